@@ -0,0 +1,257 @@
+//=================================================================================================
+// CellIndex.cpp - Implements an index over sets of evenly spaced cells
+//
+// Ranges are sorted into classes by step, and by the remainder of their first cell divided by
+// their step.  Every cell that lies within the span of a range in the class of (step, cell %
+// step) really is one of that range's cells, so a point query is one interval tree search per
+// distinct step, and never has to look at a range that merely straddles the cell.
+//
+// Two ranges with steps 'a' and 'b' can only share a cell if their first cells are the same
+// modulo gcd(a, b), so finding overlaps only searches the classes that could possibly overlap.
+// The first cell two ranges share comes from the Chinese remainder theorem.
+//=================================================================================================
+#include <algorithm>
+#include "CellIndex.h"
+using namespace std;
+
+
+//=================================================================================================
+// gcd() - Returns the greatest common divisor of two numbers
+//=================================================================================================
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b)
+    {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// inverse() - Returns the multiplicative inverse of 'a' modulo 'm', where a and m are coprime
+//=================================================================================================
+static int64_t inverse(int64_t a, int64_t m)
+{
+    int64_t r0 = m, r1 = a % m, t0 = 0, t1 = 1;
+    while (r1)
+    {
+        int64_t q = r0 / r1, t;
+        t = r0 - q * r1; r0 = r1; r1 = t;
+        t = t0 - q * t1; t0 = t1; t1 = t;
+    }
+    return (t0 % m + m) % m;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// build() - Sorts the ranges into classes and builds a tree for each class
+//=================================================================================================
+void CellIndex::build(const vector<cellrange_t>& ranges)
+{
+    ranges_ = ranges;
+    classes_.clear();
+
+    // Sort the ranges into classes.  A range with no cells at all is left out
+    for (uint32_t i = 0; i < ranges_.size(); ++i)
+    {
+        auto& r = ranges_[i];
+        if (r.step == 0 || r.last < r.first) continue;
+        classes_[r.step][r.first % r.step].order.push_back(i);
+    }
+
+    // Sort each class by first cell and build its tree
+    for (auto& step : classes_) for (auto& cls : step.second)
+    {
+        auto& tree = cls.second;
+        stable_sort(tree.order.begin(), tree.order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return ranges_[a].first < ranges_[b].first;
+        });
+        tree.maxLast.resize(tree.order.size());
+        buildTree(tree, 0, tree.order.size());
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// buildTree() - Fills in the highest last cell of every subtree
+//=================================================================================================
+uint32_t CellIndex::buildTree(tree_t& tree, size_t begin, size_t end)
+{
+    if (begin >= end) return 0;
+
+    size_t   mid     = begin + (end - begin) / 2;
+    uint32_t maxLast = ranges_[tree.order[mid]].last;
+    maxLast = max(maxLast, buildTree(tree, begin, mid));
+    maxLast = max(maxLast, buildTree(tree, mid + 1, end));
+
+    tree.maxLast[mid] = maxLast;
+    return maxLast;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// search() - Visits every range in a subtree whose span overlaps 'lo' through 'hi'
+//=================================================================================================
+template <class F>
+void CellIndex::search(const tree_t& tree, size_t begin, size_t end, uint32_t lo, uint32_t hi, F visit)
+{
+    while (begin < end)
+    {
+        size_t mid = begin + (end - begin) / 2;
+
+        // If nothing in this subtree reaches 'lo', there's nothing to find
+        if (tree.maxLast[mid] < lo) return;
+
+        // Ranges to the left start earlier, so any of them might overlap
+        search(tree, begin, mid, lo, hi, visit);
+
+        // Ranges to the right start no earlier than this one.  If this one starts after 'hi',
+        // so do they
+        auto& r = ranges_[tree.order[mid]];
+        if (r.first > hi) return;
+        if (r.last >= lo) visit(tree.order[mid]);
+
+        begin = mid + 1;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// at() - Returns the ranges that contain a cell
+//=================================================================================================
+vector<uint32_t> CellIndex::at(uint32_t cell)
+{
+    vector<uint32_t> result;
+
+    // Only one class of each step can contain the cell
+    for (auto& step : classes_)
+    {
+        auto it = step.second.find(cell % step.first);
+        if (it == step.second.end()) continue;
+        auto& tree = it->second;
+        search(tree, 0, tree.order.size(), cell, cell, [&](uint32_t i) {result.push_back(i);});
+    }
+
+    sort(result.begin(), result.end());
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// within() - Returns the ranges that contain at least one cell of 'firstCell' through 'lastCell'
+//=================================================================================================
+vector<uint32_t> CellIndex::within(uint32_t firstCell, uint32_t lastCell)
+{
+    vector<uint32_t> result;
+
+    for (auto& step : classes_) for (auto& cls : step.second)
+    {
+        auto& tree = cls.second;
+        search(tree, 0, tree.order.size(), firstCell, lastCell, [&](uint32_t i)
+        {
+            // The span overlaps, but the range might step right over the cells we want
+            auto&    r     = ranges_[i];
+            uint64_t start = max(firstCell, r.first);
+            uint64_t cell  = start + (r.step - (start - r.first) % r.step) % r.step;
+            if (cell <= min(lastCell, r.last)) result.push_back(i);
+        });
+    }
+
+    sort(result.begin(), result.end());
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// firstShared() - Returns true if two ranges have a cell in common, and the first such cell
+//=================================================================================================
+bool CellIndex::firstShared(const cellrange_t& a, const cellrange_t& b, uint32_t* cell)
+{
+    // The shared cell must be within both spans
+    uint64_t lo = max(a.first, b.first), hi = min(a.last, b.last);
+    if (lo > hi || a.step == 0 || b.step == 0) return false;
+
+    // Solve x = a.first (mod a.step) and x = b.first (mod b.step)
+    int64_t g    = gcd(a.step, b.step);
+    int64_t diff = (int64_t)b.first - (int64_t)a.first;
+    if (diff % g) return false;
+
+    // x = a.first + a.step * t, where t = (diff / g) * inverse(a.step / g) mod (b.step / g)
+    int64_t  m = b.step / g;
+    int64_t  t = ((diff / g) % m + m) % m;
+    t = (int64_t)((unsigned __int128)t * inverse((a.step / g) % m, m) % m);
+    unsigned __int128 x   = (unsigned __int128)a.first + (unsigned __int128)a.step * t;
+    unsigned __int128 lcm = (unsigned __int128)(a.step / g) * b.step;
+
+    // That's the first solution at or after a.first.  Move on to the first at or after 'lo'
+    if (x < lo) x += (lo - x + lcm - 1) / lcm * lcm;
+    if (x > hi) return false;
+
+    *cell = (uint32_t)x;
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// overlaps() - Finds every pair of ranges that have a cell in common
+//=================================================================================================
+vector<pair<uint32_t, uint32_t>> CellIndex::overlaps(size_t limit, uint64_t* total)
+{
+    vector<pair<uint32_t, uint32_t>> result;
+    uint32_t cell;
+
+    *total = 0;
+    for (uint32_t i = 0; i < ranges_.size(); ++i)
+    {
+        auto& r = ranges_[i];
+        if (r.step == 0 || r.last < r.first) continue;
+
+        vector<uint32_t> found;
+        for (auto& step : classes_)
+        {
+            // Only the classes whose first cells match ours modulo the gcd of the steps can
+            // share a cell with us.  Look them up or walk through them, whichever is quicker
+            uint32_t g       = gcd(r.step, step.first);
+            uint32_t residue = r.first % g;
+            auto&    classes = step.second;
+
+            auto searchClass = [&](tree_t& tree)
+            {
+                search(tree, 0, tree.order.size(), r.first, r.last, [&](uint32_t j)
+                {
+                    if (j > i && firstShared(r, ranges_[j], &cell)) found.push_back(j);
+                });
+            };
+
+            if (classes.size() <= step.first / g)
+            {
+                for (auto& cls : classes) if (cls.first % g == residue) searchClass(cls.second);
+            }
+            else for (uint32_t k = residue; k < step.first; k += g)
+            {
+                auto it = classes.find(k);
+                if (it != classes.end()) searchClass(it->second);
+            }
+        }
+
+        // Keep the pairs in order
+        *total += found.size();
+        sort(found.begin(), found.end());
+        for (auto j : found) if (result.size() < limit) result.push_back(make_pair(i, j));
+    }
+
+    return result;
+}
+//=================================================================================================
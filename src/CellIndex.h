@@ -0,0 +1,72 @@
+//=================================================================================================
+// CellIndex.h - Defines an index over sets of evenly spaced cells (such as the distribution
+//               records) for finding which sets cover a cell or a range of cells, and which sets
+//               have cells in common
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <map>
+#include <utility>
+
+class CellIndex
+{
+public:
+
+    // The cells first, first + step, first + 2*step ... up to and including last
+    struct cellrange_t
+    {
+        uint32_t first, last, step;
+    };
+
+    // Constructor
+    CellIndex() {}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    CellIndex (const CellIndex&) = delete;
+    CellIndex& operator= (const CellIndex&) = delete;
+
+    // Builds the index.  Ranges are referred to by their position in 'ranges'
+    void    build(const std::vector<cellrange_t>& ranges);
+
+    // Returns the ranges that contain 'cell', in ascending order
+    std::vector<uint32_t> at(uint32_t cell);
+
+    // Returns the ranges that contain at least one of the cells 'firstCell' through 'lastCell',
+    // in ascending order
+    std::vector<uint32_t> within(uint32_t firstCell, uint32_t lastCell);
+
+    // Finds every pair of ranges that have a cell in common.  Returns up to 'limit' of them as
+    // (earlier, later) pairs in ascending order, and the number of pairs there are in all
+    std::vector<std::pair<uint32_t, uint32_t>> overlaps(size_t limit, uint64_t* total);
+
+    // Returns true if two ranges have a cell in common, and which cell is the first of them
+    static bool firstShared(const cellrange_t& a, const cellrange_t& b, uint32_t* cell);
+
+    // Returns the range with the specified index
+    const cellrange_t& range(uint32_t index) {return ranges_[index];}
+
+protected:
+
+    // The ranges with the same step whose first cells are the same modulo the step, sorted by
+    // first cell.  It's an implicit binary tree: the root of order[begin, end) is the midpoint,
+    // and maxLast[midpoint] is the highest last cell of any range in [begin, end)
+    struct tree_t
+    {
+        std::vector<uint32_t> order, maxLast;
+    };
+
+    // Fills in maxLast for order[begin, end), and returns the highest last cell in it
+    uint32_t buildTree(tree_t& tree, size_t begin, size_t end);
+
+    // Calls 'visit' for every range in order[begin, end) whose span overlaps 'lo' through 'hi'
+    template <class F>
+    void    search(const tree_t& tree, size_t begin, size_t end, uint32_t lo, uint32_t hi, F visit);
+
+    // The ranges
+    std::vector<cellrange_t> ranges_;
+
+    // A tree for every step, and every remainder of first cell divided by that step
+    std::map<uint32_t, std::map<uint32_t, tree_t>> classes_;
+};
@@ -0,0 +1,149 @@
+//=================================================================================================
+// ChannelReader.cpp - Implements a class that reads frames from a shared-memory frame channel
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdexcept>
+#include "ChannelReader.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// attach() - Connects to the producer, receives the memfd, and maps the channel
+//=================================================================================================
+void ChannelReader::attach(const char* socketName)
+{
+    channel_welcome_t welcome;
+    int               memfd = -1;
+
+    // Make sure we're not already attached
+    detach();
+
+    // Build the address of the producer's socket
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketName) >= sizeof(addr.sun_path)) throwRuntime("%s: name too long", socketName);
+    strcpy(addr.sun_path, socketName);
+
+    // Connect to the producer
+    socket_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_ < 0) throwRuntime("Can't create socket");
+    if (connect(socket_, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        throwRuntime("Can't connect to %s: %s", socketName, strerror(errno));
+    }
+
+    // Receive the welcome message, which carries the memfd
+    struct iovec iov = {&welcome, sizeof(welcome)};
+    char control[CMSG_SPACE(sizeof(int))];
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket_, &msg, MSG_CMSG_CLOEXEC) != sizeof(welcome))
+    {
+        throwRuntime("%s turned us away (too many consumers?)", socketName);
+    }
+
+    // Fetch the memfd from the message
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    {
+        memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (memfd < 0) throwRuntime("%s didn't send the shared memory", socketName);
+
+    // Map the channel.  Once it's mapped, we no longer need the memfd
+    void* ptr = mmap(0, welcome.channelSize, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    ::close(memfd);
+    if (ptr == MAP_FAILED) throwRuntime("Can't map shared memory: %s", strerror(errno));
+    map_     = (uint8_t*)ptr;
+    mapSize_ = welcome.channelSize;
+    header_  = (channel_header_t*)ptr;
+    index_   = welcome.consumerIndex;
+
+    // Make sure this really is a frame channel
+    if (memcmp(header_->magic, CHANNEL_MAGIC, sizeof(header_->magic)) != 0)
+    {
+        detach();
+        throwRuntime("%s is not a frame channel", socketName);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// nextFrame() - Waits for the next frame to be published
+//
+// Returns: A pointer to the frame, or nullptr if the producer has finished
+//=================================================================================================
+const uint8_t* ChannelReader::nextFrame()
+{
+    uint64_t frameNumber = header_->consumer[index_].readCursor;
+
+    // Wait for the producer to publish the frame
+    while (__atomic_load_n(&header_->writeCursor, __ATOMIC_ACQUIRE) <= frameNumber)
+    {
+        uint32_t seq = __atomic_load_n(&header_->writeSeq, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header_->writeCursor, __ATOMIC_ACQUIRE) > frameNumber) break;
+        if (__atomic_load_n(&header_->finished, __ATOMIC_ACQUIRE)) return nullptr;
+        futexWait(&header_->writeSeq, seq, 100);
+    }
+
+    // Hand the caller a pointer to the slot that holds it
+    return map_ + header_->dataOffset + (frameNumber % header_->slotCount) * header_->slotSize;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// release() - Tells the producer we're done with the current frame
+//=================================================================================================
+void ChannelReader::release()
+{
+    auto& c = header_->consumer[index_];
+    __atomic_store_n(&c.readCursor, c.readCursor + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header_->readSeq, 1, __ATOMIC_RELEASE);
+    futexWake(&header_->readSeq);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// detach() - Unmaps the channel and closes our connection, which frees our consumer slot
+//=================================================================================================
+void ChannelReader::detach()
+{
+    if (header_) munmap(map_, mapSize_);
+    if (socket_ >= 0) ::close(socket_);
+    header_ = nullptr;
+    socket_ = -1;
+}
+//=================================================================================================
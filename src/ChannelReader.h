@@ -0,0 +1,55 @@
+//=================================================================================================
+// ChannelReader.h - Defines a class that a consumer uses to read frames from a shared-memory
+//                   frame channel (see FrameChannel.h) without copying them
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "channel.h"
+
+class ChannelReader
+{
+public:
+
+    // Constructor
+    ChannelReader() {socket_ = -1; header_ = nullptr;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    ChannelReader (const ChannelReader&) = delete;
+    ChannelReader& operator= (const ChannelReader&) = delete;
+
+    // Destructor, detaches from the channel
+    ~ChannelReader() {detach();}
+
+    // Connects to the producer listening on 'socketName' and maps the channel
+    void    attach(const char* socketName);
+
+    // Detaches from the channel
+    void    detach();
+
+    // Returns the channel header, which describes the geometry of the frames
+    const channel_header_t& header() {return *header_;}
+
+    // Waits for the next frame and returns a pointer to it, or nullptr if the producer has
+    // finished.  The frame stays valid until release() is called
+    const uint8_t* nextFrame();
+
+    // Hands the frame returned by nextFrame() back to the producer
+    void    release();
+
+    // Returns the number of the frame that nextFrame() will return next
+    uint64_t frameNumber() {return header_->consumer[index_].readCursor;}
+
+protected:
+
+    // The connection to the producer.  Closing it detaches us
+    int     socket_;
+
+    // Where the channel is mapped, and how big it is
+    channel_header_t* header_;
+    uint8_t* map_;
+    size_t  mapSize_;
+
+    // Our consumer slot in the channel header
+    uint32_t index_;
+};
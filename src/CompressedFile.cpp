@@ -0,0 +1,303 @@
+//=================================================================================================
+// CompressedFile.cpp - Implements a class that writes data frames to a compressed output file
+//
+// Frames are gathered into fixed-size chunks.   Each full chunk is handed to a pool of threads
+// that compress chunks independently of each other, while the caller goes on building frames.
+// Compressed chunks are written to the file in order, and an index of where each chunk lives is
+// written at the end so that readers can decompress any chunk (or all of them in parallel).
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdexcept>
+#include "CompressedFile.h"
+#include "codec.h"
+#include "crc32c.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Creates the output file and starts the compression threads
+//=================================================================================================
+void CompressedFile::create(const char* filename, const compressed_header_t& header)
+{
+    // Make sure we don't already have a file open
+    close();
+
+    // Create the output file, and complain if we can't
+    fd_ = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd_ < 0) throwRuntime("Can't create %s", filename);
+
+    // Save our parameters for future use
+    filename_   = filename;
+    header_     = header;
+    frameSize_  = header.cellsPerFrame;
+    chunkSize_  = (size_t)header.cellsPerFrame * header.framesPerChunk;
+
+    // The chunk index stores sizes as 32-bit values
+    if (header.framesPerChunk == 0 || chunkSize_ > 0xFFFFFFFF)
+    {
+        throwRuntime("Invalid number of frames per compressed chunk");
+    }
+
+    // Nothing has been written yet
+    current_     = nullptr;
+    offset_      = COMPRESSED_DATA_OFFSET;
+    rawBytes_    = 0;
+    packedBytes_ = 0;
+    stopping_    = false;
+    index_.clear();
+
+    // Start one compression thread per core
+    uint32_t threadCount = thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+    for (uint32_t i = 0; i < threadCount; ++i) threads_.emplace_back(&CompressedFile::compressThread, this);
+
+    // Allow enough chunks in flight to keep every thread busy while we write
+    maxInFlight_ = 2 * threadCount;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// append() - Writes a buffer to the end of the output file
+//=================================================================================================
+void CompressedFile::append(const void* buffer, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)buffer;
+
+    while (length)
+    {
+        ssize_t rc = pwrite(fd_, p, length, offset_);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) throwRuntime("Write to %s failed: %s", filename_, strerror(errno));
+        p       += rc;
+        offset_ += rc;
+        length  -= rc;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFrame() - Copies a frame into the current chunk, and submits the chunk for compression
+//                once it's full
+//=================================================================================================
+void CompressedFile::writeFrame(const uint8_t* frame)
+{
+    // If we don't have a chunk to fill, re-use a spare one or allocate a new one
+    if (current_ == nullptr)
+    {
+        {
+            lock_guard<mutex> guard(lock_);
+            if (!spare_.empty())
+            {
+                current_ = spare_.back();
+                spare_.pop_back();
+            }
+        }
+
+        if (current_ == nullptr)
+        {
+            current_ = new chunk_t;
+            current_->raw.resize(chunkSize_);
+            current_->packed.resize(compressBound(chunkSize_));
+        }
+
+        current_->rawSize = 0;
+        current_->ready   = false;
+    }
+
+    // Append this frame to the chunk
+    memcpy(current_->raw.data() + current_->rawSize, frame, frameSize_);
+    current_->rawSize += frameSize_;
+
+    // If the chunk is full, send it off to be compressed
+    if (current_->rawSize == chunkSize_) submitChunk();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// submitChunk() - Hands the current chunk to the compression threads
+//=================================================================================================
+void CompressedFile::submitChunk()
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        pending_.push_back(current_);
+        inFlight_.push_back(current_);
+    }
+    workAvailable_.notify_one();
+    current_ = nullptr;
+
+    // Write whatever is finished.   If too many chunks are in flight, wait for the oldest one
+    // so that memory usage stays bounded
+    drainChunks(inFlight_.size() >= maxInFlight_);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// drainChunks() - Writes every finished chunk at the front of the in-flight queue to the file
+//=================================================================================================
+void CompressedFile::drainChunks(bool wait)
+{
+    unique_lock<mutex> guard(lock_);
+
+    // If we've been asked to, wait for the oldest chunk to finish compressing
+    if (wait && !inFlight_.empty())
+    {
+        workDone_.wait(guard, [this]() {return inFlight_.front()->ready;});
+    }
+
+    while (!inFlight_.empty() && inFlight_.front()->ready)
+    {
+        chunk_t* chunk = inFlight_.front();
+        inFlight_.pop_front();
+        guard.unlock();
+
+        // If compression didn't help, store the chunk as-is
+        bool stored = chunk->packedSize >= chunk->rawSize;
+
+        // Build the index entry for this chunk
+        chunk_index_t entry;
+        entry.offset     = offset_;
+        entry.rawSize    = chunk->rawSize;
+        entry.packedSize = stored ? chunk->rawSize : chunk->packedSize;
+        entry.crc        = chunk->crc;
+        entry.reserved   = 0;
+        index_.push_back(entry);
+
+        // Write the chunk to the file
+        append(stored ? chunk->raw.data() : chunk->packed.data(), entry.packedSize);
+        rawBytes_    += entry.rawSize;
+        packedBytes_ += entry.packedSize;
+
+        // And this chunk can be re-used
+        guard.lock();
+        spare_.push_back(chunk);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// compressThread() - Compresses chunks until we're told to stop
+//=================================================================================================
+void CompressedFile::compressThread()
+{
+    while (true)
+    {
+        unique_lock<mutex> guard(lock_);
+
+        // Wait for a chunk to compress
+        workAvailable_.wait(guard, [this]() {return stopping_ || !pending_.empty();});
+
+        // If there's nothing to do, it's because we've been told to stop
+        if (pending_.empty()) return;
+
+        // Take the oldest chunk that hasn't been compressed
+        chunk_t* chunk = pending_.front();
+        pending_.pop_front();
+        guard.unlock();
+
+        // Checksum and compress it
+        chunk->crc        = crc32c(0, chunk->raw.data(), chunk->rawSize);
+        chunk->packedSize = compressBlock(chunk->raw.data(), chunk->rawSize, chunk->packed.data());
+
+        // And tell the writer that it's ready
+        guard.lock();
+        chunk->ready = true;
+        workDone_.notify_all();
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stopThreads() - Tells the compression threads to quit and waits for them to do so
+//=================================================================================================
+void CompressedFile::stopThreads()
+{
+    {
+        lock_guard<mutex> guard(lock_);
+        stopping_ = true;
+    }
+    workAvailable_.notify_all();
+    for (auto& t : threads_) t.join();
+    threads_.clear();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Writes any partial chunk, waits for every chunk to be written, then writes the chunk
+//           index and the header
+//=================================================================================================
+void CompressedFile::close()
+{
+    // If the file isn't open, there's nothing to do
+    if (fd_ < 0) return;
+
+    // The last chunk may be a partial one
+    if (current_ && current_->rawSize) submitChunk();
+
+    // Wait for every chunk to be compressed and written
+    while (!inFlight_.empty()) drainChunks(true);
+
+    // We're done with the compression threads
+    stopThreads();
+
+    // Fill in the fields that describe where everything is in the file
+    header_.headerSize  = sizeof(header_);
+    header_.frameCount  = rawBytes_ / frameSize_;
+    header_.chunkCount  = index_.size();
+    header_.indexOffset = offset_;
+    header_.headerCrc   = crc32c(0, &header_, offsetof(compressed_header_t, headerCrc));
+
+    // Write the chunk index, then the header
+    append(index_.data(), index_.size() * sizeof(chunk_index_t));
+    offset_ = 0;
+    append(&header_, sizeof(header_));
+
+    // And close the file
+    ::close(fd_);
+    fd_ = -1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// Destructor - Stops the compression threads and frees the chunk buffers
+//=================================================================================================
+CompressedFile::~CompressedFile()
+{
+    if (!threads_.empty()) stopThreads();
+    if (fd_ >= 0) ::close(fd_);
+
+    delete current_;
+    for (auto chunk : inFlight_) delete chunk;
+    for (auto chunk : spare_) delete chunk;
+}
+//=================================================================================================
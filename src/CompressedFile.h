@@ -0,0 +1,109 @@
+//=================================================================================================
+// CompressedFile.h - Defines a class that writes data frames to a compressed output file
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "container.h"
+#include "FrameSink.h"
+
+class CompressedFile : public FrameSink
+{
+public:
+
+    // Constructor
+    CompressedFile() {fd_ = -1; current_ = nullptr;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    CompressedFile (const CompressedFile&) = delete;
+    CompressedFile& operator= (const CompressedFile&) = delete;
+
+    // Destructor, stops the compression threads and closes the file
+    ~CompressedFile();
+
+    // Creates the output file.  'header' describes the run, the layout fields are filled in
+    // when the file is closed
+    void    create(const char* filename, const compressed_header_t& header);
+
+    // Call this to append a single data frame to the output file
+    void    writeFrame(const uint8_t* frame);
+
+    // Writes any partial chunk, waits for compression to finish, and closes the file
+    void    close();
+
+    // Call these to find out how many bytes went in and how many bytes came out
+    uint64_t rawBytes()    {return rawBytes_;}
+    uint64_t packedBytes() {return packedBytes_;}
+
+protected:
+
+    // A chunk of frames on its way to the file
+    struct chunk_t
+    {
+        std::vector<uint8_t> raw, packed;
+        size_t   rawSize, packedSize;
+        uint32_t crc;
+        bool     ready;
+    };
+
+    // Hands the current chunk to the compression threads
+    void    submitChunk();
+
+    // Writes every chunk at the front of the queue that has finished compressing.  If 'wait'
+    // is true, waits for at least the oldest chunk to finish
+    void    drainChunks(bool wait);
+
+    // The body of each compression thread
+    void    compressThread();
+
+    // Writes a buffer to the end of the output file
+    void    append(const void* buffer, size_t length);
+
+    // Stops the compression threads
+    void    stopThreads();
+
+    // The file descriptor and name of the output file
+    int     fd_;
+    const char* filename_;
+
+    // The header we'll write at the end
+    compressed_header_t header_;
+
+    // The number of bytes in a frame and in a full chunk
+    size_t  frameSize_, chunkSize_;
+
+    // The chunk currently being filled with frames
+    chunk_t* current_;
+
+    // Chunks that are compressing or waiting to be written, in file order
+    std::deque<chunk_t*> inFlight_;
+
+    // Chunks waiting for a compression thread to pick them up
+    std::deque<chunk_t*> pending_;
+
+    // Chunks that have been written and can be re-used
+    std::vector<chunk_t*> spare_;
+
+    // The most chunks we allow to be in flight at once
+    size_t  maxInFlight_;
+
+    // The compression threads and the objects that coordinate them
+    std::vector<std::thread> threads_;
+    std::mutex               lock_;
+    std::condition_variable  workAvailable_, workDone_;
+    bool                     stopping_;
+
+    // The index entry for every chunk that has been written
+    std::vector<chunk_index_t> index_;
+
+    // The file offset where the next chunk will be written
+    uint64_t offset_;
+
+    // Statistics for the report at the end of a run
+    uint64_t rawBytes_, packedBytes_;
+};
@@ -0,0 +1,79 @@
+//=================================================================================================
+// Consumer.cpp - Implements a class that emulates the consumer of a shared-memory frame channel
+//
+// The consumer reads each frame in place, checks its frame marker if it has one, and hands the
+// slot back to the producer.  The clock starts when the first frame arrives, so the time spent
+// waiting for the producer to get going isn't counted.  Frame 'n' is due at start + n / rate.
+//=================================================================================================
+#include <errno.h>
+#include <time.h>
+#include "Consumer.h"
+using namespace std;
+
+
+//=================================================================================================
+// now() - Returns the current time in nanoseconds
+//=================================================================================================
+static uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// sleepUntil() - Sleeps until the specified time (in nanoseconds)
+//=================================================================================================
+static void sleepUntil(uint64_t deadline)
+{
+    struct timespec ts;
+    ts.tv_sec  = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// run() - Reads frames until the producer finishes
+//=================================================================================================
+void Consumer::run(double frameRate, uint32_t markerCell)
+{
+    uint32_t cellsPerFrame = reader_.header().cellsPerFrame;
+    double   period = frameRate > 0 ? 1e9 / frameRate : 0;
+    uint64_t start  = 0;
+
+    framesConsumed_ = missedDeadlines_ = 0;
+    elapsed_ = waiting_ = 0;
+    checker_.create(cellsPerFrame, markerCell);
+
+    for (uint64_t n = 0;; ++n)
+    {
+        // If we're pacing ourselves, wait until this frame is due
+        uint64_t deadline = start + (uint64_t)(n * period);
+        if (period && n) sleepUntil(deadline);
+
+        // Wait for the producer to publish the frame
+        uint64_t before = now();
+        const uint8_t* frame = reader_.nextFrame();
+        if (frame == nullptr) break;
+        uint64_t after = now();
+
+        // The clock starts with the first frame
+        if (n == 0) start = deadline = after;
+        else waiting_ += after - before;
+
+        // Check the frame marker, then hand the slot back
+        if (markerCell) checker_.check(frame, 1);
+        reader_.release();
+        ++framesConsumed_;
+
+        // If we're pacing ourselves, note whether we kept up
+        if (period && now() > deadline + period) ++missedDeadlines_;
+    }
+
+    if (framesConsumed_) elapsed_ = now() - start;
+}
+//=================================================================================================
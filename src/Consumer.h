@@ -0,0 +1,57 @@
+//=================================================================================================
+// Consumer.h - Defines a class that emulates the consumer of a shared-memory frame channel, so
+//              that the producer's sustained throughput can be measured without hardware
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "ChannelReader.h"
+#include "MarkerChecker.h"
+
+class Consumer
+{
+public:
+
+    // Constructor
+    Consumer() {}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    Consumer (const Consumer&) = delete;
+    Consumer& operator= (const Consumer&) = delete;
+
+    // Attaches to the producer listening on 'socketName'
+    void    attach(const char* socketName) {reader_.attach(socketName);}
+
+    // Returns the channel header, which describes the geometry of the frames
+    const channel_header_t& header() {return reader_.header();}
+
+    // Reads frames until the producer finishes.  If 'frameRate' is 0 frames are read as fast as
+    // possible, otherwise at 'frameRate' frames per second.  If 'markerCell' is not 0, the frame
+    // marker in every frame is checked (see marker.h)
+    void    run(double frameRate, uint32_t markerCell);
+
+    // Detaches from the channel
+    void    detach() {reader_.detach();}
+
+    // Returns the checker that examined the frame markers
+    MarkerChecker& checker() {return checker_;}
+
+    // Statistics about the run.  Times are in nanoseconds.  "Waiting" is the time spent waiting
+    // for the producer to publish a frame, which is the consumer's headroom
+    uint64_t framesConsumed()  {return framesConsumed_;}
+    uint64_t missedDeadlines() {return missedDeadlines_;}
+    double   elapsed()         {return elapsed_;}
+    double   waiting()         {return waiting_;}
+
+protected:
+
+    // Reads frames from the channel
+    ChannelReader reader_;
+
+    // Checks the frame markers
+    MarkerChecker checker_;
+
+    // Statistics about the run
+    uint64_t framesConsumed_, missedDeadlines_;
+    double   elapsed_, waiting_;
+};
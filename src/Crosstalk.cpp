@@ -0,0 +1,290 @@
+//=================================================================================================
+// Crosstalk.cpp - Implements a model of the crosstalk between neighbouring cells
+//
+// A frame is a grid of cells, 'rowSize' cells wide.  Each cell reads the weighted sum of itself
+// and its neighbours, shifted right, and clamped to 0 - 255.  Cells past the edges of the grid
+// are taken to be the nearest edge cell.
+//
+// The arithmetic is done in 16-bit lanes, sixteen cells at a time: the running sum starts at
+// the rounding bias, each weighted neighbour is added with signed saturation in row-major
+// order, and the result is shifted and packed back to bytes with unsigned saturation.
+// applyCell() does exactly the same arithmetic one cell at a time, so a traced cell always
+// matches the frame it came from.
+//
+// The frame is changed in place.  It's cut into stripes of whole rows, one per thread, and
+// each thread walks its stripe a row at a time, keeping copies of the rows above, at, and below
+// the one it's writing.  Those three rows fit easily in L1, and are the only thing read while
+// computing a row.  The rows just outside each stripe are copied before any thread starts, so
+// neighbouring stripes never see each other's output.
+//=================================================================================================
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdexcept>
+#include <thread>
+#include "Crosstalk.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// A stripe is never shorter than this many rows, so that small frames aren't split across
+// threads that would cost more to start than they save
+static const uint32_t MIN_STRIPE_ROWS = 64;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// clear() - Turns crosstalk off
+//=================================================================================================
+void Crosstalk::clear()
+{
+    memset(&stencil_, 0, sizeof(stencil_));
+    rowCount_ = 0;
+    taps_.clear();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// set() - Sets the stencil from a list of 3 or 9 weights
+//=================================================================================================
+void Crosstalk::set(const vector<int32_t>& weights, uint32_t shift, uint32_t rowSize)
+{
+    stencil_t stencil;
+    memset(&stencil, 0, sizeof(stencil));
+
+    if (weights.size() != 3 && weights.size() != 9) throwRuntime("A crosstalk kernel has 3 or 9 weights");
+
+    // A 1x3 kernel is the middle row of a 3x3 one
+    size_t first = (weights.size() == 3) ? 3 : 0;
+    for (size_t i = 0; i < weights.size(); ++i)
+    {
+        if (weights[i] < -128 || weights[i] > 127) throwRuntime("Crosstalk weights must be between -128 and 127");
+        stencil.weights[first + i] = weights[i];
+    }
+
+    stencil.shift   = shift;
+    stencil.rowSize = rowSize;
+    set(stencil);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// set() - Sets the stencil
+//=================================================================================================
+void Crosstalk::set(const stencil_t& stencil)
+{
+    if (stencil.shift > 15) throwRuntime("The crosstalk shift must be between 0 and 15");
+    if (stencil.rowSize % 8) throwRuntime("The crosstalk row size must be a multiple of 8");
+
+    stencil_ = stencil;
+    taps_.clear();
+    for (int k = 0; k < 9; ++k) if (stencil_.weights[k]) taps_.push_back(k);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// compile() - Prepares to apply the stencil to frames of a particular size
+//=================================================================================================
+void Crosstalk::compile(uint32_t cellsPerFrame)
+{
+    if (!enabled()) return;
+
+    if (cellsPerFrame % stencil_.rowSize)
+    {
+        throwRuntime("A frame of %u cells isn't a whole number of %u cell rows", cellsPerFrame, stencil_.rowSize);
+    }
+
+    rowCount_ = cellsPerFrame / stencil_.rowSize;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// neighbour() - Returns the cell under weight 'k' of the stencil, clamped to the frame
+//=================================================================================================
+uint32_t Crosstalk::neighbour(uint32_t cellNumber, int k) const
+{
+    int64_t row = (int64_t)(cellNumber / stencil_.rowSize) + k / 3 - 1;
+    int64_t col = (int64_t)(cellNumber % stencil_.rowSize) + k % 3 - 1;
+
+    row = min<int64_t>(max<int64_t>(row, 0), rowCount_ - 1);
+    col = min<int64_t>(max<int64_t>(col, 0), stencil_.rowSize - 1);
+    return row * stencil_.rowSize + col;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// applyCell() - Returns what a cell reads, given the values of the 9 cells under the stencil
+//=================================================================================================
+uint8_t Crosstalk::applyCell(const uint8_t* values) const
+{
+    int32_t sum = stencil_.shift ? 1 << (stencil_.shift - 1) : 0;
+
+    for (int k : taps_)
+    {
+        sum += values[k] * stencil_.weights[k];
+        sum  = min(max(sum, -32768), 32767);
+    }
+
+    sum >>= stencil_.shift;
+    return (uint8_t)min(max(sum, 0), 255);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// padRow() - Copies a row into a buffer with one extra cell on each end
+//=================================================================================================
+void Crosstalk::padRow(const uint8_t* row, uint8_t* padded) const
+{
+    memcpy(padded + 1, row, stencil_.rowSize);
+    padded[0] = row[0];
+    padded[stencil_.rowSize + 1] = row[stencil_.rowSize - 1];
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// computeRow() - Computes one row of output.  rows[0..2] are padded copies of the rows above,
+//                at, and below the output row
+//=================================================================================================
+void Crosstalk::computeRow(const uint8_t* const rows[3], uint8_t* out) const
+{
+    uint32_t x = 0;
+
+#if defined(__x86_64__)
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i bias  = _mm_set1_epi16(stencil_.shift ? 1 << (stencil_.shift - 1) : 0);
+    const __m128i shift = _mm_cvtsi32_si128(stencil_.shift);
+    __m128i weight[9];
+    for (int k : taps_) weight[k] = _mm_set1_epi16(stencil_.weights[k]);
+
+    // Sixteen cells at a time, as two sets of eight 16-bit lanes
+    for (; x + 16 <= stencil_.rowSize; x += 16)
+    {
+        __m128i lo = bias, hi = bias;
+        for (int k : taps_)
+        {
+            __m128i cells = _mm_loadu_si128((const __m128i*)(rows[k / 3] + x + k % 3));
+            lo = _mm_adds_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(cells, zero), weight[k]));
+            hi = _mm_adds_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(cells, zero), weight[k]));
+        }
+        lo = _mm_sra_epi16(lo, shift);
+        hi = _mm_sra_epi16(hi, shift);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    // Whatever is left (or everything, without SSE2) is done one cell at a time
+    for (; x < stencil_.rowSize; ++x)
+    {
+        uint8_t values[9];
+        for (int k = 0; k < 9; ++k) values[k] = rows[k / 3][x + k % 3];
+        out[x] = applyCell(values);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// applyRows() - Applies the stencil to a stripe of rows, in place
+//=================================================================================================
+void Crosstalk::applyRows(uint8_t* frame, uint32_t firstRow, uint32_t endRow,
+                          const uint8_t* above, const uint8_t* below) const
+{
+    const uint32_t rowSize = stencil_.rowSize;
+
+    // Padded copies of the rows above, at, and below the one being written
+    vector<uint8_t> buffer[3];
+    for (auto& b : buffer) b.resize(rowSize + 2);
+    uint8_t* window[3] = {buffer[0].data(), buffer[1].data(), buffer[2].data()};
+
+    memcpy(window[0], above, rowSize + 2);
+    padRow(frame + (uint64_t)firstRow * rowSize, window[1]);
+
+    for (uint32_t row = firstRow; row < endRow; ++row)
+    {
+        // Fetch the row below before this one is overwritten
+        if (row + 1 < endRow)
+            padRow(frame + (uint64_t)(row + 1) * rowSize, window[2]);
+        else
+            memcpy(window[2], below, rowSize + 2);
+
+        computeRow(window, frame + (uint64_t)row * rowSize);
+
+        // Slide the window down a row
+        uint8_t* oldest = window[0];
+        window[0] = window[1];
+        window[1] = window[2];
+        window[2] = oldest;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// apply() - Applies the stencil to a frame in place, a stripe of rows per thread
+//=================================================================================================
+void Crosstalk::apply(uint8_t* frame, uint32_t maxThreads) const
+{
+    if (!enabled() || rowCount_ == 0) return;
+
+    const uint32_t rowSize = stencil_.rowSize;
+
+    // Decide how many stripes to cut the frame into
+    uint32_t stripes = rowCount_ / MIN_STRIPE_ROWS;
+    if (stripes > maxThreads) stripes = maxThreads;
+    if (stripes == 0) stripes = 1;
+
+    // Copy the rows just above and below every stripe before any of them change
+    vector<uint8_t> halo((size_t)stripes * 2 * (rowSize + 2));
+    for (uint32_t s = 0; s < stripes; ++s)
+    {
+        uint32_t firstRow = (uint64_t)rowCount_ * s / stripes;
+        uint32_t endRow   = (uint64_t)rowCount_ * (s + 1) / stripes;
+        uint32_t aboveRow = firstRow ? firstRow - 1 : 0;
+        uint32_t belowRow = endRow < rowCount_ ? endRow : rowCount_ - 1;
+        padRow(frame + (uint64_t)aboveRow * rowSize, &halo[(2 * s    ) * (rowSize + 2)]);
+        padRow(frame + (uint64_t)belowRow * rowSize, &halo[(2 * s + 1) * (rowSize + 2)]);
+    }
+
+    // Apply the stencil to each stripe
+    auto applyStripe = [&](uint32_t s)
+    {
+        applyRows(frame, (uint64_t)rowCount_ * s / stripes, (uint64_t)rowCount_ * (s + 1) / stripes,
+                  &halo[(2 * s) * (rowSize + 2)], &halo[(2 * s + 1) * (rowSize + 2)]);
+    };
+
+    if (stripes == 1)
+    {
+        applyStripe(0);
+        return;
+    }
+
+    vector<thread> threads;
+    for (uint32_t s = 0; s < stripes; ++s) threads.emplace_back(applyStripe, s);
+    for (auto& t : threads) t.join();
+}
+//=================================================================================================
@@ -0,0 +1,76 @@
+//=================================================================================================
+// Crosstalk.h - Defines a model of the crosstalk between neighbouring cells: a 3x3 (or 1x3)
+//               stencil applied to the grid of cells that makes up a frame
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class Crosstalk
+{
+public:
+
+    // The stencil.  Weights are in row-major order, the middle one is the cell itself, and the
+    // weighted sum is shifted right by 'shift'.  A row size of 0 means there is no crosstalk
+    struct stencil_t
+    {
+        int16_t  weights[9];
+        uint16_t shift;
+        uint32_t rowSize;
+    };
+
+    // Constructor
+    Crosstalk() {clear();}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    Crosstalk (const Crosstalk&) = delete;
+    Crosstalk& operator= (const Crosstalk&) = delete;
+
+    // Turns crosstalk off
+    void    clear();
+
+    // Sets the stencil from 3 weights (left, self, right) or 9 (a 3x3 grid, row by row), over
+    // rows of 'rowSize' cells
+    void    set(const std::vector<int32_t>& weights, uint32_t shift, uint32_t rowSize);
+    void    set(const stencil_t& stencil);
+
+    // Prepares to apply the stencil to frames of 'cellsPerFrame' cells
+    void    compile(uint32_t cellsPerFrame);
+
+    // Returns true if there is a stencil to apply
+    bool    enabled() const {return stencil_.rowSize != 0;}
+
+    // Applies the stencil to a frame in place, using up to 'maxThreads' threads
+    void    apply(uint8_t* frame, uint32_t maxThreads) const;
+
+    // Returns the cell (numbered from 0) under weight 'k' of the stencil when it's centered on
+    // 'cellNumber'.  Cells past the edges of the frame are the nearest edge cell
+    uint32_t neighbour(uint32_t cellNumber, int k) const;
+
+    // Returns what a cell reads, given the values of the 9 cells under the stencil
+    uint8_t applyCell(const uint8_t* values) const;
+
+    // Returns the stencil
+    const stencil_t& stencil() const {return stencil_;}
+
+protected:
+
+    // Applies the stencil to rows 'firstRow' through 'endRow' - 1.  'above' and 'below' are
+    // copies of the rows just outside that range, as they were before any row was changed
+    void    applyRows(uint8_t* frame, uint32_t firstRow, uint32_t endRow,
+                      const uint8_t* above, const uint8_t* below) const;
+
+    // Computes one row of output from padded copies of the three rows around it
+    void    computeRow(const uint8_t* const rows[3], uint8_t* out) const;
+
+    // Copies a row into a padded row buffer, repeating the edge cells into the padding
+    void    padRow(const uint8_t* row, uint8_t* padded) const;
+
+    // The stencil, and the number of rows in a frame
+    stencil_t stencil_;
+    uint32_t  rowCount_;
+
+    // The weights that aren't 0, as indexes into stencil_.weights
+    std::vector<int> taps_;
+};
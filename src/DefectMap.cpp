@@ -0,0 +1,245 @@
+//=================================================================================================
+// DefectMap.cpp - Implements a map of defective cells
+//
+// A defect file has one defective cell per line.  Blank lines and anything after a '#' are
+// ignored:
+//
+//     <cell>, dead            : the cell always reads 0
+//     <cell>, stuck, <value>  : the cell always reads <value>
+//     <cell>, hot [, <bits>]  : the cell reads with <bits> (default 0x80) stuck at one
+//
+// Cells are numbered from 1, as they are in the distribution file.  Values can be decimal or
+// hex ("0x...").
+//
+// Every defect is "(value & keep) | stuck", so the whole map compiles down to a keep mask and an
+// overlay of stuck bits.  Only the 16-byte blocks of the frame that contain a defect are kept,
+// and applying the map touches nothing else: a handful of defects costs a handful of blends, not
+// a pass over the frame.
+//=================================================================================================
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <fstream>
+#include <algorithm>
+#include <set>
+#include "DefectMap.h"
+#include "GlibcRandom.h"
+#include "simd.h"
+using namespace std;
+
+// The stuck bits of a hot cell, unless the defect file says otherwise
+static const uint8_t DEFAULT_HOT_BITS = 0x80;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// clear() - Empties the map
+//=================================================================================================
+void DefectMap::clear()
+{
+    defects_.clear();
+    offsets_.clear();
+    keep_.clear();
+    stuck_.clear();
+    cellsPerFrame_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// add() - Adds a defective cell
+//=================================================================================================
+void DefectMap::add(uint32_t cell, uint8_t keep, uint8_t stuck)
+{
+    if (cell == 0) throwRuntime("Defective cells are numbered from 1");
+    defects_.push_back({cell, keep, stuck, 0});
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// load() - Adds the defective cells listed in a defect file
+//=================================================================================================
+void DefectMap::load(const string& filename)
+{
+    string line;
+    int    lineNumber = 0;
+
+    ifstream file(filename);
+    if (!file.is_open()) throwRuntime("Can't open %s", filename.c_str());
+
+    while (getline(file, line))
+    {
+        char* p;
+        ++lineNumber;
+
+        // Throw away comments
+        size_t hash = line.find('#');
+        if (hash != string::npos) line.erase(hash);
+
+        // Split the line into its comma-separated fields
+        vector<string> field;
+        for (size_t start = 0; start <= line.size();)
+        {
+            size_t comma = line.find(',', start);
+            if (comma == string::npos) comma = line.size();
+            string token = line.substr(start, comma - start);
+            token.erase(0, token.find_first_not_of(" \t\r"));
+            token.erase(token.find_last_not_of(" \t\r") + 1);
+            field.push_back(token);
+            start = comma + 1;
+        }
+
+        // Skip blank lines
+        if (field.size() == 1 && field[0].empty()) continue;
+
+        // Fetch the cell number and the type of defect
+        if (field.size() < 2 || field.size() > 3) throwRuntime("%s(%d): malformed defect", filename.c_str(), lineNumber);
+        uint32_t cell = strtoul(field[0].c_str(), &p, 0);
+        if (*p || field[0].empty() || cell == 0) throwRuntime("%s(%d): invalid cell '%s'", filename.c_str(), lineNumber, field[0].c_str());
+
+        // Fetch the value, if there is one
+        uint32_t value = 0;
+        bool     hasValue = (field.size() == 3);
+        if (hasValue)
+        {
+            value = strtoul(field[2].c_str(), &p, 0);
+            if (*p || field[2].empty() || value > 255) throwRuntime("%s(%d): invalid value '%s'", filename.c_str(), lineNumber, field[2].c_str());
+        }
+
+        string& type = field[1];
+        if (type == "dead" && !hasValue)
+            add(cell, 0, 0);
+        else if (type == "stuck" && hasValue)
+            add(cell, 0, value);
+        else if (type == "hot")
+            add(cell, 0xFF, hasValue ? value : DEFAULT_HOT_BITS);
+        else
+            throwRuntime("%s(%d): malformed defect", filename.c_str(), lineNumber);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// generate() - Picks a fraction 'rate' of the cells at random and makes each of them dead, stuck
+//              (at a random value), or hot, in equal proportion
+//=================================================================================================
+void DefectMap::generate(double rate, uint32_t seed, uint32_t cellsPerFrame)
+{
+    GlibcRandom   rng(seed);
+    set<uint32_t> chosen;
+
+    if (!(rate >= 0 && rate <= 1)) throwRuntime("The defect rate must be between 0 and 1");
+
+    uint64_t count = (uint64_t)(rate * cellsPerFrame + 0.5);
+    while (chosen.size() < count)
+    {
+        // Pick a cell we haven't already picked
+        uint64_t high = rng.next();
+        uint32_t cell = ((high << 31) | rng.next()) % cellsPerFrame + 1;
+        if (!chosen.insert(cell).second) continue;
+
+        switch (rng.next() % 3)
+        {
+            case 0:  add(cell, 0, 0);                   break;
+            case 1:  add(cell, 0, rng.next() & 0xFF);   break;
+            default: add(cell, 0xFF, DEFAULT_HOT_BITS); break;
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// compile() - Sorts the defects by cell, and builds the masks for every 16-byte block of the
+//             frame that contains one
+//=================================================================================================
+void DefectMap::compile(uint32_t cellsPerFrame)
+{
+    cellsPerFrame_ = cellsPerFrame;
+    offsets_.clear();
+    keep_.clear();
+    stuck_.clear();
+    if (defects_.empty()) return;
+
+    // Sort the defects by cell.  Where a cell appears more than once, keep the last of them
+    stable_sort(defects_.begin(), defects_.end(), [](const defect_t& a, const defect_t& b)
+    {
+        return a.cell < b.cell;
+    });
+    vector<defect_t> merged;
+    for (auto& d : defects_)
+    {
+        if (!merged.empty() && merged.back().cell == d.cell) merged.back() = d; else merged.push_back(d);
+    }
+    defects_ = merged;
+
+    // Every defect has to be in the frame, and a frame has to hold at least one whole block
+    if (defects_.back().cell > cellsPerFrame_)
+    {
+        throwRuntime("Defective cell %u is beyond the end of the frame", defects_.back().cell);
+    }
+    if (cellsPerFrame_ < 16) throwRuntime("Frames are too small for a defect map");
+
+    // Build a block for each run of defects that share one.  If the frame doesn't end on a block
+    // boundary, the last block is moved back to fit, and may overlap the one before it.  That's
+    // harmless, since each defect is in only one block, and every other byte of a block is kept
+    for (auto& d : defects_)
+    {
+        uint32_t offset = min((d.cell - 1) & ~15u, cellsPerFrame_ - 16);
+        if (offsets_.empty() || offsets_.back() != offset)
+        {
+            offsets_.push_back(offset);
+            keep_.insert(keep_.end(), 16, 0xFF);
+            stuck_.insert(stuck_.end(), 16, 0);
+        }
+        size_t i = (offsets_.size() - 1) * 16 + (d.cell - 1 - offset);
+        keep_[i]  = d.keep;
+        stuck_[i] = d.stuck;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// apply() - Applies the defects to a frame
+//=================================================================================================
+void DefectMap::apply(uint8_t* frame) const
+{
+    blendBlocks(frame, offsets_.data(), keep_.data(), stuck_.data(), offsets_.size());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// apply() - Returns the value that a single cell (numbered from 0) reads
+//=================================================================================================
+uint8_t DefectMap::apply(uint32_t cellNumber, uint8_t value) const
+{
+    auto it = lower_bound(defects_.begin(), defects_.end(), cellNumber + 1, [](const defect_t& d, uint32_t cell)
+    {
+        return d.cell < cell;
+    });
+
+    if (it == defects_.end() || it->cell != cellNumber + 1) return value;
+    return (value & it->keep) | it->stuck;
+}
+//=================================================================================================
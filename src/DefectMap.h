@@ -0,0 +1,67 @@
+//=================================================================================================
+// DefectMap.h - Defines a map of defective cells (dead, stuck, and hot) and the masks that apply
+//               them to a built frame
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class DefectMap
+{
+public:
+
+    // A defective cell (numbered from 1) always reads (value & keep) | stuck
+    struct defect_t
+    {
+        uint32_t cell;
+        uint8_t  keep, stuck;
+        uint16_t reserved;
+    };
+
+    // Constructor
+    DefectMap() {cellsPerFrame_ = 0;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    DefectMap (const DefectMap&) = delete;
+    DefectMap& operator= (const DefectMap&) = delete;
+
+    // Empties the map
+    void    clear();
+
+    // Adds a defective cell.  If a cell is added more than once, the last one wins
+    void    add(uint32_t cell, uint8_t keep, uint8_t stuck);
+
+    // Adds the defective cells listed in a defect file
+    void    load(const std::string& filename);
+
+    // Adds defects to a random selection of the cells, a fraction 'rate' of them in all
+    void    generate(double rate, uint32_t seed, uint32_t cellsPerFrame);
+
+    // Builds the masks for frames of 'cellsPerFrame' cells.  Call this after the map is complete
+    void    compile(uint32_t cellsPerFrame);
+
+    // Applies the defects to a frame
+    void    apply(uint8_t* frame) const;
+
+    // Returns the value that cell 'cellNumber' (numbered from 0) reads if it should be 'value'
+    uint8_t apply(uint32_t cellNumber, uint8_t value) const;
+
+    // Returns the defects, in ascending order of cell once the map is compiled
+    const std::vector<defect_t>& defects() const {return defects_;}
+
+    // Returns the number of 16-byte blocks of the frame that have a defect in them
+    size_t  blockCount() const {return offsets_.size();}
+
+protected:
+
+    // The defects, and the size of frame they were compiled for
+    std::vector<defect_t> defects_;
+    uint32_t cellsPerFrame_;
+
+    // Every 16-byte block of the frame that contains a defect: its offset, and the 16 bytes each
+    // of the keep mask and the stuck bits.  A cell that isn't defective has a mask of 0xFF
+    std::vector<uint32_t> offsets_;
+    std::vector<uint8_t>  keep_, stuck_;
+};
@@ -0,0 +1,355 @@
+//=================================================================================================
+// FrameChannel.cpp - Implements a class that publishes data frames into a shared-memory ring
+//
+// A consumer attaches by connecting to our Unix domain socket.  The server thread picks a free
+// consumer slot, starts the consumer's read cursor at the newest frame, and sends it the memfd.
+// The connection stays open for as long as the consumer is attached: when it closes (even
+// because the consumer crashed) the slot is freed, so a dead consumer can't stall the ring.
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdexcept>
+#include "FrameChannel.h"
+using namespace std;
+
+// Slots and the start of the frame data are aligned to this
+static const size_t PAGE_SIZE = 4096;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Creates the shared-memory ring and starts listening for consumers
+//
+// Passed: socketName     = The path of the Unix domain socket consumers connect to
+//         cellsPerFrame  = The number of bytes in a single data frame
+//         framesPerGroup = The number of frames in a frame group
+//         frameCount     = The total number of frames that will be published
+//         slotCount      = The number of frames the ring holds
+//=================================================================================================
+void FrameChannel::create(const char* socketName, uint32_t cellsPerFrame, uint32_t framesPerGroup,
+                          uint64_t frameCount, uint32_t slotCount)
+{
+    struct stat sb;
+
+    // Make sure we don't already have a channel open
+    close();
+
+    // Save our parameters for future use
+    socketName_ = socketName;
+    stalls_     = 0;
+    if (slotCount == 0) slotCount = 1;
+
+    // Work out how big the shared memory has to be
+    uint64_t dataOffset = (sizeof(channel_header_t) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint64_t slotSize   = (cellsPerFrame + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    mapSize_ = dataOffset + slotSize * slotCount;
+
+    // Create the shared memory.  Once it's the right size, seal it so that consumers can trust
+    // that it will stay that size
+    memfd_ = memfd_create("sfg-channel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd_ < 0) throwRuntime("Can't create shared memory: %s", strerror(errno));
+    if (ftruncate(memfd_, mapSize_) < 0) throwRuntime("Can't size shared memory: %s", strerror(errno));
+    fcntl(memfd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    // Map it into our address space
+    void* ptr = mmap(0, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, memfd_, 0);
+    if (ptr == MAP_FAILED) throwRuntime("Can't map shared memory: %s", strerror(errno));
+    map_    = (uint8_t*)ptr;
+    header_ = (channel_header_t*)ptr;
+
+    // Fill in the header.  The memfd starts out full of zeros, so every consumer slot is free
+    memcpy(header_->magic, CHANNEL_MAGIC, sizeof(header_->magic));
+    header_->headerSize     = sizeof(channel_header_t);
+    header_->cellsPerFrame  = cellsPerFrame;
+    header_->framesPerGroup = framesPerGroup;
+    header_->slotCount      = slotCount;
+    header_->slotSize       = slotSize;
+    header_->dataOffset     = dataOffset;
+    header_->frameCount     = frameCount;
+
+    // If a stale socket is lying around from an earlier run, get rid of it
+    if (stat(socketName, &sb) == 0 && S_ISSOCK(sb.st_mode)) unlink(socketName);
+
+    // Build the address of the socket
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketName) >= sizeof(addr.sun_path)) throwRuntime("%s: name too long", socketName);
+    strcpy(addr.sun_path, socketName);
+
+    // Create the socket and start listening for consumers
+    listen_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_ < 0) throwRuntime("Can't create socket");
+    if (bind(listen_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(listen_, 16) < 0)
+    {
+        throwRuntime("Can't listen on %s: %s", socketName, strerror(errno));
+    }
+
+    // No consumers are connected yet
+    for (auto& fd : connection_) fd = -1;
+
+    // Start the thread that attaches consumers
+    stopping_ = false;
+    server_ = thread(&FrameChannel::serverThread, this);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// consumerCount() - Returns the number of consumers that are attached
+//=================================================================================================
+uint32_t FrameChannel::consumerCount()
+{
+    uint32_t count = 0;
+    for (auto& c : header_->consumer) if (__atomic_load_n(&c.active, __ATOMIC_ACQUIRE)) ++count;
+    return count;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// hasRoom() - Returns true if every attached consumer has finished with the frame that
+//             'frameNumber' is about to overwrite
+//=================================================================================================
+bool FrameChannel::hasRoom(uint64_t frameNumber)
+{
+    for (auto& c : header_->consumer)
+    {
+        if (!__atomic_load_n(&c.active, __ATOMIC_ACQUIRE)) continue;
+        uint64_t readCursor = __atomic_load_n(&c.readCursor, __ATOMIC_ACQUIRE);
+        if (frameNumber - readCursor >= header_->slotCount) return false;
+    }
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// waitForConsumer() - Waits until at least one consumer is attached
+//=================================================================================================
+void FrameChannel::waitForConsumer()
+{
+    while (consumerCount() == 0)
+    {
+        uint32_t seq = __atomic_load_n(&header_->readSeq, __ATOMIC_ACQUIRE);
+        if (consumerCount()) break;
+        futexWait(&header_->readSeq, seq, 100);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFrame() - Publishes a frame into the ring
+//=================================================================================================
+void FrameChannel::writeFrame(const uint8_t* frame)
+{
+    uint64_t frameNumber = header_->writeCursor;
+
+    // Before the first frame, wait for someone to send it to
+    if (frameNumber == 0) waitForConsumer();
+
+    // Wait for the slowest consumer to make room in the ring
+    if (!hasRoom(frameNumber))
+    {
+        ++stalls_;
+        while (!hasRoom(frameNumber))
+        {
+            uint32_t seq = __atomic_load_n(&header_->readSeq, __ATOMIC_ACQUIRE);
+            if (hasRoom(frameNumber)) break;
+            futexWait(&header_->readSeq, seq, 100);
+        }
+    }
+
+    // Copy the frame into its slot
+    uint8_t* slot = map_ + header_->dataOffset + (frameNumber % header_->slotCount) * header_->slotSize;
+    memcpy(slot, frame, header_->cellsPerFrame);
+
+    // Publish it, and wake any consumers that are waiting for it
+    __atomic_store_n(&header_->writeCursor, frameNumber + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header_->writeSeq, 1, __ATOMIC_RELEASE);
+    futexWake(&header_->writeSeq);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// welcome() - Attaches a newly connected consumer and sends it the memfd
+//=================================================================================================
+void FrameChannel::welcome(int fd)
+{
+    channel_welcome_t welcome;
+    uint32_t          index;
+
+    // Find a free consumer slot.  If there isn't one, turn the consumer away
+    for (index = 0; index < CHANNEL_MAX_CONSUMERS; ++index) if (connection_[index] < 0) break;
+    if (index == CHANNEL_MAX_CONSUMERS)
+    {
+        ::close(fd);
+        return;
+    }
+
+    // Find out who the consumer is
+    struct ucred cred;
+    socklen_t    credSize = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credSize) < 0) cred.pid = 0;
+
+    // The consumer starts with the next frame to be published.  The cursor has to be in place
+    // before the slot is marked active, or the producer might race past it
+    auto& c = header_->consumer[index];
+    c.pid = cred.pid;
+    __atomic_store_n(&c.readCursor, __atomic_load_n(&header_->writeCursor, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_store_n(&c.active, 1, __ATOMIC_RELEASE);
+    connection_[index] = fd;
+
+    // Build the message that carries the memfd
+    welcome.consumerIndex = index;
+    welcome.reserved      = 0;
+    welcome.channelSize   = mapSize_;
+
+    struct iovec iov = {&welcome, sizeof(welcome)};
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &memfd_, sizeof(int));
+
+    // Send it.  If that fails, the consumer is gone already
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(welcome)) detach(index);
+
+    // The producer may be waiting for its first consumer
+    __atomic_add_fetch(&header_->readSeq, 1, __ATOMIC_RELEASE);
+    futexWake(&header_->readSeq);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// detach() - Frees a consumer slot
+//=================================================================================================
+void FrameChannel::detach(uint32_t index)
+{
+    __atomic_store_n(&header_->consumer[index].active, 0, __ATOMIC_RELEASE);
+    ::close(connection_[index]);
+    connection_[index] = -1;
+
+    // The producer may have been waiting on this consumer
+    __atomic_add_fetch(&header_->readSeq, 1, __ATOMIC_RELEASE);
+    futexWake(&header_->readSeq);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// serverThread() - Accepts new consumers, and notices when consumers go away
+//=================================================================================================
+void FrameChannel::serverThread()
+{
+    while (!stopping_)
+    {
+        struct pollfd pfd[CHANNEL_MAX_CONSUMERS + 1];
+        uint32_t      index[CHANNEL_MAX_CONSUMERS + 1];
+        uint32_t      count = 0;
+
+        // We're listening for new connections...
+        pfd[count++] = {listen_, POLLIN, 0};
+
+        // ...and for existing connections to close
+        for (uint32_t i = 0; i < CHANNEL_MAX_CONSUMERS; ++i) if (connection_[i] >= 0)
+        {
+            index[count] = i;
+            pfd[count++] = {connection_[i], POLLIN, 0};
+        }
+
+        // Wait for something to happen.  The timeout lets us notice when it's time to stop
+        if (poll(pfd, count, 100) <= 0) continue;
+
+        // Attach any new consumer
+        if (pfd[0].revents & POLLIN)
+        {
+            int fd = accept4(listen_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) welcome(fd);
+        }
+
+        // A consumer detaches by closing its connection.  Anything else it sends is ignored
+        for (uint32_t i = 1; i < count; ++i) if (pfd[i].revents)
+        {
+            char buffer[64];
+            if (recv(pfd[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT) <= 0) detach(index[i]);
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Tells consumers there are no more frames, and shuts the channel down.  Consumers
+//           that are still attached keep the shared memory alive until they're done with it
+//=================================================================================================
+void FrameChannel::close()
+{
+    // Stop accepting consumers
+    if (server_.joinable())
+    {
+        stopping_ = true;
+        server_.join();
+    }
+
+    // Tell the consumers we're done
+    if (header_)
+    {
+        __atomic_store_n(&header_->finished, 1, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&header_->writeSeq, 1, __ATOMIC_RELEASE);
+        futexWake(&header_->writeSeq);
+        munmap(map_, mapSize_);
+        header_ = nullptr;
+    }
+
+    // Close the connections to the consumers and get rid of the socket
+    for (auto& fd : connection_) if (fd >= 0) {::close(fd); fd = -1;}
+    if (listen_ >= 0)
+    {
+        ::close(listen_);
+        unlink(socketName_);
+        listen_ = -1;
+    }
+
+    // Close the shared memory
+    if (memfd_ >= 0) ::close(memfd_);
+    memfd_ = -1;
+}
+//=================================================================================================
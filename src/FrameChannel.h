@@ -0,0 +1,84 @@
+//=================================================================================================
+// FrameChannel.h - Defines a class that publishes data frames into a shared-memory ring that
+//                  local consumers can read without copying.  See channel.h for the layout.
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <thread>
+#include <atomic>
+#include "channel.h"
+#include "FrameSink.h"
+
+class FrameChannel : public FrameSink
+{
+public:
+
+    // Constructor
+    FrameChannel()
+    {
+        memfd_ = listen_ = -1;
+        header_ = nullptr;
+        for (auto& fd : connection_) fd = -1;
+    }
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    FrameChannel (const FrameChannel&) = delete;
+    FrameChannel& operator= (const FrameChannel&) = delete;
+
+    // Destructor, shuts the channel down
+    ~FrameChannel() {close();}
+
+    // Creates the shared-memory ring, and starts listening for consumers on the Unix domain
+    // socket 'socketName'
+    void    create(const char* socketName, uint32_t cellsPerFrame, uint32_t framesPerGroup,
+                   uint64_t frameCount, uint32_t slotCount);
+
+    // Waits for at least one consumer to attach
+    void    waitForConsumer();
+
+    // Publishes a single frame.  The first frame waits for a consumer to attach, and after that
+    // this blocks whenever the ring is full
+    void    writeFrame(const uint8_t* frame);
+
+    // Tells the consumers there are no more frames, and stops accepting new consumers
+    void    close();
+
+    // Returns the number of times we had to wait for a consumer to make room in the ring
+    uint64_t stalls() {return stalls_;}
+
+protected:
+
+    // Returns true if every attached consumer has room for another frame
+    bool    hasRoom(uint64_t frameNumber);
+
+    // Returns the number of consumers attached
+    uint32_t consumerCount();
+
+    // The body of the thread that attaches and detaches consumers
+    void    serverThread();
+
+    // Hands the memfd to a newly connected consumer
+    void    welcome(int fd);
+
+    // Marks a consumer as gone, and wakes the producer in case it was waiting on it
+    void    detach(uint32_t index);
+
+    // The name of the socket, its file descriptor, and the connection to each consumer
+    const char* socketName_;
+    int     listen_;
+    int     connection_[CHANNEL_MAX_CONSUMERS];
+
+    // The shared memory, where it's mapped, and how big it is
+    int     memfd_;
+    channel_header_t* header_;
+    uint8_t* map_;
+    size_t  mapSize_;
+
+    // The thread that attaches consumers, and the flag that tells it to stop
+    std::thread       server_;
+    std::atomic<bool> stopping_;
+
+    // Statistics for the report at the end of a run
+    uint64_t stalls_;
+};
@@ -0,0 +1,860 @@
+//=================================================================================================
+// FrameFile.cpp - Implements a class that provides read access to the frames in an output file
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "FrameFile.h"
+#include "RingLayout.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "simd.h"
+using namespace std;
+
+// Frames of a striped run are read into the window in batches of at most this many bytes, and
+// the whole window is kept to about this many
+static const size_t STRIPED_BATCH_SIZE  = 8 * 1024 * 1024;
+static const size_t STRIPED_WINDOW_SIZE = 64 * 1024 * 1024;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// threadCount() - Returns the number of threads we use for parallel operations
+//=================================================================================================
+static uint32_t threadCount()
+{
+    uint32_t count = thread::hardware_concurrency();
+    return count ? count : 1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// parallelFor() - Calls 'function(i)' for every 'i' from 0 to count-1, spread across threads
+//=================================================================================================
+template <class F> static void parallelFor(uint32_t count, F function)
+{
+    vector<thread> threads;
+
+    // Each thread handles every 'n'th index
+    uint32_t n = threadCount();
+    for (uint32_t t = 0; t < n && t < count; ++t) threads.emplace_back([=]()
+    {
+        for (uint32_t i = t; i < count; i += n) function(i);
+    });
+
+    // Wait for all of the threads to finish
+    for (auto& t : threads) t.join();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// open() - Opens the specified file, maps it into memory, and figures out its geometry
+//=================================================================================================
+void FrameFile::open(const char* filename, uint32_t cellsPerFrame)
+{
+    struct stat sb;
+
+    // Make sure we don't already have a file open
+    close();
+
+    // Open the file and complain if we can't
+    fd_ = ::open(filename, O_RDONLY);
+    if (fd_ < 0) throwRuntime("Can't open %s", filename);
+    filename_ = filename;
+
+    // Find out how big the file is
+    fstat(fd_, &sb);
+    fileSize_ = sb.st_size;
+
+    // Map the file into memory
+    if (fileSize_)
+    {
+        void* ptr = mmap(0, fileSize_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (ptr == MAP_FAILED) throwRuntime("Can't map %s", filename);
+        map_ = (uint8_t*)ptr;
+    }
+
+    // Find out whether this file is a container or is compressed
+    isContainer_  = fileSize_ >= sizeof(header_) && memcmp(map_, CONTAINER_MAGIC, 8) == 0;
+    isCompressed_ = fileSize_ >= sizeof(compressedHeader_) && memcmp(map_, COMPRESSED_MAGIC, 8) == 0;
+    isModel_      = fileSize_ >= sizeof(eventHeader_) && memcmp(map_, EVENTS_MAGIC, 8) == 0;
+    isStriped_    = fileSize_ >= sizeof(manifest_) && memcmp(map_, STRIPES_MAGIC, 8) == 0;
+    isSparse_     = false;
+    hasLayout_    = false;
+    windowCount_  = 0;
+
+    // A stripe manifest points to the files that hold the frames
+    if (isStriped_)
+    {
+        openStriped();
+        return;
+    }
+
+    // Event files hold a model of the frames rather than the frames themselves
+    if (isModel_)
+    {
+        openEvents();
+        return;
+    }
+
+    // Compressed files have their own header
+    if (isCompressed_)
+    {
+        openCompressed();
+        return;
+    }
+
+    // If it isn't a container, it's a raw file, and the caller has told us how big the frames are
+    if (!isContainer_)
+    {
+        // If the frames are spaced out for DMA, the layout table says how
+        RingLayout layout;
+        if (layout.load((string(filename) + ".layout").c_str()))
+        {
+            auto& h = layout.header();
+            if (h.imageSize > fileSize_) throwRuntime("%s is shorter than its layout says", filename);
+            hasLayout_      = true;
+            cellsPerFrame_  = h.cellsPerFrame;
+            frameStride_    = h.frameStride;
+            groupStride_    = h.groupStride;
+            framesPerGroup_ = h.framesPerGroup;
+            dataOffset_     = 0;
+            dataSize_       = fileSize_;
+            frameCount_     = h.frameCount;
+            return;
+        }
+
+        if (cellsPerFrame == 0) throwRuntime("%s is not a container file", filename);
+        cellsPerFrame_ = cellsPerFrame;
+        dataOffset_    = 0;
+        dataSize_      = fileSize_;
+        frameCount_    = fileSize_ / cellsPerFrame;
+        return;
+    }
+
+    // If we get here, it's a container.  Fetch and sanity check the header
+    memcpy(&header_, map_, sizeof(header_));
+    if (header_.headerCrc != crc32c(0, &header_, offsetof(container_header_t, headerCrc)))
+    {
+        throwRuntime("%s has a corrupt header", filename);
+    }
+
+    // Make sure the file hasn't been truncated
+    uint64_t trailerSize = header_.frameGroupCount * sizeof(uint32_t);
+    if (header_.trailerOffset + trailerSize > fileSize_) throwRuntime("%s is truncated", filename);
+
+    // The geometry comes from the header
+    cellsPerFrame_ = header_.cellsPerFrame;
+    dataOffset_    = header_.dataOffset;
+    dataSize_      = header_.dataSize;
+    frameCount_    = header_.frameCount;
+
+    // Find out how the frame data is encoded
+    if (header_.encoding == ENCODING_FILLER_XOR)
+    {
+        isSparse_ = true;
+        decoded_.resize(cellsPerFrame_);
+        findExtents();
+    }
+    else if (header_.encoding != ENCODING_NONE)
+    {
+        throwRuntime("%s has unknown encoding %u", filename, header_.encoding);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// openCompressed() - Fetches the header and chunk index of a compressed file
+//=================================================================================================
+void FrameFile::openCompressed()
+{
+    auto& h = compressedHeader_;
+
+    // Fetch and sanity check the header
+    memcpy(&h, map_, sizeof(h));
+    if (h.headerCrc != crc32c(0, &h, offsetof(compressed_header_t, headerCrc)))
+    {
+        throwRuntime("%s has a corrupt header", filename_);
+    }
+
+    // Make sure the file hasn't been truncated
+    uint64_t indexSize = h.chunkCount * sizeof(chunk_index_t);
+    if (h.indexOffset > fileSize_ || indexSize > fileSize_ - h.indexOffset)
+    {
+        throwRuntime("%s is truncated", filename_);
+    }
+
+    // Make sure the header describes the chunks it says it has
+    if (h.cellsPerFrame == 0 || h.framesPerGroup == 0 || h.framesPerChunk == 0 ||
+        h.indexOffset < COMPRESSED_DATA_OFFSET ||
+        h.chunkCount != (h.frameCount + h.framesPerChunk - 1) / h.framesPerChunk)
+    {
+        throwRuntime("%s is corrupt", filename_);
+    }
+
+    // Get a pointer to the chunk index
+    index_ = (const chunk_index_t*)(map_ + h.indexOffset);
+
+    // Every chunk has to be 'framesPerChunk' frames (the last may be fewer) and lie between the
+    // header and the index, or we'd write past the end of the caller's buffer when we copy it
+    for (uint32_t chunk = 0; chunk < h.chunkCount; ++chunk)
+    {
+        const chunk_index_t& entry = index_[chunk];
+        uint64_t frames = min((uint64_t)h.framesPerChunk, h.frameCount - (uint64_t)chunk * h.framesPerChunk);
+        if (entry.rawSize != frames * h.cellsPerFrame || entry.packedSize > entry.rawSize ||
+            entry.offset < COMPRESSED_DATA_OFFSET || entry.offset > h.indexOffset ||
+            entry.packedSize > h.indexOffset - entry.offset)
+        {
+            throwRuntime("%s has a corrupt index entry for chunk %u", filename_, chunk);
+        }
+    }
+
+    // Fill in a container-style header so callers can find out about this run
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, h.magic, sizeof(header_.magic));
+    header_.cellsPerFrame   = h.cellsPerFrame;
+    header_.framesPerGroup  = h.framesPerGroup;
+    header_.frameCount      = h.frameCount;
+    header_.frameGroupCount = (h.frameCount + h.framesPerGroup - 1) / h.framesPerGroup;
+    header_.randomSeed      = h.randomSeed;
+    header_.nucleotideCrc   = h.nucleotideCrc;
+    header_.fragmentCrc     = h.fragmentCrc;
+    header_.distributionCrc = h.distributionCrc;
+
+    // And the geometry comes from the header
+    cellsPerFrame_ = h.cellsPerFrame;
+    frameCount_    = h.frameCount;
+    dataOffset_    = 0;
+    dataSize_      = frameCount_ * cellsPerFrame_;
+
+    // We decompress a window of one chunk per thread at a time
+    window_.resize(threadCount());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// openEvents() - Fetches the header of an event file and rebuilds the model of the run
+//=================================================================================================
+void FrameFile::openEvents()
+{
+    auto& h = eventHeader_;
+
+    // Fetch and sanity check the header
+    memcpy(&h, map_, sizeof(h));
+    if (h.headerCrc != crc32c(0, &h, offsetof(event_header_t, headerCrc)))
+    {
+        throwRuntime("%s has a corrupt header", filename_);
+    }
+
+    // Make sure the file hasn't been truncated
+    if (h.eventsOffset + h.eventsSize > fileSize_) throwRuntime("%s is truncated", filename_);
+
+    // Make sure the events are intact before we trust them
+    const uint8_t* events = map_ + h.eventsOffset;
+    if (crc32c(0, events, h.eventsSize) != h.eventsCrc) throwRuntime("%s is corrupt", filename_);
+
+    // Rebuild the model
+    model_.clear();
+    model_.setGeometry(h.cellsPerFrame, h.frameCount, h.fillerValue);
+    model_.deserialize(events, h.eventsSize);
+
+    // Fill in a container-style header so callers can find out about this run
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, h.magic, sizeof(header_.magic));
+    header_.cellsPerFrame   = h.cellsPerFrame;
+    header_.framesPerGroup  = h.framesPerGroup;
+    header_.frameCount      = h.frameCount;
+    header_.frameGroupCount = (h.frameCount + h.framesPerGroup - 1) / h.framesPerGroup;
+    header_.randomSeed      = h.randomSeed;
+    header_.fillerValue     = h.fillerValue;
+    header_.nucleotideCrc   = h.nucleotideCrc;
+    header_.fragmentCrc     = h.fragmentCrc;
+    header_.distributionCrc = h.distributionCrc;
+
+    // And the geometry comes from the header
+    cellsPerFrame_ = h.cellsPerFrame;
+    frameCount_    = h.frameCount;
+    dataOffset_    = 0;
+    dataSize_      = frameCount_ * cellsPerFrame_;
+
+    // Frames are built into this buffer, which doesn't hold a frame yet
+    decoded_.resize(cellsPerFrame_);
+    builtFrame_ = UINT64_MAX;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// openStriped() - Reads a stripe manifest and opens every file it names
+//=================================================================================================
+void FrameFile::openStriped()
+{
+    auto& m = manifest_;
+
+    // Fetch and sanity check the manifest
+    memcpy(&m, map_, sizeof(m));
+    if (m.headerCrc != crc32c(0, &m, offsetof(stripe_manifest_t, headerCrc)))
+    {
+        throwRuntime("%s has a corrupt header", filename_);
+    }
+
+    // Make sure the file table and the file names are intact
+    uint64_t tableSize = (uint64_t)m.fileCount * sizeof(stripe_file_t);
+    if (m.headerSize + tableSize + m.namesSize > fileSize_) throwRuntime("%s is truncated", filename_);
+    if (crc32c(0, map_ + m.headerSize, tableSize + m.namesSize) != m.filesCrc)
+    {
+        throwRuntime("%s is corrupt", filename_);
+    }
+    if (m.fileCount == 0 || m.framesPerGroup == 0) throwRuntime("%s is corrupt", filename_);
+
+    // Fetch the file table, and the name of every file
+    const stripe_file_t* table = (const stripe_file_t*)(map_ + m.headerSize);
+    stripeTable_.assign(table, table + m.fileCount);
+    const char* names = (const char*)(table + m.fileCount);
+    stripeNames_.clear();
+    for (const char* p = names; p < names + m.namesSize; p += strlen(p) + 1) stripeNames_.push_back(p);
+    if (stripeNames_.size() != m.fileCount) throwRuntime("%s is corrupt", filename_);
+
+    // Fill in a container-style header so callers can find out about this run
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, m.magic, sizeof(header_.magic));
+    header_.cellsPerFrame   = m.cellsPerFrame;
+    header_.framesPerGroup  = m.framesPerGroup;
+    header_.frameCount      = m.frameCount;
+    header_.frameGroupCount = (m.frameCount + m.framesPerGroup - 1) / m.framesPerGroup;
+    header_.randomSeed      = m.randomSeed;
+    header_.fillerValue     = m.fillerValue;
+    header_.nucleotideCrc   = m.nucleotideCrc;
+    header_.fragmentCrc     = m.fragmentCrc;
+    header_.distributionCrc = m.distributionCrc;
+
+    // The geometry comes from the manifest
+    cellsPerFrame_ = m.cellsPerFrame;
+    frameCount_    = m.frameCount;
+    dataOffset_    = 0;
+    dataSize_      = frameCount_ * cellsPerFrame_;
+
+    // Open every file, and make sure it holds all of the frames it should
+    stripes_.clear();
+    for (uint32_t i = 0; i < m.fileCount; ++i)
+    {
+        stripes_.emplace_back(new FrameFile);
+        auto& stripe = *stripes_.back();
+        stripe.open(stripeNames_[i].c_str(), cellsPerFrame_);
+        if (stripe.cellsPerFrame() != cellsPerFrame_ || !(stripe.isRawData() || stripe.isSparse())
+                                                   || stripe.hasLayout())
+        {
+            throwRuntime("%s doesn't match %s", stripeNames_[i].c_str(), filename_);
+        }
+        if (stripe.frameCount() < stripeTable_[i].frameCount)
+        {
+            throwRuntime("%s is truncated", stripeNames_[i].c_str());
+        }
+    }
+
+    // Every file can be checked, either by its own CRCs or by the one in the manifest
+    isContainer_ = true;
+
+    // The window is read a batch of consecutive frames at a time.  A batch never spans frame
+    // groups, so all of its frames are in the same file
+    framesPerBatch_ = STRIPED_BATCH_SIZE / cellsPerFrame_;
+    if (framesPerBatch_ > m.framesPerGroup) framesPerBatch_ = m.framesPerGroup;
+    if (framesPerBatch_ == 0) framesPerBatch_ = 1;
+    batchesPerGroup_ = (m.framesPerGroup + framesPerBatch_ - 1) / framesPerBatch_;
+
+    // The window holds as many batches as fit in its budget, one per thread at most, but always
+    // at least one
+    size_t batches = STRIPED_WINDOW_SIZE / ((size_t)framesPerBatch_ * cellsPerFrame_);
+    window_.resize(max<size_t>(min<size_t>(batches, threadCount()), 1));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// copyFrames() - Copies frames from a raw, container, or sparse file to 'dst'
+//=================================================================================================
+void FrameFile::copyFrames(uint64_t first, uint64_t count, uint8_t* dst)
+{
+    if (isSparse_)
+        decodeSparse(first * cellsPerFrame_, count * cellsPerFrame_, dst);
+    else
+        memcpy(dst, map_ + dataOffset_ + first * cellsPerFrame_, count * cellsPerFrame_);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// locateGroup() - Finds which file of a striped run holds a frame group
+//
+// Returns: The index of the file, and the number of the frame group within it in 'localGroup'
+//=================================================================================================
+uint32_t FrameFile::locateGroup(uint64_t group, uint64_t* localGroup)
+{
+    uint32_t count = stripes_.size();
+
+    if (manifest_.groupsPerFile)
+    {
+        *localGroup = group % manifest_.groupsPerFile;
+        return group / manifest_.groupsPerFile;
+    }
+
+    *localGroup = group / count;
+    return group % count;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// copyStripedGroup() - Copies a frame group of a striped run to 'dst'
+//=================================================================================================
+void FrameFile::copyStripedGroup(uint64_t group, uint8_t* dst)
+{
+    uint32_t fpg = manifest_.framesPerGroup;
+    uint64_t local;
+
+    // Find the file that holds this frame group
+    uint32_t file = locateGroup(group, &local);
+
+    // The last frame group may be a partial one
+    uint64_t first  = group * fpg;
+    uint64_t frames = min((uint64_t)fpg, frameCount_ - first);
+
+    stripes_[file]->copyFrames(local * fpg, frames, dst);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// copyStripedBatch() - Copies a batch of frames of a striped run to 'dst'.  Batch 'k' of frame
+//                      group 'g' is batch g * batchesPerGroup + k of the run
+//=================================================================================================
+void FrameFile::copyStripedBatch(uint64_t batch, uint8_t* dst)
+{
+    uint32_t fpg = manifest_.framesPerGroup;
+    uint64_t local;
+
+    // Find the file that holds this batch's frame group
+    uint64_t group  = batch / batchesPerGroup_;
+    uint64_t skip   = (batch % batchesPerGroup_) * framesPerBatch_;
+    uint32_t file   = locateGroup(group, &local);
+
+    // The last batch of a frame group, and of the run, may be a partial one
+    uint64_t first  = group * fpg + skip;
+    uint64_t frames = min((uint64_t)framesPerBatch_, min(fpg - skip, frameCount_ - first));
+
+    stripes_[file]->copyFrames(local * fpg + skip, frames, dst);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stripedFrame() - Returns a pointer to a frame of a striped run.  If the frame isn't in the
+//                  window we already read, a new window of batches is read, in parallel
+//=================================================================================================
+const uint8_t* FrameFile::stripedFrame(uint64_t frameNumber)
+{
+    uint32_t fpg   = manifest_.framesPerGroup;
+    uint32_t size  = window_.size();
+    uint64_t group = frameNumber / fpg;
+    uint32_t index = frameNumber % fpg;
+    uint64_t batch = group * batchesPerGroup_ + index / framesPerBatch_;
+
+    // If this batch isn't in the window, read a new window that contains it
+    if (windowCount_ == 0 || batch < windowFirst_ || batch >= windowFirst_ + windowCount_)
+    {
+        // The last frame group may have fewer batches than the others
+        uint64_t lastFrames = frameCount_ - (header_.frameGroupCount - 1) * fpg;
+        uint64_t batchCount = (header_.frameGroupCount - 1) * batchesPerGroup_
+                            + (lastFrames + framesPerBatch_ - 1) / framesPerBatch_;
+
+        windowFirst_ = batch - batch % size;
+        windowCount_ = size;
+        if (windowFirst_ + windowCount_ > batchCount) windowCount_ = batchCount - windowFirst_;
+
+        parallelFor(windowCount_, [&](uint32_t i)
+        {
+            auto& buffer = window_[i];
+            buffer.resize((size_t)framesPerBatch_ * cellsPerFrame_);
+            copyStripedBatch(windowFirst_ + i, buffer.data());
+        });
+    }
+
+    // Hand the caller a pointer to the frame within the window
+    uint64_t offset = (uint64_t)(index % framesPerBatch_) * cellsPerFrame_;
+    return window_[batch - windowFirst_].data() + offset;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// modelFrame() - Builds a frame from the model of the run and returns a pointer to it.  The last
+//                frame built is remembered, so fetching one cell at a time is still cheap
+//=================================================================================================
+const uint8_t* FrameFile::modelFrame(uint64_t frameNumber)
+{
+    if (frameNumber != builtFrame_)
+    {
+        model_.buildFrame(frameNumber, decoded_.data());
+        builtFrame_ = frameNumber;
+    }
+    return decoded_.data();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// decompressChunk() - Decompresses a single chunk into 'dst' and checks its CRC
+//
+// Returns: false if the chunk is corrupt
+//=================================================================================================
+bool FrameFile::decompressChunk(uint32_t chunk, uint8_t* dst)
+{
+    const chunk_index_t& entry = index_[chunk];
+
+    // Point to the chunk data
+    const uint8_t* src = map_ + entry.offset;
+
+    // A chunk that didn't compress was stored as-is
+    if (entry.packedSize == entry.rawSize)
+        memcpy(dst, src, entry.rawSize);
+    else if (!decompressBlock(src, entry.packedSize, dst, entry.rawSize))
+        return false;
+
+    // The chunk is good if the CRC matches
+    return crc32c(0, dst, entry.rawSize) == entry.crc;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// compressedFrame() - Returns a pointer to a frame in a compressed file.  If the frame isn't in
+//                     the window of chunks we already decompressed, the next window of chunks is
+//                     decompressed in parallel
+//=================================================================================================
+const uint8_t* FrameFile::compressedFrame(uint64_t frameNumber)
+{
+    uint32_t framesPerChunk = compressedHeader_.framesPerChunk;
+    uint32_t chunk          = frameNumber / framesPerChunk;
+
+    // If this chunk isn't in the window, decompress a new window starting with it
+    if (windowCount_ == 0 || chunk < windowFirst_ || chunk >= windowFirst_ + windowCount_)
+    {
+        windowFirst_ = chunk;
+        windowCount_ = window_.size();
+        if (windowFirst_ + windowCount_ > compressedHeader_.chunkCount)
+        {
+            windowCount_ = compressedHeader_.chunkCount - windowFirst_;
+        }
+
+        atomic<bool> ok(true);
+        parallelFor(windowCount_, [&](uint32_t i)
+        {
+            auto& buffer = window_[i];
+            buffer.resize(index_[windowFirst_ + i].rawSize);
+            if (!decompressChunk(windowFirst_ + i, buffer.data())) ok = false;
+        });
+
+        if (!ok)
+        {
+            windowCount_ = 0;
+            throwRuntime("%s is corrupt near frame %lu", filename_, frameNumber);
+        }
+    }
+
+    // Hand the caller a pointer to the frame within the window
+    uint64_t offset = (frameNumber % framesPerChunk) * cellsPerFrame_;
+    return window_[chunk - windowFirst_].data() + offset;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// findExtents() - Uses SEEK_DATA and SEEK_HOLE to find the regions of frame data in a sparse
+//                 file that aren't holes.  Holes decode to filler without us having to touch 
+//                 them.   If the file system can't tell us, we treat the whole file as data.
+//=================================================================================================
+void FrameFile::findExtents()
+{
+    off64_t position = dataOffset_;
+    off64_t end      = dataOffset_ + dataSize_;
+
+    extents_.clear();
+
+    while (position < end)
+    {
+        // Find the start of the next region of data
+        off64_t start = lseek64(fd_, position, SEEK_DATA);
+        if (start < 0 || start >= end) break;
+
+        // And find where that region ends
+        off64_t stop = lseek64(fd_, start, SEEK_HOLE);
+        if (stop < 0 || stop > end) stop = end;
+
+        extents_.push_back(make_pair(start, stop));
+        position = stop;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// decodeSparse() - Decodes 'length' bytes of frame data from a sparse file, starting at byte
+//                  'offset' of the frame data, into 'dst'
+//=================================================================================================
+void FrameFile::decodeSparse(uint64_t offset, uint64_t length, uint8_t* dst)
+{
+    uint64_t start = dataOffset_ + offset, end = start + length;
+
+    // Holes are filler
+    memset(dst, header_.fillerValue, length);
+
+    // Find the first extent that ends after 'start'
+    auto it = upper_bound(extents_.begin(), extents_.end(), start, 
+              [](uint64_t value, const pair<uint64_t, uint64_t>& e) {return value < e.second;});
+
+    // Decode every extent that overlaps the range
+    for (; it != extents_.end() && it->first < end; ++it)
+    {
+        uint64_t from = max(start, it->first);
+        uint64_t to   = min(end,   it->second);
+        xorBytes(dst + (from - start), map_ + from, to - from, header_.fillerValue);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// sparseFrame() - Decodes a frame from a sparse file and returns a pointer to it
+//=================================================================================================
+const uint8_t* FrameFile::sparseFrame(uint64_t frameNumber)
+{
+    decodeSparse(frameNumber * cellsPerFrame_, cellsPerFrame_, decoded_.data());
+    return decoded_.data();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// copyTo() - Copies all of the frame data to 'dst'.   Compressed chunks are decompressed in 
+//            parallel, each into a local buffer that is then copied to 'dst' in one go, since
+//            'dst' may well be the contiguous buffer (see the note on fillBuffer() in main.cpp)
+//=================================================================================================
+void FrameFile::copyTo(uint8_t* dst)
+{
+    // Event files are rebuilt from the model, on every core
+    if (isModel_)
+    {
+        model_.buildFrames(0, frameCount_, dst);
+        return;
+    }
+
+    // Each file of a striped run is copied to its place in 'dst' by a thread of its own.  A split
+    // file holds consecutive frames, a striped one holds every n'th frame group
+    if (isStriped_)
+    {
+        uint32_t count = stripes_.size();
+        uint64_t groupSize = (uint64_t)manifest_.framesPerGroup * cellsPerFrame_;
+        parallelFor(count, [&](uint32_t file)
+        {
+            auto& entry = stripeTable_[file];
+            if (manifest_.groupsPerFile)
+            {
+                stripes_[file]->copyFrames(0, entry.frameCount, dst + entry.firstFrame * cellsPerFrame_);
+                return;
+            }
+            for (uint64_t group = file; group < header_.frameGroupCount; group += count)
+            {
+                copyStripedGroup(group, dst + group * groupSize);
+            }
+        });
+        return;
+    }
+
+    // Sparse data is decoded in parallel, one slice at a time
+    if (isSparse_)
+    {
+        const uint64_t SLICE_SIZE = 0x100000;
+        uint32_t sliceCount = (dataSize_ + SLICE_SIZE - 1) / SLICE_SIZE;
+        parallelFor(sliceCount, [&](uint32_t slice)
+        {
+            thread_local vector<uint8_t> buffer(SLICE_SIZE);
+            uint64_t offset = slice * SLICE_SIZE;
+            uint64_t length = min(SLICE_SIZE, dataSize_ - offset);
+            decodeSparse(offset, length, buffer.data());
+            memcpy(dst + offset, buffer.data(), length);
+        });
+        return;
+    }
+
+    // Uncompressed data can simply be copied
+    if (!isCompressed_)
+    {
+        memcpy(dst, map_ + dataOffset_, dataSize_);
+        return;
+    }
+
+    // Decompress each chunk and copy it to its place in 'dst'
+    uint64_t chunkSize = (uint64_t)compressedHeader_.framesPerChunk * cellsPerFrame_;
+    atomic<bool> ok(true);
+    parallelFor(compressedHeader_.chunkCount, [&](uint32_t chunk)
+    {
+        thread_local vector<uint8_t> buffer;
+        buffer.resize(index_[chunk].rawSize);
+        if (!decompressChunk(chunk, buffer.data())) ok = false;
+        memcpy(dst + chunk * chunkSize, buffer.data(), buffer.size());
+    });
+
+    // Complain if any of the chunks was corrupt
+    if (!ok) throwRuntime("%s is corrupt", filename_);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Unmaps and closes the file
+//=================================================================================================
+void FrameFile::close()
+{
+    if (map_) munmap(map_, fileSize_);
+    if (fd_ >= 0) ::close(fd_);
+    stripes_.clear();
+    map_      = nullptr;
+    fd_       = -1;
+    fileSize_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// verify() - Checks the CRC of every frame group in a container file, or of every chunk in a
+//            compressed file.  The work is divided among as many threads as the machine has 
+//            cores.
+//
+// Returns: The (sorted) indices of the frame groups or chunks whose CRC doesn't match
+//=================================================================================================
+vector<uint32_t> FrameFile::verify()
+{
+    vector<uint32_t> badGroups;
+    mutex            lock;
+
+    // For a compressed file, decompress and check every chunk
+    if (isCompressed_)
+    {
+        parallelFor(compressedHeader_.chunkCount, [&](uint32_t chunk)
+        {
+            thread_local vector<uint8_t> buffer;
+            buffer.resize(index_[chunk].rawSize);
+            if (!decompressChunk(chunk, buffer.data()))
+            {
+                lock_guard<mutex> guard(lock);
+                badGroups.push_back(chunk);
+            }
+        });
+        sort(badGroups.begin(), badGroups.end());
+        return badGroups;
+    }
+
+    // An event file has a single CRC that covers all of the events
+    if (isModel_)
+    {
+        const uint8_t* events = map_ + eventHeader_.eventsOffset;
+        if (crc32c(0, events, eventHeader_.eventsSize) != eventHeader_.eventsCrc) badGroups.push_back(0);
+        return badGroups;
+    }
+
+    // The files of a striped run are checked at the same time.  Containers are checked frame
+    // group by frame group, raw files against the CRC in the manifest.  If a raw file is bad,
+    // so is every frame group in it
+    if (isStriped_)
+    {
+        uint32_t count = stripes_.size();
+        uint32_t fpg   = manifest_.framesPerGroup;
+        vector<exception_ptr> errors(count);
+        parallelFor(count, [&](uint32_t file)
+        {
+            auto& stripe = *stripes_[file];
+            auto& entry  = stripeTable_[file];
+            vector<uint32_t> bad;
+
+            try
+            {
+                if (stripe.isContainer())
+                    bad = stripe.verify();
+                else if (crc32c(0, stripe.map_ + stripe.dataOffset_, entry.frameCount * cellsPerFrame_) != entry.crc)
+                    for (uint32_t g = 0; g < (entry.frameCount + fpg - 1) / fpg; ++g) bad.push_back(g);
+            }
+            catch (...)
+            {
+                errors[file] = current_exception();
+            }
+
+            // Convert the frame groups within the file to frame groups of the run
+            lock_guard<mutex> guard(lock);
+            for (auto g : bad)
+            {
+                badGroups.push_back(manifest_.groupsPerFile ? file * manifest_.groupsPerFile + g 
+                                                            : g * count + file);
+            }
+        });
+        for (auto& e : errors) if (e) rethrow_exception(e);
+        sort(badGroups.begin(), badGroups.end());
+        return badGroups;
+    }
+
+    // A raw file has nothing to verify
+    if (!isContainer_) return badGroups;
+
+    // Get a pointer to the table of CRCs in the trailer
+    const uint32_t* expected = (const uint32_t*)(map_ + header_.trailerOffset);
+
+    // Compute how many bytes are in a frame group
+    uint64_t groupSize = (uint64_t)header_.framesPerGroup * cellsPerFrame_;
+
+    // Check the CRC of each frame group
+    parallelFor(header_.frameGroupCount, [&](uint32_t group)
+    {
+        uint64_t offset = group * groupSize;
+        uint64_t length = groupSize;
+        if (offset + length > dataSize_) length = dataSize_ - offset;
+        uint32_t crc = crc32c(0, map_ + dataOffset_ + offset, length);
+        if (crc != expected[group])
+        {
+            lock_guard<mutex> guard(lock);
+            badGroups.push_back(group);
+        }
+    });
+
+    // Hand the caller the list of bad frame groups in order
+    sort(badGroups.begin(), badGroups.end());
+    return badGroups;
+}
+//=================================================================================================
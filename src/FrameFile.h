@@ -0,0 +1,205 @@
+//=================================================================================================
+// FrameFile.h - Defines a class that provides read access to the frames in an output file
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include "container.h"
+#include "FrameModel.h"
+
+class FrameFile
+{
+public:
+
+    // Constructor
+    FrameFile() {fd_ = -1; map_ = nullptr; fileSize_ = 0;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    FrameFile (const FrameFile&) = delete;
+    FrameFile& operator= (const FrameFile&) = delete;
+
+    // Destructor, unmaps and closes the file
+    ~FrameFile() {close();}
+
+    // Opens a file and maps it into memory.   'cellsPerFrame' is only used for raw files,
+    // containers describe their own geometry
+    void    open(const char* filename, uint32_t cellsPerFrame);
+
+    // Unmaps and closes the file
+    void    close();
+
+    // Returns true if the file is in container format
+    bool    isContainer() {return isContainer_;}
+
+    // Returns true if the file is compressed
+    bool    isCompressed() {return isCompressed_;}
+
+    // Returns true if the file is a sparse container, with frames stored XORed with the filler
+    bool    isSparse() {return isSparse_;}
+
+    // Returns true if the file is an event file, holding a model of the frames rather than frames
+    bool    isModel() {return isModel_;}
+
+    // Returns true if the file is a manifest of frame groups spread across several files
+    bool    isStriped() {return isStriped_;}
+
+    // Returns true if the frames of a raw file are spaced out according to a layout table
+    // (see layout.h) rather than packed back to back
+    bool    hasLayout() {return hasLayout_;}
+
+    // Returns true if the frame data is stored in the file exactly as it would be in RAM
+    bool    isRawData() {return !(isCompressed_ || isSparse_ || isModel_ || isStriped_);}
+
+    // Returns a container header that describes the file.  Only meaningful if the file is 
+    // a container, is compressed, or is an event file
+    const container_header_t& header() {return header_;}
+
+    // Returns the geometry of the file
+    uint32_t cellsPerFrame() {return cellsPerFrame_;}
+    uint64_t frameCount()    {return frameCount_;}
+
+    // Returns the offset and size of the frame data within the file.  For a compressed file,
+    // 'dataSize' is the size of the frame data after decompression
+    uint64_t dataOffset()    {return dataOffset_;}
+    uint64_t dataSize()      {return dataSize_;}
+
+    // Returns a pointer to the specified frame.  The pointer to a frame in a compressed, sparse,
+    // or event file is only valid until the next call
+    const uint8_t* frame(uint64_t frameNumber)
+    {
+        if (isCompressed_) return compressedFrame(frameNumber);
+        if (isModel_) return modelFrame(frameNumber);
+        if (isSparse_) return sparseFrame(frameNumber);
+        if (isStriped_) return stripedFrame(frameNumber);
+        return map_ + dataOffset_ + frameOffset(frameNumber);
+    }
+
+    // Returns the value of a single cell.  This is much cheaper than fetching the whole frame
+    uint8_t cell(uint64_t frameNumber, uint32_t cellNumber)
+    {
+        if (isCompressed_) return compressedFrame(frameNumber)[cellNumber];
+        if (isModel_) return modelFrame(frameNumber)[cellNumber];
+        if (isStriped_) return stripedFrame(frameNumber)[cellNumber];
+        uint8_t value = map_[dataOffset_ + frameOffset(frameNumber) + cellNumber];
+        return isSparse_ ? value ^ header_.fillerValue : value;
+    }
+
+    // Copies all of the frame data to 'dst', decompressing (or rebuilding) in parallel if need be
+    void    copyTo(uint8_t* dst);
+
+    // Checks the CRC of every frame group (or compressed chunk) in parallel.  Returns the indices
+    // of the bad groups or chunks.  An event file has a single CRC, reported as index 0.  The 
+    // files named by a manifest are checked at the same time
+    std::vector<uint32_t> verify();
+
+protected:
+
+    // Returns the offset of a frame within the frame data
+    uint64_t frameOffset(uint64_t frameNumber)
+    {
+        if (!hasLayout_) return frameNumber * cellsPerFrame_;
+        return (frameNumber / framesPerGroup_) * groupStride_ + (frameNumber % framesPerGroup_) * frameStride_;
+    }
+
+    // Fetches the header and chunk index of a compressed file
+    void    openCompressed();
+
+    // Fetches the header of an event file and rebuilds the model it contains
+    void    openEvents();
+
+    // Builds the specified frame from the model and returns a pointer to it
+    const uint8_t* modelFrame(uint64_t frameNumber);
+
+    // Decompresses the chunks around the specified frame and returns a pointer to the frame
+    const uint8_t* compressedFrame(uint64_t frameNumber);
+
+    // Decompresses a single chunk into 'dst'.  Returns false if the chunk is corrupt
+    bool    decompressChunk(uint32_t chunk, uint8_t* dst);
+
+    // Reads a stripe manifest and opens each of the files it names
+    void    openStriped();
+
+    // Copies 'count' frames starting at 'first' to 'dst'.  Only for raw, container, and sparse
+    // files, and safe to call from several threads at once
+    void    copyFrames(uint64_t first, uint64_t count, uint8_t* dst);
+
+    // Finds the file that holds a frame group of a striped run, and the number of the frame
+    // group within that file
+    uint32_t locateGroup(uint64_t group, uint64_t* localGroup);
+
+    // Copies frame group 'group' of a striped run to 'dst'
+    void    copyStripedGroup(uint64_t group, uint8_t* dst);
+
+    // Copies batch 'batch' of a striped run to 'dst'
+    void    copyStripedBatch(uint64_t batch, uint8_t* dst);
+
+    // Reads a window of batches of frames around the specified frame (in parallel) and returns a
+    // pointer to the frame
+    const uint8_t* stripedFrame(uint64_t frameNumber);
+
+    // Finds the regions of a sparse file that contain data rather than holes
+    void    findExtents();
+
+    // Decodes a range of frame data in a sparse file into 'dst'
+    void    decodeSparse(uint64_t offset, uint64_t length, uint8_t* dst);
+
+    // Decodes the specified frame of a sparse file and returns a pointer to it
+    const uint8_t* sparseFrame(uint64_t frameNumber);
+
+    // The file descriptor and the name of the open file
+    int         fd_;
+    const char* filename_;
+
+    // The address where the file is mapped, and the size of the file
+    uint8_t*    map_;
+    size_t      fileSize_;
+
+    // The header of a container file
+    bool        isContainer_;
+    container_header_t header_;
+
+    // If the file is compressed, its header and a pointer to its chunk index
+    bool    isCompressed_;
+    compressed_header_t   compressedHeader_;
+    const chunk_index_t*  index_;
+
+    // Buffers holding a window of consecutive decompressed chunks
+    std::vector<std::vector<uint8_t>> window_;
+    uint32_t    windowFirst_, windowCount_;
+
+    // If the file is sparse, the (start, end) file offsets of the regions that contain data,
+    // and a buffer to decode a frame into
+    bool    isSparse_;
+    std::vector<std::pair<uint64_t, uint64_t>> extents_;
+    std::vector<uint8_t> decoded_;
+
+    // If the file is an event file, its header, the model of the run, and the number of the frame
+    // that's in 'decoded_'
+    bool    isModel_;
+    event_header_t eventHeader_;
+    FrameModel     model_;
+    uint64_t       builtFrame_;
+
+    // If the file is a stripe manifest, the manifest, and the table entry, name, and contents
+    // of each file it names.  The window of decompressed chunks doubles as a window of batches
+    // of frames read from those files, each batch from a single frame group
+    bool    isStriped_;
+    stripe_manifest_t manifest_;
+    uint32_t framesPerBatch_, batchesPerGroup_;
+    std::vector<stripe_file_t> stripeTable_;
+    std::vector<std::string> stripeNames_;
+    std::vector<std::unique_ptr<FrameFile>> stripes_;
+
+    // If a raw file has a layout table, how its frames are spaced out
+    bool        hasLayout_;
+    uint64_t    frameStride_, groupStride_;
+    uint32_t    framesPerGroup_;
+
+    // The geometry of the frame data
+    uint32_t    cellsPerFrame_;
+    uint64_t    frameCount_;
+    uint64_t    dataOffset_, dataSize_;
+};
@@ -0,0 +1,543 @@
+//=================================================================================================
+// FrameModel.cpp - Implements a compact, compiled model of a run
+//
+// The serialized form of the model is a stream of events.  Each event is a 32-bit type and a
+// 32-bit payload length, followed by the payload:
+//
+//     EVENT_SEED       : uint32 seed
+//     EVENT_NUCLEOTIDE : uint8  adc_value[length]
+//     EVENT_SEQUENCE   : uint16 symbol[length / 2]
+//     EVENT_CELLSET    : uint32 first, last, step, sequence
+//     EVENT_MARKER     : uint32 marker_cell
+//     EVENT_DEFECTS    : DefectMap::defect_t defect[length / 8]
+//     EVENT_CROSSTALK  : Crosstalk::stencil_t stencil
+//
+// Nucleotides and sequences are numbered in the order their events appear.
+//=================================================================================================
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdexcept>
+#include <thread>
+#include "FrameModel.h"
+#include "MarkerChecker.h"
+using namespace std;
+
+// The types of events in a serialized model
+enum
+{
+    EVENT_SEED       = 1,
+    EVENT_NUCLEOTIDE = 2,
+    EVENT_SEQUENCE   = 3,
+    EVENT_CELLSET    = 4,
+    EVENT_MARKER     = 5,
+    EVENT_DEFECTS    = 6,
+    EVENT_CROSSTALK  = 7
+};
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// clear() - Empties the model
+//=================================================================================================
+void FrameModel::clear()
+{
+    cellsPerFrame_ = 0;
+    frameCount_    = 0;
+    fillerValue_   = 0;
+    seed_          = 1;
+    markerCell_    = 0;
+    rngFrame_      = 0;
+    nucleotides_.clear();
+    sequences_.clear();
+    cellsets_.clear();
+    drawOffset_.clear();
+    crosstalk_.clear();
+    defects_.clear();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// setGeometry() - Describes the frames the model builds
+//=================================================================================================
+void FrameModel::setGeometry(uint32_t cellsPerFrame, uint64_t frameCount, uint8_t fillerValue)
+{
+    cellsPerFrame_ = cellsPerFrame;
+    frameCount_    = frameCount;
+    fillerValue_   = fillerValue;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// addNucleotide() - Adds a nucleotide to the model and returns its index
+//=================================================================================================
+uint32_t FrameModel::addNucleotide(const vector<uint8_t>& adcValues)
+{
+    if (adcValues.empty()) throwRuntime("A nucleotide must have at least one ADC value");
+    nucleotides_.push_back(adcValues);
+    return nucleotides_.size() - 1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// addSequence() - Adds a sequence to the model and returns its index
+//=================================================================================================
+uint32_t FrameModel::addSequence(const vector<uint16_t>& symbols)
+{
+    sequences_.push_back(symbols);
+    return sequences_.size() - 1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// addCellSet() - Adds a set of cells that plays the specified sequence
+//=================================================================================================
+void FrameModel::addCellSet(uint32_t first, uint32_t last, uint32_t step, uint32_t sequence)
+{
+    cellsets_.push_back({first, last, step, sequence});
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// cellCount() - Returns the number of cells in a cell set, which are cells first-1,
+//               first-1+step, ... while < last
+//=================================================================================================
+uint64_t FrameModel::cellCount(const cellset_t& cs)
+{
+    if (cs.first == 0 || cs.last <= cs.first - 1) return 0;
+    return (cs.last - (cs.first - 1) + cs.step - 1) / cs.step;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// finalize() - Checks the model for consistency and works out how many random values are
+//              consumed before each frame is built
+//=================================================================================================
+void FrameModel::finalize()
+{
+    // Make sure every reference in the model is valid
+    for (auto& cs : cellsets_)
+    {
+        if (cs.sequence >= sequences_.size()) throwRuntime("Model refers to unknown sequence");
+        if (cs.step == 0) throwRuntime("Model contains a cell set with a step of 0");
+    }
+    if (markerCell_ && markerCell_ - 1 + sizeof(frame_marker_t) > cellsPerFrame_)
+    {
+        throwRuntime("The frame marker at cell %u doesn't fit in the frame", markerCell_);
+    }
+    for (auto& seq : sequences_) for (auto symbol : seq)
+    {
+        if ((symbol & NUCLEOTIDE) && (symbol & ~NUCLEOTIDE) >= nucleotides_.size())
+        {
+            throwRuntime("Model refers to unknown nucleotide");
+        }
+    }
+
+    // Count the random values consumed by each frame.  One value is consumed for every cell
+    // that is assigned a nucleotide
+    drawOffset_.assign(frameCount_ + 1, 0);
+    for (auto& cs : cellsets_)
+    {
+        auto&    seq   = sequences_[cs.sequence];
+        uint64_t cells = cellCount(cs);
+        for (uint64_t frame = 0; frame < seq.size() && frame < frameCount_; ++frame)
+        {
+            if (seq[frame] & NUCLEOTIDE) drawOffset_[frame + 1] += cells;
+        }
+    }
+
+    // Turn the per-frame counts into a running total
+    for (uint64_t frame = 1; frame <= frameCount_; ++frame) drawOffset_[frame] += drawOffset_[frame - 1];
+
+    // Fit the crosstalk stencil to the frame, and build the masks for the defective cells
+    crosstalk_.compile(cellsPerFrame_);
+    defects_.compile(cellsPerFrame_);
+
+    // The generator is no longer positioned anywhere useful
+    rng_.seed(seed_);
+    rngFrame_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// buildFrame() - Builds a frame using a generator that is positioned at the frame's first draw
+//=================================================================================================
+void FrameModel::buildFrame(uint64_t frameNumber, uint8_t* frame, GlibcRandom& rng, uint32_t threads)
+{
+    // Every cell in the frame starts out quiescent
+    memset(frame, fillerValue_, cellsPerFrame_);
+
+    // Apply each cell set in order
+    for (auto& cs : cellsets_)
+    {
+        auto& seq = sequences_[cs.sequence];
+
+        // If this sequence has ended, this cell set doesn't affect the frame
+        if (frameNumber >= seq.size()) continue;
+
+        uint16_t symbol = seq[frameNumber];
+
+        // A literal value is the same in every cell
+        if ((symbol & NUCLEOTIDE) == 0)
+        {
+            for (uint64_t cell = cs.first - 1; cell < cs.last && cell < cellsPerFrame_; cell += cs.step)
+            {
+                frame[cell] = (uint8_t)symbol;
+            }
+            continue;
+        }
+
+        // A nucleotide gets a random ADC value in each cell.  Cells past the end of the frame
+        // still consume a random value, as they always have
+        auto& adc = nucleotides_[symbol & ~NUCLEOTIDE];
+        for (uint64_t cell = cs.first - 1; cell < cs.last; cell += cs.step)
+        {
+            uint8_t value = adc[rng.next() % adc.size()];
+            if (cell < cellsPerFrame_) frame[cell] = value;
+        }
+    }
+
+    // Neighbouring cells leak into each other
+    crosstalk_.apply(frame, threads);
+
+    // Defective cells read what they read, whatever the cell sets put there
+    defects_.apply(frame);
+
+    // The frame marker goes on top of everything else
+    if (markerCell_) MarkerChecker::stamp(frame, cellsPerFrame_, markerCell_ - 1, frameNumber);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// buildFrame() - Builds the specified frame.  Building consecutive frames is cheapest, but any
+//                frame can be built at any time
+//=================================================================================================
+void FrameModel::buildFrame(uint64_t frameNumber, uint8_t* frame)
+{
+    // If the generator isn't already positioned at this frame, move it there
+    if (frameNumber != rngFrame_)
+    {
+        uint64_t target = drawOffset_[frameNumber];
+        if (target < rng_.position()) rng_.seed(seed_);
+        rng_.skip(target - rng_.position());
+    }
+
+    // Building a single frame has all the cores to itself
+    uint32_t threads = thread::hardware_concurrency();
+    buildFrame(frameNumber, frame, rng_, threads ? threads : 1);
+    rngFrame_ = frameNumber + 1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// buildFrames() - Builds 'count' consecutive frames into 'dst'.  Each thread builds a contiguous
+//                 range of frames with its own generator, jumped ahead to the start of its range.
+//                 Frames are built in a local buffer and then copied into place, because 'dst'
+//                 may be the contiguous buffer (see the note on fillBuffer() in main.cpp)
+//=================================================================================================
+void FrameModel::buildFrames(uint64_t firstFrame, uint64_t count, uint8_t* dst)
+{
+    vector<thread> threads;
+
+    // Find out how many threads to run
+    uint32_t threadCount = thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+    if (threadCount > count) threadCount = count;
+
+    for (uint32_t t = 0; t < threadCount; ++t) threads.emplace_back([=]()
+    {
+        // This is the range of frames this thread builds
+        uint64_t start = firstFrame + count * t / threadCount;
+        uint64_t end   = firstFrame + count * (t + 1) / threadCount;
+
+        // Position a generator at the first frame in our range
+        GlibcRandom rng(seed_);
+        rng.skip(drawOffset_[start]);
+
+        // Build each frame and copy it into place
+        vector<uint8_t> frame(cellsPerFrame_);
+        for (uint64_t n = start; n < end; ++n)
+        {
+            buildFrame(n, frame.data(), rng, 1);
+            memcpy(dst + (n - firstFrame) * cellsPerFrame_, frame.data(), cellsPerFrame_);
+        }
+    });
+
+    for (auto& t : threads) t.join();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// traceCell() - Fetches the value of one cell in 'count' consecutive frames
+//
+// A cell's value in a frame is decided by the last cell set that covers the cell and whose
+// sequence hasn't ended.  If that cell set plays a nucleotide, the value is a single random 
+// draw, whose position in the random sequence is the number of draws before the frame, plus
+// the draws made in that frame by the cell sets before it, plus the cell's position within
+// its own cell set.  The generator jumps straight there.  With crosstalk, the cell reads a blend
+// of its neighbours, so each of them is traced that way too.  A defective cell's value then goes
+// through its mask.  Cells in the frame marker depend on the whole frame, so for those the frame
+// is built after all
+//=================================================================================================
+void FrameModel::traceCell(uint32_t cellNumber, uint64_t firstFrame, uint64_t count, uint8_t* values)
+{
+    // Make sure we've been asked about cells and frames that exist
+    if (cellNumber >= cellsPerFrame_) throwRuntime("Invalid cell number %u", cellNumber);
+    if (firstFrame + count > frameCount_) throwRuntime("The model only has %lu frames", frameCount_);
+
+    // The frame marker is stamped on top of everything else
+    if (markerCell_ && cellNumber >= markerCell_ - 1 && cellNumber < markerCell_ - 1 + sizeof(frame_marker_t))
+    {
+        vector<uint8_t> frame(cellsPerFrame_);
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            buildFrame(firstFrame + i, frame.data());
+            values[i] = frame[cellNumber];
+        }
+        return;
+    }
+
+    // Without crosstalk, the cell sets decide what the cell reads
+    if (!crosstalk_.enabled()) traceCellSets(cellNumber, firstFrame, count, values);
+
+    // Otherwise trace every cell under the stencil, and blend them
+    else
+    {
+        vector<uint8_t> neighbours(9 * count);
+        for (int k = 0; k < 9; ++k) if (crosstalk_.stencil().weights[k])
+        {
+            traceCellSets(crosstalk_.neighbour(cellNumber, k), firstFrame, count, &neighbours[k * count]);
+        }
+
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            uint8_t under[9];
+            for (int k = 0; k < 9; ++k) under[k] = neighbours[k * count + i];
+            values[i] = crosstalk_.applyCell(under);
+        }
+    }
+
+    // If the cell is defective, that changes what it reads
+    for (uint64_t i = 0; i < count; ++i) values[i] = defects_.apply(cellNumber, values[i]);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// traceCellSets() - Fetches the value the cell sets give one cell in 'count' consecutive frames
+//=================================================================================================
+void FrameModel::traceCellSets(uint32_t cellNumber, uint64_t firstFrame, uint64_t count, uint8_t* values)
+{
+    // A cell set that covers the cell, and the cell's position within it
+    struct cover_t
+    {
+        size_t   index;
+        uint64_t position;
+    };
+    vector<cover_t>  covers;
+    vector<uint64_t> cells(cellsets_.size());
+
+    // Find the cell sets that cover the cell
+    for (size_t k = 0; k < cellsets_.size(); ++k)
+    {
+        auto& cs = cellsets_[k];
+        cells[k] = cellCount(cs);
+        if (cells[k] == 0 || cellNumber < cs.first - 1 || cellNumber >= cs.last) continue;
+        if ((cellNumber - (cs.first - 1)) % cs.step) continue;
+        covers.push_back({k, (cellNumber - (cs.first - 1)) / cs.step});
+    }
+
+    GlibcRandom rng(seed_);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t frameNumber = firstFrame + i;
+
+        // If nothing plays in this cell, it's quiescent
+        values[i] = fillerValue_;
+
+        // Find the last cell set that plays something in this frame
+        for (auto it = covers.rbegin(); it != covers.rend(); ++it)
+        {
+            auto& seq = sequences_[cellsets_[it->index].sequence];
+            if (frameNumber >= seq.size()) continue;
+
+            // A literal value needs no random draw
+            uint16_t symbol = seq[frameNumber];
+            if ((symbol & NUCLEOTIDE) == 0)
+            {
+                values[i] = (uint8_t)symbol;
+                break;
+            }
+
+            // Work out which draw this cell gets
+            uint64_t draw = drawOffset_[frameNumber] + it->position;
+            for (size_t k = 0; k < it->index; ++k)
+            {
+                auto& before = sequences_[cellsets_[k].sequence];
+                if (frameNumber < before.size() && (before[frameNumber] & NUCLEOTIDE)) draw += cells[k];
+            }
+
+            // And jump the generator to it
+            if (draw < rng.position()) rng.seed(seed_);
+            rng.skip(draw - rng.position());
+            auto& adc = nucleotides_[symbol & ~NUCLEOTIDE];
+            values[i] = adc[rng.next() % adc.size()];
+            break;
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// serialize() - Converts the model to a stream of events
+//=================================================================================================
+vector<uint8_t> FrameModel::serialize()
+{
+    vector<uint8_t> events;
+
+    // Appends a single event to the stream
+    auto append = [&](uint32_t type, const void* payload, uint32_t length)
+    {
+        uint32_t hdr[2] = {type, length};
+        const uint8_t* p = (const uint8_t*)payload;
+        events.insert(events.end(), (const uint8_t*)hdr, (const uint8_t*)(hdr + 2));
+        events.insert(events.end(), p, p + length);
+    };
+
+    append(EVENT_SEED, &seed_, sizeof(seed_));
+
+    for (auto& n : nucleotides_) append(EVENT_NUCLEOTIDE, n.data(), n.size());
+
+    for (auto& s : sequences_) append(EVENT_SEQUENCE, s.data(), s.size() * sizeof(uint16_t));
+
+    for (auto& cs : cellsets_) append(EVENT_CELLSET, &cs, sizeof(cs));
+
+    if (markerCell_) append(EVENT_MARKER, &markerCell_, sizeof(markerCell_));
+
+    if (crosstalk_.enabled()) append(EVENT_CROSSTALK, &crosstalk_.stencil(), sizeof(Crosstalk::stencil_t));
+
+    auto& defects = defects_.defects();
+    if (!defects.empty()) append(EVENT_DEFECTS, defects.data(), defects.size() * sizeof(defects[0]));
+
+    return events;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// deserialize() - Rebuilds the model from a stream of events.   The geometry must already have
+//                 been set, and finalize() is called once the events have been consumed
+//=================================================================================================
+void FrameModel::deserialize(const uint8_t* events, size_t length)
+{
+    const uint8_t* p   = events;
+    const uint8_t* end = events + length;
+    uint32_t       hdr[2];
+
+    nucleotides_.clear();
+    sequences_.clear();
+    cellsets_.clear();
+    crosstalk_.clear();
+    defects_.clear();
+    markerCell_ = 0;
+
+    while (p < end)
+    {
+        // Fetch the type and length of the event
+        if (end - p < (ptrdiff_t)sizeof(hdr)) throwRuntime("Truncated model event");
+        memcpy(hdr, p, sizeof(hdr));
+        p += sizeof(hdr);
+        uint32_t type = hdr[0], size = hdr[1];
+        if ((size_t)(end - p) < size) throwRuntime("Truncated model event");
+
+        switch (type)
+        {
+            case EVENT_SEED:
+                if (size != sizeof(seed_)) throwRuntime("Malformed seed event");
+                memcpy(&seed_, p, size);
+                break;
+
+            case EVENT_NUCLEOTIDE:
+                addNucleotide(vector<uint8_t>(p, p + size));
+                break;
+
+            case EVENT_SEQUENCE:
+            {
+                vector<uint16_t> symbols(size / sizeof(uint16_t));
+                memcpy(symbols.data(), p, symbols.size() * sizeof(uint16_t));
+                addSequence(symbols);
+                break;
+            }
+
+            case EVENT_CELLSET:
+            {
+                cellset_t cs;
+                if (size != sizeof(cs)) throwRuntime("Malformed cell set event");
+                memcpy(&cs, p, size);
+                cellsets_.push_back(cs);
+                break;
+            }
+
+            case EVENT_MARKER:
+                if (size != sizeof(markerCell_)) throwRuntime("Malformed marker event");
+                memcpy(&markerCell_, p, size);
+                break;
+
+            case EVENT_CROSSTALK:
+            {
+                Crosstalk::stencil_t stencil;
+                if (size != sizeof(stencil)) throwRuntime("Malformed crosstalk event");
+                memcpy(&stencil, p, size);
+                crosstalk_.set(stencil);
+                break;
+            }
+
+            case EVENT_DEFECTS:
+            {
+                DefectMap::defect_t defect;
+                if (size % sizeof(defect)) throwRuntime("Malformed defect event");
+                for (uint32_t i = 0; i < size; i += sizeof(defect))
+                {
+                    memcpy(&defect, p + i, sizeof(defect));
+                    defects_.add(defect.cell, defect.keep, defect.stuck);
+                }
+                break;
+            }
+
+            // Unknown events are skipped so that newer files can still be read
+            default:
+                break;
+        }
+
+        p += size;
+    }
+
+    finalize();
+}
+//=================================================================================================
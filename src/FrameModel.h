@@ -0,0 +1,121 @@
+//=================================================================================================
+// FrameModel.h - Defines a compact, compiled model of a run from which any data frame can be
+//                built, in parallel, exactly as a single thread calling srand() and then
+//                rand() once per nucleotide cell would have built it
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "GlibcRandom.h"
+#include "DefectMap.h"
+#include "Crosstalk.h"
+
+class FrameModel
+{
+public:
+
+    // A symbol in a sequence is either a literal ADC value, or (if this bit is set) the index
+    // of a nucleotide whose ADC value is chosen at random
+    static const uint16_t NUCLEOTIDE = 0x8000;
+
+    // A set of cells (first, first+step, ... last, numbered from 1) that plays a sequence
+    struct cellset_t
+    {
+        uint32_t first, last, step, sequence;
+    };
+
+    // Constructor
+    FrameModel() {clear();}
+
+    // Empties the model
+    void     clear();
+
+    // Describes the shape of the frames and the random seed
+    void     setGeometry(uint32_t cellsPerFrame, uint64_t frameCount, uint8_t fillerValue);
+    void     setSeed(uint32_t seed) {seed_ = seed;}
+
+    // Reserves the cells starting at 'cell' (numbered from 1) of every frame for a frame marker
+    // (see marker.h).  0 means frames carry no marker
+    void     setMarkerCell(uint32_t cell) {markerCell_ = cell;}
+
+    // The defective cells of the sensor.  Fill this in before calling finalize()
+    DefectMap& defects() {return defects_;}
+
+    // The crosstalk between neighbouring cells.  Set this up before calling finalize()
+    Crosstalk& crosstalk() {return crosstalk_;}
+
+    // These build the model.  Cell sets are applied in the order they are added
+    uint32_t addNucleotide(const std::vector<uint8_t>& adcValues);
+    uint32_t addSequence(const std::vector<uint16_t>& symbols);
+    void     addCellSet(uint32_t first, uint32_t last, uint32_t step, uint32_t sequence);
+
+    // Call this after the model is complete, it works out where in the random sequence each
+    // frame begins
+    void     finalize();
+
+    // Converts the model to and from a stream of events
+    std::vector<uint8_t> serialize();
+    void     deserialize(const uint8_t* events, size_t length);
+
+    // Builds a single frame
+    void     buildFrame(uint64_t frameNumber, uint8_t* frame);
+
+    // Builds 'count' consecutive frames into 'dst', spread across all cores
+    void     buildFrames(uint64_t firstFrame, uint64_t count, uint8_t* dst);
+
+    // Fetches the value of cell 'cellNumber' (numbered from 0) in 'count' consecutive frames,
+    // without building the frames
+    void     traceCell(uint32_t cellNumber, uint64_t firstFrame, uint64_t count, uint8_t* values);
+
+    // Accessors
+    uint32_t cellsPerFrame() {return cellsPerFrame_;}
+    uint64_t frameCount()    {return frameCount_;}
+    uint8_t  fillerValue()   {return fillerValue_;}
+    uint32_t seed()          {return seed_;}
+    uint32_t markerCell()    {return markerCell_;}
+    uint64_t drawsBefore(uint64_t frameNumber) {return drawOffset_[frameNumber];}
+
+protected:
+
+    // Builds a frame using a random number generator that is already at the right position.
+    // Crosstalk is applied with up to 'threads' threads
+    void     buildFrame(uint64_t frameNumber, uint8_t* frame, GlibcRandom& rng, uint32_t threads);
+
+    // Fetches the value the cell sets alone give a cell, before crosstalk and defects
+    void     traceCellSets(uint32_t cellNumber, uint64_t firstFrame, uint64_t count, uint8_t* values);
+
+    // Returns the number of cells in a cell set
+    static uint64_t cellCount(const cellset_t& cs);
+
+    // Geometry and seed
+    uint32_t cellsPerFrame_;
+    uint64_t frameCount_;
+    uint8_t  fillerValue_;
+    uint32_t seed_;
+
+    // The first cell of the frame marker, or 0 if there isn't one
+    uint32_t markerCell_;
+
+    // The crosstalk between cells, applied to what the cell sets build
+    Crosstalk crosstalk_;
+
+    // The defective cells, applied after crosstalk and before the frame marker
+    DefectMap defects_;
+
+    // The ADC values of each nucleotide
+    std::vector<std::vector<uint8_t>> nucleotides_;
+
+    // Each sequence is one symbol per frame
+    std::vector<std::vector<uint16_t>> sequences_;
+
+    // The cell sets, in the order they are applied
+    std::vector<cellset_t> cellsets_;
+
+    // drawOffset_[n] is the number of random values consumed before frame 'n' is built
+    std::vector<uint64_t> drawOffset_;
+
+    // The generator used by buildFrame(), and the frame it's positioned at
+    GlibcRandom rng_;
+    uint64_t    rngFrame_;
+};
@@ -0,0 +1,20 @@
+//=================================================================================================
+// FrameSink.h - Defines the interface implemented by every destination that data frames can be
+//               written to
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+class FrameSink
+{
+public:
+
+    // Destructor
+    virtual ~FrameSink() {}
+
+    // Call this to append a single data frame
+    virtual void writeFrame(const uint8_t* frame) = 0;
+
+    // Call this after the last frame has been written
+    virtual void close() = 0;
+};
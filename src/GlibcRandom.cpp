@@ -0,0 +1,144 @@
+//=================================================================================================
+// GlibcRandom.cpp - Implements a class that reproduces (and jumps ahead in) the C library's
+//                   rand() sequence
+//
+// The sequence satisfies r[i] = r[i-31] + r[i-3] (mod 2^32), so any value can be expressed as a
+// linear combination of 31 consecutive earlier values.  The coefficients of that combination
+// are the coefficients of x^n mod (x^31 - x^28 - 1), which can be computed by repeated squaring
+// in O(log n) polynomial multiplications.
+//=================================================================================================
+#include <string.h>
+#include "GlibcRandom.h"
+
+// A polynomial of degree < 31 with coefficients mod 2^32
+struct poly_t {uint32_t c[31];};
+
+
+//=================================================================================================
+// polyMulMod() - Returns (a * b) mod (x^31 - x^28 - 1)
+//=================================================================================================
+static poly_t polyMulMod(const poly_t& a, const poly_t& b)
+{
+    uint32_t product[61] = {0};
+    poly_t   result;
+
+    // Multiply the polynomials
+    for (int i = 0; i < 31; ++i)
+    {
+        if (a.c[i] == 0) continue;
+        for (int j = 0; j < 31; ++j) product[i + j] += a.c[i] * b.c[j];
+    }
+
+    // Reduce using x^31 = x^28 + 1, working down from the highest power
+    for (int d = 60; d >= 31; --d)
+    {
+        uint32_t t = product[d];
+        product[d - 3]  += t;
+        product[d - 31] += t;
+    }
+
+    memcpy(result.c, product, sizeof(result.c));
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// polyMulX() - Returns (a * x) mod (x^31 - x^28 - 1)
+//=================================================================================================
+static poly_t polyMulX(const poly_t& a)
+{
+    poly_t   result;
+    uint32_t top = a.c[30];
+
+    result.c[0] = 0;
+    for (int i = 1; i < 31; ++i) result.c[i] = a.c[i - 1];
+    result.c[28] += top;
+    result.c[0]  += top;
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// seed() - Initializes the sequence exactly the way the C library's srand() does
+//=================================================================================================
+void GlibcRandom::seed(uint32_t seed)
+{
+    uint32_t r[34];
+
+    // A seed of 0 is treated as 1
+    if (seed == 0) seed = 1;
+
+    // The first 31 values come from a "minimal standard" linear congruential generator
+    int32_t word = seed;
+    r[0] = word;
+    for (int i = 1; i < 31; ++i)
+    {
+        int64_t hi = word / 127773;
+        int64_t lo = word % 127773;
+        int64_t value = 16807 * lo - 2836 * hi;
+        if (value < 0) value += 2147483647;
+        word = (int32_t)value;
+        r[i] = word;
+    }
+
+    // The next three are copies of the first three
+    for (int i = 31; i < 34; ++i) r[i] = r[i - 31];
+
+    // Our window is the most recent 31 values
+    memcpy(r_, r + 3, sizeof(r_));
+    index_ = 0;
+
+    // The C library throws away the first 310 values
+    for (int i = 0; i < 310; ++i) next();
+
+    // And now we're at the start of the sequence that rand() returns
+    position_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// skip() - Advances the sequence by 'count' values
+//=================================================================================================
+void GlibcRandom::skip(uint64_t count)
+{
+    // For short distances it's quicker to just generate the values
+    if (count < 1000)
+    {
+        while (count--) next();
+        return;
+    }
+
+    // Compute x^count mod P(x) by repeated squaring
+    poly_t power, base;
+    memset(&power, 0, sizeof(power));
+    memset(&base,  0, sizeof(base));
+    power.c[0] = 1;
+    base.c[1]  = 1;
+    for (uint64_t n = count; n; n >>= 1)
+    {
+        if (n & 1) power = polyMulMod(power, base);
+        base = polyMulMod(base, base);
+    }
+
+    // Fetch the current window in order, oldest first
+    uint32_t window[DEGREE], result[DEGREE];
+    for (uint32_t k = 0; k < DEGREE; ++k) window[k] = r_[(index_ + k) % DEGREE];
+
+    // Each value in the new window is a linear combination of the values in the old window
+    for (uint32_t k = 0; k < DEGREE; ++k)
+    {
+        uint32_t value = 0;
+        for (uint32_t j = 0; j < DEGREE; ++j) value += power.c[j] * window[j];
+        result[k] = value;
+        power = polyMulX(power);
+    }
+
+    // The new window starts at slot 0 of our ring
+    memcpy(r_, result, sizeof(r_));
+    index_     = 0;
+    position_ += count;
+}
+//=================================================================================================
@@ -0,0 +1,50 @@
+//=================================================================================================
+// GlibcRandom.h - Defines a class that reproduces the sequence of values returned by the C
+//                 library's rand() after a call to srand(), and that can jump ahead in that
+//                 sequence without generating the values in between.
+//
+// This lets any thread produce exactly the values that a single thread calling rand() would
+// have seen at any point in a run.
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+class GlibcRandom
+{
+public:
+
+    // Constructor
+    GlibcRandom(uint32_t seed = 1) {this->seed(seed);}
+
+    // Equivalent to srand()
+    void     seed(uint32_t seed);
+
+    // Equivalent to rand()
+    uint32_t next()
+    {
+        uint32_t value = r_[index_ % DEGREE] += r_[(index_ + DEGREE - SEPARATION) % DEGREE];
+        ++index_;
+        ++position_;
+        return value >> 1;
+    }
+
+    // Skips over the next 'count' values in the sequence
+    void     skip(uint64_t count);
+
+    // Returns the number of values that have been generated since seed() was called
+    uint64_t position() {return position_;}
+
+protected:
+
+    // The C library's default generator is an additive lagged-fibonacci generator with these
+    // parameters:  r[i] = r[i - 31] + r[i - 3]
+    static const uint32_t DEGREE     = 31;
+    static const uint32_t SEPARATION = 3;
+
+    // The 31 most recent values of the sequence.  r_[index_ % DEGREE] is the oldest
+    uint32_t r_[DEGREE];
+    uint64_t index_;
+
+    // The number of values generated since the last call to seed()
+    uint64_t position_;
+};
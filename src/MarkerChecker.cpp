@@ -0,0 +1,178 @@
+//=================================================================================================
+// MarkerChecker.cpp - Implements a class that stamps frame markers into frames, and checks a
+//                     capture of frames for dropped, duplicated, reordered, or damaged ones
+//
+// Checking a capture is dominated by computing the CRC of every frame, so the frames are
+// divided among all of the cores, each of which runs the CPU's CRC instruction over its share.
+// The frame numbers are then examined in order on a single thread, which is cheap.
+//=================================================================================================
+#include <string.h>
+#include <thread>
+#include "MarkerChecker.h"
+#include "crc32c.h"
+using namespace std;
+
+// We record the details of this many problems.  The rest are only counted
+static const size_t MAX_ANOMALIES = 100;
+
+// The number of frames examined in parallel at a time
+static const uint64_t FRAMES_PER_PASS = 4096;
+
+
+//=================================================================================================
+// frameCrc() - Returns the CRC-32C of every cell in a frame except those of the marker
+//=================================================================================================
+uint32_t MarkerChecker::frameCrc(const uint8_t* frame, uint32_t cellsPerFrame, uint32_t markerOffset)
+{
+    uint32_t after = markerOffset + sizeof(frame_marker_t);
+    uint32_t crc   = crc32c(0, frame, markerOffset);
+    return crc32c(crc, frame + after, cellsPerFrame - after);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stamp() - Writes the marker into a frame
+//=================================================================================================
+void MarkerChecker::stamp(uint8_t* frame, uint32_t cellsPerFrame, uint32_t markerOffset, uint64_t frameNumber)
+{
+    frame_marker_t marker;
+    memcpy(marker.magic, MARKER_MAGIC, sizeof(marker.magic));
+    marker.crc         = frameCrc(frame, cellsPerFrame, markerOffset);
+    marker.frameNumber = frameNumber;
+    memcpy(frame + markerOffset, &marker, sizeof(marker));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Starts checking a new capture
+//=================================================================================================
+void MarkerChecker::create(uint32_t cellsPerFrame, uint32_t markerCell)
+{
+    cellsPerFrame_ = cellsPerFrame;
+    markerOffset_  = markerCell ? markerCell - 1 : 0;
+    next_          = 0;
+    started_       = false;
+    framesChecked_ = firstFrame_ = lastFrame_ = 0;
+    dropped_ = duplicated_ = reordered_ = badMarkers_ = badCrcs_ = 0;
+    anomalies_.clear();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// report() - Records the details of a problem
+//=================================================================================================
+void MarkerChecker::report(kind_t kind, uint64_t position, uint64_t expected, uint64_t found)
+{
+    if (anomalies_.size() < MAX_ANOMALIES) anomalies_.push_back({kind, position, expected, found});
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// check() - Checks the next 'count' frames of the capture
+//=================================================================================================
+void MarkerChecker::check(const uint8_t* frames, uint64_t count)
+{
+    // The status of each frame in a pass: its frame number, and whether its marker is intact
+    struct status_t {uint64_t frameNumber; bool goodMarker, goodCrc;};
+    vector<status_t> status(FRAMES_PER_PASS);
+
+    // Find out how many threads to run
+    uint32_t threadCount = thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+
+    for (uint64_t first = 0; first < count; first += FRAMES_PER_PASS)
+    {
+        uint64_t passFrames = count - first < FRAMES_PER_PASS ? count - first : FRAMES_PER_PASS;
+        uint32_t passThreads = passFrames < threadCount ? passFrames : threadCount;
+
+        // Reads the marker and computes the CRC of each frame in a thread's share of this pass
+        auto examine = [&](uint32_t t)
+        {
+            for (uint64_t i = passFrames * t / passThreads; i < passFrames * (t + 1) / passThreads; ++i)
+            {
+                const uint8_t* frame = frames + (first + i) * cellsPerFrame_;
+                frame_marker_t marker;
+                memcpy(&marker, frame + markerOffset_, sizeof(marker));
+                status[i].frameNumber = marker.frameNumber;
+                status[i].goodMarker  = memcmp(marker.magic, MARKER_MAGIC, sizeof(marker.magic)) == 0;
+                status[i].goodCrc     = status[i].goodMarker &&
+                                        marker.crc == frameCrc(frame, cellsPerFrame_, markerOffset_);
+            }
+        };
+
+        // A single frame (the usual case for a live consumer) isn't worth starting a thread for
+        if (passThreads == 1)
+            examine(0);
+        else
+        {
+            vector<thread> threads;
+            for (uint32_t t = 0; t < passThreads; ++t) threads.emplace_back(examine, t);
+            for (auto& t : threads) t.join();
+        }
+
+        // Now walk through the frame numbers in the order they were captured
+        for (uint64_t i = 0; i < passFrames; ++i)
+        {
+            uint64_t position = framesChecked_++;
+            uint64_t n        = status[i].frameNumber;
+
+            // If there's no marker, we can't tell which frame this is.  We presume it's the one
+            // we were expecting, so that it isn't counted as dropped as well
+            if (!status[i].goodMarker)
+            {
+                ++badMarkers_;
+                report(BAD_MARKER, position, next_, 0);
+                if (started_) ++next_;
+                continue;
+            }
+
+            // If the contents of the frame don't match its CRC, the frame was damaged
+            if (!status[i].goodCrc)
+            {
+                ++badCrcs_;
+                report(BAD_CRC, position, n, n);
+            }
+
+            // The first frame we see sets the expectations
+            if (!started_)
+            {
+                started_ = true;
+                firstFrame_ = lastFrame_ = n;
+                next_ = n + 1;
+                continue;
+            }
+
+            lastFrame_ = n;
+
+            // Frames that are skipped over are presumed dropped...
+            if (n > next_)
+            {
+                dropped_ += n - next_;
+                report(GAP, position, next_, n);
+                next_ = n + 1;
+            }
+
+            // ...unless they turn up later, out of order
+            else if (n < next_ - 1)
+            {
+                ++reordered_;
+                if (dropped_) --dropped_;
+                report(REORDERED, position, next_, n);
+            }
+
+            // A frame that immediately repeats is a duplicate
+            else if (n == next_ - 1)
+            {
+                ++duplicated_;
+                report(DUPLICATE, position, next_, n);
+            }
+
+            else ++next_;
+        }
+    }
+}
+//=================================================================================================
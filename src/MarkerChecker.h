@@ -0,0 +1,77 @@
+//=================================================================================================
+// MarkerChecker.h - Defines a class that stamps frame markers into frames, and checks a capture
+//                   of frames for dropped, duplicated, reordered, or damaged ones
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "marker.h"
+
+class MarkerChecker
+{
+public:
+
+    // The kinds of trouble the checker reports
+    enum kind_t {GAP, DUPLICATE, REORDERED, BAD_MARKER, BAD_CRC};
+
+    // A single problem.  'position' is the index of the frame within the capture
+    struct anomaly_t
+    {
+        kind_t   kind;
+        uint64_t position;
+        uint64_t expected;
+        uint64_t found;
+    };
+
+    // Constructor
+    MarkerChecker() {create(0, 0);}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    MarkerChecker (const MarkerChecker&) = delete;
+    MarkerChecker& operator= (const MarkerChecker&) = delete;
+
+    // Returns the CRC that the marker at 'markerOffset' in a frame should hold
+    static uint32_t frameCrc(const uint8_t* frame, uint32_t cellsPerFrame, uint32_t markerOffset);
+
+    // Writes the marker for frame 'frameNumber' into a frame that is otherwise complete
+    static void stamp(uint8_t* frame, uint32_t cellsPerFrame, uint32_t markerOffset, uint64_t frameNumber);
+
+    // Starts checking a new capture.  'markerCell' is numbered from 1, like "marker_cell"
+    void    create(uint32_t cellsPerFrame, uint32_t markerCell);
+
+    // Checks the next 'count' consecutive frames of the capture, spread across all cores.  This
+    // can be called repeatedly as more of the capture becomes available
+    void    check(const uint8_t* frames, uint64_t count);
+
+    // The first few problems that were found, in the order they appear in the capture
+    const std::vector<anomaly_t>& anomalies() {return anomalies_;}
+
+    // Statistics about the capture so far
+    uint64_t framesChecked() {return framesChecked_;}
+    uint64_t firstFrame()    {return firstFrame_;}
+    uint64_t lastFrame()     {return lastFrame_;}
+    uint64_t dropped()       {return dropped_;}
+    uint64_t duplicated()    {return duplicated_;}
+    uint64_t reordered()     {return reordered_;}
+    uint64_t badMarkers()    {return badMarkers_;}
+    uint64_t badCrcs()       {return badCrcs_;}
+
+protected:
+
+    // Records a problem, if we haven't already recorded plenty of them
+    void    report(kind_t kind, uint64_t position, uint64_t expected, uint64_t found);
+
+    // The geometry of the frames, and the offset of the marker in each frame
+    uint32_t cellsPerFrame_;
+    uint32_t markerOffset_;
+
+    // The frame number we expect to see next, and whether we've seen any frame yet
+    uint64_t next_;
+    bool     started_;
+
+    // The statistics, and the first few problems
+    uint64_t framesChecked_, firstFrame_, lastFrame_;
+    uint64_t dropped_, duplicated_, reordered_, badMarkers_, badCrcs_;
+    std::vector<anomaly_t> anomalies_;
+};
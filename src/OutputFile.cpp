@@ -0,0 +1,542 @@
+//=================================================================================================
+// OutputFile.cpp - Implements a class that writes data frames to the output file
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include <stddef.h>
+#include <stdexcept>
+#include "OutputFile.h"
+#include "crc32c.h"
+#include "simd.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// hashFrame() - Computes a fast 64-bit hash of a data frame.   Frame sizes are always a multiple
+//               of the row size, so we can consume the frame 8 bytes at a time.
+//=================================================================================================
+static uint64_t hashFrame(const uint8_t* frame, size_t size)
+{
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t h = size * prime, word;
+
+    for (size_t i = 0; i < size; i += 8)
+    {
+        memcpy(&word, frame + i, 8);
+        h = (h ^ word) * prime;
+        h ^= h >> 29;
+    }
+
+    return h;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Creates the output file
+//
+// Passed: filename  = The name of the file to create
+//         frameSize = The number of bytes in a single data frame
+//         dedup     = If true, frames that duplicate an earlier frame get cloned from the earlier
+//                     copy rather than written again
+//         header    = If not null, the file is a container, and this is its header.  The
+//                     'dataOffset', 'dataSize', 'trailerOffset' and 'headerCrc' fields are
+//                     filled in when the file is closed
+//=================================================================================================
+void OutputFile::create(const char* filename, size_t frameSize, bool dedup,
+                        const container_header_t* header)
+{
+    openFile(filename, frameSize, dedup, header, true);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// resume() - Re-opens a partially written output file and positions us after the first 
+//            'frameCount' frames.  De-duplication starts afresh, so frames after that point are 
+//            only cloned from other frames after that point.
+//=================================================================================================
+void OutputFile::resume(const char* filename, size_t frameSize, bool dedup,
+                        const container_header_t* header, uint64_t frameCount,
+                        const vector<uint32_t>& groupCrcs)
+{
+    struct stat sb;
+
+    openFile(filename, frameSize, dedup, header, false);
+
+    // This is where the frame data we're keeping ends, and where the next frame goes.  They
+    // differ if there's padding after the last frame we're keeping
+    off_t dataEnd = frameCount ? frameOffset(frameCount - 1) + frameSize : dataStart_;
+    off_t end     = frameOffset(frameCount);
+
+    // If the file doesn't contain all of those frames, we can't resume
+    fstat(fd_, &sb);
+    if (sb.st_size < dataEnd) throwRuntime("%s is shorter than its checkpoint says", filename);
+
+    // Throw away anything that was written after that point
+    if (ftruncate(fd_, end) < 0) throwRuntime("Can't set size of %s: %s", filename, strerror(errno));
+
+    // And carry on from there
+    offset_      = end;
+    frameNumber_ = frameCount;
+    windowStart_ = end;
+    groupCrcs_   = groupCrcs;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// openFile() - Opens the output file and gets ready to write frames to it
+//=================================================================================================
+void OutputFile::openFile(const char* filename, size_t frameSize, bool dedup,
+                          const container_header_t* header, bool truncate)
+{
+    // Make sure we don't already have a file open
+    close();
+
+    // Open the output file, and complain if we can't
+    fd_ = ::open(filename, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0666);
+    if (fd_ < 0) throwRuntime("Can't create %s", filename);
+
+    // Save our parameters for future use
+    filename_  = filename;
+    frameSize_ = frameSize;
+    dedup_     = dedup;
+
+    // If this is a container, the frame data begins after the header
+    isContainer_ = (header != nullptr);
+    if (isContainer_) header_ = *header;
+
+    // Find out if the frames should be stored as a sparse file
+    isSparse_ = isContainer_ && header_.encoding == ENCODING_FILLER_XOR;
+    if (isSparse_) encoded_.reset(new uint8_t[frameSize]);
+
+    // Nothing has been written yet
+    dataStart_         = isContainer_ ? CONTAINER_DATA_OFFSET : 0;
+    offset_            = dataStart_;
+    frameNumber_       = 0;
+    windowStart_       = offset_;
+    groupCrc_          = 0;
+    framesInGroup_     = 0;
+    groupCrcs_.clear();
+    pendingLen_        = 0;
+    bytesWritten_      = 0;
+    bytesDeduplicated_ = 0;
+    seen_.clear();
+
+    // If we're de-duplicating, we need a buffer to verify matching frames
+    if (dedup_) verify_.reset(new uint8_t[frameSize]);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// preallocate() - Reserves disk space for 'frameCount' frames after the current write offset
+//
+// The file size is left alone, so until the frames are actually written the file looks exactly
+// as it would have without this.  Sparse files are left alone, since the whole point of them is
+// that idle pages take no space.  Not every file system supports this, and that's fine.
+//=================================================================================================
+void OutputFile::preallocate(uint64_t frameCount)
+{
+    if (isSparse_ || frameCount == 0) return;
+
+    // If the frames are packed, it's a single range
+    if (frameStride_ == 0)
+    {
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, offset_, frameCount * frameSize_);
+        return;
+    }
+
+    // Otherwise the padding stays a hole, and only each run of abutting frames gets space
+    uint64_t end = frameNumber_ + frameCount;
+    for (uint64_t n = frameNumber_; n < end;)
+    {
+        uint64_t frames = frameStride_ == frameSize_ ? framesPerGroup_ - n % framesPerGroup_ : 1;
+        if (n + frames > end) frames = end - n;
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, frameOffset(n), frames * frameSize_);
+        n += frames;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// frameOffset() - Returns the file offset of the specified frame
+//=================================================================================================
+off_t OutputFile::frameOffset(uint64_t frameNumber)
+{
+    if (frameStride_ == 0) return dataStart_ + frameNumber * frameSize_;
+    return dataStart_ + (frameNumber / framesPerGroup_) * groupStride_
+                      + (frameNumber % framesPerGroup_) * frameStride_;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// flushWindows() - Keeps the amount of dirty data in the page cache bounded
+//
+// Each time a window of the file has been completely written, we ask the kernel to start
+// writing it to disk.  Then we wait for the window before it (which has had a whole window's
+// worth of time to get there) to finish, and tell the kernel we won't be needing its pages
+// again.  At most two windows of the file are ever dirty, rather than however much the kernel
+// allows before it throttles us.
+//=================================================================================================
+void OutputFile::flushWindows()
+{
+    while (offset_ - windowStart_ >= (off_t)writeBehind_)
+    {
+        // Start writing the window that was just completed
+        sync_file_range(fd_, windowStart_, writeBehind_, SYNC_FILE_RANGE_WRITE);
+
+        // Wait for the previous window to reach the disk, then drop it from the page cache
+        if (windowStart_ >= (off_t)writeBehind_)
+        {
+            off_t previous = windowStart_ - writeBehind_;
+            sync_file_range(fd_, previous, writeBehind_, SYNC_FILE_RANGE_WAIT_BEFORE
+                                                        | SYNC_FILE_RANGE_WRITE
+                                                        | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(fd_, previous, writeBehind_, POSIX_FADV_DONTNEED);
+        }
+
+        windowStart_ += writeBehind_;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeAt() - Writes a buffer to the output file at the specified offset
+//=================================================================================================
+void OutputFile::writeAt(const uint8_t* buffer, size_t length, off_t offset)
+{
+    while (length)
+    {
+        ssize_t rc = pwrite(fd_, buffer, length, offset);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) throwRuntime("Write to %s failed: %s", filename_, strerror(errno));
+        buffer += rc;
+        offset += rc;
+        length -= rc;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFrameAt() - Writes a frame to the output file at the specified offset.  If this is a
+//                  sparse file, any page of the file that would be entirely zero is skipped
+//                  so that it remains a hole
+//=================================================================================================
+void OutputFile::writeFrameAt(const uint8_t* frame, off_t offset)
+{
+    const off_t PAGE_SIZE = 4096;
+
+    // If this isn't a sparse file, just write the frame
+    if (!isSparse_)
+    {
+        writeAt(frame, frameSize_, offset);
+        return;
+    }
+
+    off_t  end = offset + frameSize_;
+    off_t  runStart = -1;
+
+    // Walk through the frame one page of the file at a time
+    for (off_t pageStart = offset; pageStart < end;)
+    {
+        off_t pageEnd = (pageStart / PAGE_SIZE + 1) * PAGE_SIZE;
+        if (pageEnd > end) pageEnd = end;
+
+        bool zero = isAllZero(frame + (pageStart - offset), pageEnd - pageStart);
+
+        // Non-zero pages are gathered into runs that are written all at once
+        if (!zero && runStart < 0) runStart = pageStart;
+        if (zero && runStart >= 0)
+        {
+            writeAt(frame + (runStart - offset), pageStart - runStart, runStart);
+            runStart = -1;
+        }
+
+        pageStart = pageEnd;
+    }
+
+    // Write out the final run of non-zero pages
+    if (runStart >= 0)
+    {
+        writeAt(frame + (runStart - offset), end - runStart, runStart);
+        return;
+    }
+
+    // If the frame ended in a hole, extend the file so that the hole is readable
+    if (ftruncate(fd_, end) < 0) throwRuntime("Can't set size of %s: %s", filename_, strerror(errno));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// cloneRange() - Copies 'length' bytes that have already been written at 'srcOffset' to
+//                'dstOffset'.   We first try to reflink the range (which shares the underlying
+//                disk blocks), then try an in-kernel copy, and if neither of those is supported
+//                by the file system we fall back to reading and re-writing the data.
+//=================================================================================================
+void OutputFile::cloneRange(off_t srcOffset, off_t dstOffset, size_t length)
+{
+    struct stat sb;
+
+    // Reflinks only work on ranges that are aligned to the file system block size
+    fstat(fd_, &sb);
+    size_t blockSize = sb.st_blksize;
+    bool aligned = (srcOffset % blockSize == 0) && (dstOffset % blockSize == 0)
+                && (length % blockSize == 0);
+
+    // If the range is aligned, try to reflink it
+    if (aligned)
+    {
+        file_clone_range fcr;
+        fcr.src_fd      = fd_;
+        fcr.src_offset  = srcOffset;
+        fcr.src_length  = length;
+        fcr.dest_offset = dstOffset;
+        if (ioctl(fd_, FICLONERANGE, &fcr) == 0) return;
+    }
+
+    // Try to have the kernel copy the data for us
+    while (length)
+    {
+        loff_t src = srcOffset, dst = dstOffset;
+        ssize_t rc = copy_file_range(fd_, &src, fd_, &dst, length, 0);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) break;
+        srcOffset += rc;
+        dstOffset += rc;
+        length    -= rc;
+    }
+
+    // If there's nothing left to copy, we're done
+    if (length == 0) return;
+
+    // If we get here, the file system won't copy for us.  Do it the old-fashioned way.
+    while (length)
+    {
+        size_t blockSize = (length < frameSize_) ? length : frameSize_;
+        if (pread(fd_, verify_.get(), blockSize, srcOffset) != (ssize_t)blockSize)
+        {
+            throwRuntime("Read from %s failed: %s", filename_, strerror(errno));
+        }
+        writeAt(verify_.get(), blockSize, dstOffset);
+        srcOffset += blockSize;
+        dstOffset += blockSize;
+        length    -= blockSize;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// flushPendingRun() - Clones the current run of duplicate frames (if there is one) into the file
+//=================================================================================================
+void OutputFile::flushPendingRun()
+{
+    if (pendingLen_ == 0) return;
+    cloneRange(pendingSrc_, pendingDst_, pendingLen_);
+    pendingLen_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFrame() - Appends a data frame to the output file, and keeps the write-behind going
+//=================================================================================================
+void OutputFile::writeFrame(const uint8_t* frame)
+{
+    offset_ = frameOffset(frameNumber_++);
+    appendFrame(frame);
+    if (writeBehind_) flushWindows();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// appendFrame() - Appends a data frame to the output file
+//
+// When de-duplicating, consecutive duplicate frames whose earlier copies are also consecutive
+// are accumulated into a single run, so a repeated frame group gets cloned in one operation.
+//=================================================================================================
+void OutputFile::appendFrame(const uint8_t* frame)
+{
+    // In a sparse file, frames are stored exclusive-ORed with the filler value
+    if (isSparse_)
+    {
+        xorBytes(encoded_.get(), frame, frameSize_, header_.fillerValue);
+        frame = encoded_.get();
+    }
+
+    // If this is a container, fold this frame into the CRC of the current frame group
+    if (isContainer_)
+    {
+        groupCrc_ = crc32c(groupCrc_, frame, frameSize_);
+        if (++framesInGroup_ == header_.framesPerGroup)
+        {
+            groupCrcs_.push_back(groupCrc_);
+            groupCrc_      = 0;
+            framesInGroup_ = 0;
+        }
+    }
+
+    // If we're not de-duplicating (or the frame is nothing but a hole), just write the frame
+    if (!dedup_ || (isSparse_ && isAllZero(frame, frameSize_)))
+    {
+        flushPendingRun();
+        writeFrameAt(frame, offset_);
+        offset_       += frameSize_;
+        bytesWritten_ += frameSize_;
+        return;
+    }
+
+    // Hash the frame and find out if we've seen this hash before
+    uint64_t hash = hashFrame(frame, frameSize_);
+    auto it = seen_.find(hash);
+
+    // If we have, make sure the earlier frame really is identical to this one
+    if (it != seen_.end())
+    {
+        off_t src = it->second;
+        bool  identical = pread(fd_, verify_.get(), frameSize_, src) == (ssize_t)frameSize_
+                       && memcmp(verify_.get(), frame, frameSize_) == 0;
+
+        if (identical)
+        {
+            // If this frame doesn't extend the current run, flush the run and start a new one
+            if (pendingLen_ == 0 || pendingSrc_ + (off_t)pendingLen_ != src
+                                 || pendingDst_ + (off_t)pendingLen_ != offset_)
+            {
+                flushPendingRun();
+                pendingSrc_ = src;
+                pendingDst_ = offset_;
+            }
+
+            // This frame is now part of the pending run
+            pendingLen_        += frameSize_;
+            offset_            += frameSize_;
+            bytesDeduplicated_ += frameSize_;
+            return;
+        }
+    }
+
+    // If we get here, this frame is unique.  Any pending clones have to be written first.
+    flushPendingRun();
+
+    // Remember where the first frame with this hash lives
+    if (it == seen_.end()) seen_[hash] = offset_;
+
+    // And write the frame to the file
+    writeFrameAt(frame, offset_);
+    offset_       += frameSize_;
+    bytesWritten_ += frameSize_;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// checkpoint() - Writes any pending clones and waits for all of the frame data to reach the disk
+//=================================================================================================
+void OutputFile::checkpoint()
+{
+    flushPendingRun();
+    if (fdatasync(fd_) < 0) throwRuntime("Can't sync %s: %s", filename_, strerror(errno));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeContainerMetadata() - Writes the table of frame group CRCs after the frame data, then 
+//                            goes back and writes the header at the start of the file
+//=================================================================================================
+void OutputFile::writeContainerMetadata()
+{
+    // If the last frame group was incomplete, it still gets a CRC
+    if (framesInGroup_) groupCrcs_.push_back(groupCrc_);
+
+    // Fill in the fields that describe where everything is in the file
+    header_.headerSize      = sizeof(header_);
+    header_.dataOffset      = CONTAINER_DATA_OFFSET;
+    header_.dataSize        = offset_ - CONTAINER_DATA_OFFSET;
+    header_.trailerOffset   = offset_;
+    header_.frameGroupCount = groupCrcs_.size();
+    header_.frameCount      = header_.dataSize / frameSize_;
+    header_.headerCrc       = crc32c(0, &header_, offsetof(container_header_t, headerCrc));
+
+    // Write the CRC table, then the header.  In a sparse file, the frame data might end with
+    // a hole, and the CRC table could be empty, so make sure the file is the right size
+    writeAt((uint8_t*)groupCrcs_.data(), groupCrcs_.size() * sizeof(uint32_t), offset_);
+    writeAt((uint8_t*)&header_, sizeof(header_), 0);
+    if (ftruncate(fd_, offset_ + groupCrcs_.size() * sizeof(uint32_t)) < 0)
+    {
+        throwRuntime("Can't set size of %s: %s", filename_, strerror(errno));
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// Destructor - If the caller never called close() we're being destroyed during an exception, so
+//              just release the file descriptor
+//=================================================================================================
+OutputFile::~OutputFile()
+{
+    if (fd_ >= 0) ::close(fd_);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Flushes any pending clones and closes the output file
+//=================================================================================================
+void OutputFile::close()
+{
+    // If the file isn't open, there's nothing to do
+    if (fd_ < 0) return;
+
+    // Write out any duplicate frames that are still pending
+    flushPendingRun();
+
+    // If this is a container, it still needs a header and trailer
+    if (isContainer_) writeContainerMetadata();
+
+    // If the frames are spaced out, the file is padded out to a whole number of frame groups
+    if (frameStride_ && frameNumber_)
+    {
+        uint64_t groups = (frameNumber_ + framesPerGroup_ - 1) / framesPerGroup_;
+        off_t    end    = dataStart_ + groups * groupStride_;
+        if (ftruncate(fd_, end) < 0) throwRuntime("Can't set size of %s: %s", filename_, strerror(errno));
+    }
+
+    // And close the file
+    ::close(fd_);
+    fd_ = -1;
+}
+//=================================================================================================
@@ -0,0 +1,157 @@
+//=================================================================================================
+// OutputFile.h - Defines a class that writes data frames to the output file
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include "container.h"
+#include "FrameSink.h"
+
+class OutputFile : public FrameSink
+{
+public:
+
+    // Constructor
+    OutputFile() {fd_ = -1; writeBehind_ = 0; setLayout(0, 1, 0);}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    OutputFile (const OutputFile&) = delete;
+    OutputFile& operator= (const OutputFile&) = delete;
+
+    // Destructor, closes the file without flushing pending clones
+    ~OutputFile();
+
+    // Call this to create the output file.  If 'dedup' is true, duplicate frames are cloned
+    // from their earlier copy in the file instead of being written again.  If 'header' is 
+    // not null, the file is written in container format
+    void    create(const char* filename, size_t frameSize, bool dedup,
+                   const container_header_t* header = nullptr);
+
+    // Call this instead of create() to carry on with a partially written output file.  The 
+    // first 'frameCount' frames (and, for a container, the CRCs of their frame groups) are
+    // kept, and anything after them is discarded
+    void    resume(const char* filename, size_t frameSize, bool dedup, 
+                   const container_header_t* header, uint64_t frameCount,
+                   const std::vector<uint32_t>& groupCrcs);
+
+    // Reserves disk space for a file that will hold 'frameCount' frames, so the file system can
+    // lay it out contiguously and we don't run out of space half way through
+    void    preallocate(uint64_t frameCount);
+
+    // Once 'windowSize' bytes have been written, they're handed to the disk in the background,
+    // and once they're on the disk they're dropped from the page cache.  0 turns this off
+    void    setWriteBehind(size_t windowSize) {writeBehind_ = windowSize;}
+
+    // Spaces the frames out in the file: frame 'n' is written 'groupStride' bytes into frame
+    // group n / framesPerGroup, plus 'frameStride' bytes for each frame before it in the group.
+    // The gaps are left as holes.  A stride of 0 packs the frames back to back.  Only for raw
+    // files, and call this before create() or resume()
+    void    setLayout(uint64_t frameStride, uint32_t framesPerGroup, uint64_t groupStride)
+    {
+        frameStride_ = frameStride; framesPerGroup_ = framesPerGroup; groupStride_ = groupStride;
+    }
+
+    // Makes everything written so far durable.  Call this at the end of a frame group
+    void    checkpoint();
+
+    // Call this to append a single data frame to the output file
+    void    writeFrame(const uint8_t* frame);
+
+    // Flushes any pending de-duplicated frames and closes the file
+    void    close();
+
+    // Call these to find out how many bytes were written and how many were de-duplicated
+    uint64_t bytesWritten()      {return bytesWritten_;}
+    uint64_t bytesDeduplicated() {return bytesDeduplicated_;}
+
+    // Returns the CRC of every completed frame group in a container
+    const std::vector<uint32_t>& groupCrcs() {return groupCrcs_;}
+
+protected:
+
+    // Opens the output file, truncating it if 'truncate' is true, and sets up for writing
+    void    openFile(const char* filename, size_t frameSize, bool dedup,
+                     const container_header_t* header, bool truncate);
+
+    // Returns the file offset of frame number 'frameNumber'
+    off_t   frameOffset(uint64_t frameNumber);
+
+    // Writes a buffer to the file at the specified offset
+    void    writeAt(const uint8_t* buffer, size_t length, off_t offset);
+
+    // Writes a frame to the file at the specified offset.  In a sparse file, pages of zeros are
+    // skipped
+    void    writeFrameAt(const uint8_t* frame, off_t offset);
+
+    // Copies a region of the file that has already been written to a new offset
+    void    cloneRange(off_t srcOffset, off_t dstOffset, size_t length);
+
+    // Clones the current run of duplicate frames into the file
+    void    flushPendingRun();
+
+    // Appends a frame to the file, de-duplicating it if necessary
+    void    appendFrame(const uint8_t* frame);
+
+    // Starts write-back of each window that has been completely written, and evicts the
+    // window before it from the page cache
+    void    flushWindows();
+
+    // Writes the header and CRC trailer of a container file
+    void    writeContainerMetadata();
+
+    // The file descriptor of the output file
+    int     fd_;
+
+    // The name of the output file
+    const char* filename_;
+
+    // The number of bytes in a single data frame
+    size_t  frameSize_;
+
+    // True if we are de-duplicating frames
+    bool    dedup_;
+
+    // This is the file offset where the next frame will be written, and the number of that frame
+    off_t   offset_;
+    uint64_t frameNumber_;
+
+    // Where the frame data starts, and how the frames are spaced out (see setLayout())
+    off_t   dataStart_;
+    uint64_t frameStride_, groupStride_;
+    uint32_t framesPerGroup_;
+
+    // The size of a write-behind window (0 = none), and the offset where the next one starts
+    size_t  writeBehind_;
+    off_t   windowStart_;
+
+    // Map of frame-hash to the file offset of the first frame with that hash
+    std::unordered_map<uint64_t, off_t> seen_;
+
+    // The run of consecutive duplicate frames that hasn't been cloned yet
+    off_t   pendingSrc_, pendingDst_;
+    size_t  pendingLen_;
+
+    // Frame-sized buffer used to confirm that frames with matching hashes really are identical
+    std::unique_ptr<uint8_t[]> verify_;
+
+    // True if we're writing a container file, and the header we'll write at the end
+    bool    isContainer_;
+    container_header_t header_;
+
+    // True if frames are stored exclusive-ORed with the filler value, and a buffer to encode them
+    bool    isSparse_;
+    std::unique_ptr<uint8_t[]> encoded_;
+
+    // The running CRC of the current frame group, and the number of frames it contains so far
+    uint32_t groupCrc_, framesInGroup_;
+
+    // The CRC of every completed frame group
+    std::vector<uint32_t> groupCrcs_;
+
+    // Statistics for the report at the end of a run
+    uint64_t bytesWritten_, bytesDeduplicated_;
+};
@@ -0,0 +1,288 @@
+//=================================================================================================
+// PatternGenerator.cpp - Implements a class that builds synthetic test-pattern frames
+//
+// Every pattern is a pure function of the frame number, so frames can be built in any order,
+// by any number of threads:
+//
+//     prbs7        : The PRBS-7 sequence (x^7 + x^6 + 1), as one continuous stream of bits
+//                    running through every frame, most significant bit of each cell first
+//     prbs31       : The PRBS-31 sequence (x^31 + x^28 + 1), the same way
+//     ramp         : Cell 'c' of frame 'n' is (c + n) & 0xFF
+//     walking_ones : Cell 'c' of frame 'n' is 1 << ((c + n) % 8)
+//     frame_number : Every 8 cells hold the frame number, as a little-endian 64-bit value
+//
+// Both PRBS generators start with every bit of the register set.  PRBS-7 repeats every 127
+// bytes, so like the ramps it's copied out of a table.  PRBS-31 doesn't repeat for 256 MB, so
+// the generator jumps straight to the start of a frame, and then produces 7 bytes per step:
+// the sequence obeys s[n] = s[n-62] ^ s[n-56] (the square of its polynomial), so the next 56
+// bits are a shift and an exclusive-OR of the 64 bits before them.
+//=================================================================================================
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdexcept>
+#include <thread>
+#include "PatternGenerator.h"
+#include "MarkerChecker.h"
+using namespace std;
+
+// PRBS-31's characteristic polynomial, x^31 + x^3 + 1, from s[n+31] = s[n+3] ^ s[n]
+static const uint64_t PRBS31_POLY = (1ull << 31) | (1ull << 3) | 1;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// mulX() - Multiplies a polynomial by x, modulo the PRBS-31 polynomial
+//=================================================================================================
+static uint64_t mulX(uint64_t a)
+{
+    a <<= 1;
+    if (a & (1ull << 31)) a ^= PRBS31_POLY;
+    return a;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// mulMod() - Multiplies two polynomials modulo the PRBS-31 polynomial
+//=================================================================================================
+static uint64_t mulMod(uint64_t a, uint64_t b)
+{
+    uint64_t result = 0;
+    for (int bit = 30; bit >= 0; --bit)
+    {
+        result = mulX(result);
+        if ((b >> bit) & 1) result ^= a;
+    }
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// prbs31Word() - Returns bits 'bitPosition' through 'bitPosition' + 63 of the PRBS-31 sequence,
+//                the first of them in the most significant bit
+//
+// With every initial bit set, s[n] is the parity of x^n mod P(x)
+//=================================================================================================
+static uint64_t prbs31Word(uint64_t bitPosition)
+{
+    // Compute x^bitPosition mod P(x) by repeated squaring
+    uint64_t power = 1, base = 2;
+    for (uint64_t n = bitPosition; n; n >>= 1)
+    {
+        if (n & 1) power = mulMod(power, base);
+        base = mulMod(base, base);
+    }
+
+    // And step through the next 64 bits
+    uint64_t word = 0;
+    for (int i = 0; i < 64; ++i)
+    {
+        word = (word << 1) | __builtin_parityll(power);
+        power = mulX(power);
+    }
+    return word;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// storeBE() - Stores a big-endian 64-bit value
+//=================================================================================================
+static void storeBE(uint8_t* p, uint64_t value)
+{
+    value = __builtin_bswap64(value);
+    memcpy(p, &value, sizeof(value));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// prbs31() - Fills 'length' bytes of the PRBS-31 byte stream, starting 'position' bytes into it
+//=================================================================================================
+void PatternGenerator::prbs31(uint64_t position, uint8_t* dst, size_t length)
+{
+    uint8_t  head[8];
+    uint64_t w = prbs31Word(position * 8);
+
+    // The first 8 bytes come from jumping straight to them
+    storeBE(head, w);
+    memcpy(dst, head, min(length, sizeof(head)));
+
+    // Each step makes the next 56 bits from the 64 before them, which stay in 'w'.  The eighth
+    // byte it stores is overwritten by the next step
+    size_t n = sizeof(head);
+    for (; n + 8 <= length; n += 7)
+    {
+        w = (w << 56) | (((w >> 6) ^ w) & 0xFFFFFFFFFFFFFF);
+        storeBE(dst + n, w << 8);
+    }
+
+    // The last few bytes don't have room for a whole step
+    if (n < length)
+    {
+        storeBE(head, ((w >> 6) ^ w) << 8);
+        memcpy(dst + n, head, length - n);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Sets up to build frames with the named pattern
+//=================================================================================================
+void PatternGenerator::create(const string& name, uint32_t cellsPerFrame, uint32_t markerCell)
+{
+    uint64_t period = 0;
+
+    cellsPerFrame_ = cellsPerFrame;
+    markerCell_    = markerCell;
+    frameStep_     = 1;
+
+         if (name == "prbs7"       ) pattern_ = PRBS7;
+    else if (name == "prbs31"      ) pattern_ = PRBS31;
+    else if (name == "ramp"        ) pattern_ = RAMP;
+    else if (name == "walking_ones") pattern_ = WALKING_ONES;
+    else if (name == "frame_number") pattern_ = FRAME_NUMBER;
+    else throwRuntime("Unknown test_pattern '%s'", name.c_str());
+
+    // The frame marker has to fit inside the frame
+    if (markerCell_ && markerCell_ - 1 + sizeof(frame_marker_t) > cellsPerFrame_)
+    {
+        throwRuntime("The frame marker at cell %u doesn't fit in the frame", markerCell_);
+    }
+
+    // Build the table that repeating patterns are copied from.  It's long enough that a whole
+    // frame can be copied from any point in the first period
+    if (pattern_ == PRBS7)
+    {
+        // 127 bytes is exactly 8 periods of the bit sequence.  Frames follow on from each other
+        uint8_t  state = 0x7F;
+        period     = 127;
+        frameStep_ = cellsPerFrame_;
+        table_.assign(period + cellsPerFrame_, 0);
+        for (uint64_t bit = 0; bit < period * 8; ++bit)
+        {
+            uint8_t out = (state >> 6) & 1;
+            state = ((state << 1) | (((state >> 6) ^ (state >> 5)) & 1)) & 0x7F;
+            table_[bit / 8] |= out << (7 - bit % 8);
+        }
+    }
+    else if (pattern_ == RAMP || pattern_ == WALKING_ONES)
+    {
+        period = (pattern_ == RAMP) ? 256 : 8;
+        table_.resize(period + cellsPerFrame_);
+        for (uint64_t i = 0; i < table_.size(); ++i)
+        {
+            table_[i] = (pattern_ == RAMP) ? (uint8_t)i : (uint8_t)(1 << (i % 8));
+        }
+    }
+
+    // Wrap the table around on itself
+    for (uint64_t i = period; i < table_.size(); ++i) table_[i] = table_[i % period];
+    period_ = period;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// fill() - Fills a frame with the pattern
+//=================================================================================================
+void PatternGenerator::fill(uint64_t frameNumber, uint8_t* frame)
+{
+    switch (pattern_)
+    {
+        case PRBS31:
+            prbs31(frameNumber * cellsPerFrame_, frame, cellsPerFrame_);
+            break;
+
+        case FRAME_NUMBER:
+        {
+            uint32_t i = 0;
+            for (; i + sizeof(frameNumber) <= cellsPerFrame_; i += sizeof(frameNumber))
+            {
+                memcpy(frame + i, &frameNumber, sizeof(frameNumber));
+            }
+            memcpy(frame + i, &frameNumber, cellsPerFrame_ - i);
+            break;
+        }
+
+        // Everything else repeats, so it's a copy from the table
+        default:
+        {
+            uint64_t start = (frameNumber % period_) * (frameStep_ % period_) % period_;
+            memcpy(frame, table_.data() + start, cellsPerFrame_);
+            break;
+        }
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// buildFrame() - Builds a single frame
+//=================================================================================================
+void PatternGenerator::buildFrame(uint64_t frameNumber, uint8_t* frame)
+{
+    fill(frameNumber, frame);
+
+    // The frame marker goes on top of the pattern
+    if (markerCell_) MarkerChecker::stamp(frame, cellsPerFrame_, markerCell_ - 1, frameNumber);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// buildFrames() - Builds 'count' consecutive frames into 'dst'.  Each thread builds a
+//                 contiguous range of frames directly in place
+//=================================================================================================
+void PatternGenerator::buildFrames(uint64_t firstFrame, uint64_t count, uint8_t* dst)
+{
+    vector<thread> threads;
+
+    // Find out how many threads to run
+    uint32_t threadCount = thread::hardware_concurrency();
+    if (threadCount == 0) threadCount = 1;
+    if (threadCount > count) threadCount = count;
+
+    for (uint32_t t = 0; t < threadCount; ++t) threads.emplace_back([=]()
+    {
+        // This is the range of frames this thread builds
+        uint64_t start = firstFrame + count * t / threadCount;
+        uint64_t end   = firstFrame + count * (t + 1) / threadCount;
+        uint8_t* frame = dst + (start - firstFrame) * cellsPerFrame_;
+
+        // PRBS-31 frames follow on from each other, so the whole range is one run of the
+        // stream, and only needs one jump
+        if (pattern_ == PRBS31)
+        {
+            prbs31(start * cellsPerFrame_, frame, (end - start) * cellsPerFrame_);
+            if (markerCell_) for (uint64_t n = start; n < end; ++n, frame += cellsPerFrame_)
+            {
+                MarkerChecker::stamp(frame, cellsPerFrame_, markerCell_ - 1, n);
+            }
+            return;
+        }
+
+        for (uint64_t n = start; n < end; ++n, frame += cellsPerFrame_) buildFrame(n, frame);
+    });
+
+    for (auto& t : threads) t.join();
+}
+//=================================================================================================
@@ -0,0 +1,53 @@
+//=================================================================================================
+// PatternGenerator.h - Defines a class that builds synthetic test-pattern frames for bringing up
+//                      the DMA path: PRBS-7, PRBS-31, ramps, walking ones, and frame numbers
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+class PatternGenerator
+{
+public:
+
+    // The patterns we know how to build
+    enum pattern_t {PRBS7, PRBS31, RAMP, WALKING_ONES, FRAME_NUMBER};
+
+    // Constructor
+    PatternGenerator() {pattern_ = RAMP; cellsPerFrame_ = 0; markerCell_ = 0;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    PatternGenerator (const PatternGenerator&) = delete;
+    PatternGenerator& operator= (const PatternGenerator&) = delete;
+
+    // Sets up to build frames of 'cellsPerFrame' cells with the named pattern ("prbs7",
+    // "prbs31", "ramp", "walking_ones", or "frame_number").  If 'markerCell' is not 0, every
+    // frame carries a frame marker (see marker.h) starting at that cell
+    void    create(const std::string& name, uint32_t cellsPerFrame, uint32_t markerCell);
+
+    // Builds a single frame
+    void    buildFrame(uint64_t frameNumber, uint8_t* frame);
+
+    // Builds 'count' consecutive frames into 'dst', spread across all cores
+    void    buildFrames(uint64_t firstFrame, uint64_t count, uint8_t* dst);
+
+protected:
+
+    // Fills 'length' bytes of the PRBS-31 byte stream, starting 'position' bytes into it
+    static void prbs31(uint64_t position, uint8_t* dst, size_t length);
+
+    // Fills a frame, without its marker
+    void    fill(uint64_t frameNumber, uint8_t* frame);
+
+    // The pattern, the size of a frame, and the first cell of the frame marker (or 0)
+    pattern_t pattern_;
+    uint32_t  cellsPerFrame_;
+    uint32_t  markerCell_;
+
+    // Patterns that repeat are copied from this table.  A frame is 'cellsPerFrame_' bytes of
+    // it, starting at ((frameNumber * frameStep_) % period_)
+    std::vector<uint8_t> table_;
+    uint64_t  period_, frameStep_;
+};
@@ -4,11 +4,20 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
 #include <sys/mman.h>
 #include <sys/fcntl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include <errno.h>
 #include <string.h>
 #include <string>
+#include <sstream>
 #include <fstream>
+#include <stdexcept>
 #include "PhysMem.h"
 using namespace std;
 
@@ -42,10 +51,15 @@ static void throwRuntime(const char* fmt, ...)
 //                        2K = 0x400
 //                        3M = 0x30_0000
 //
+//              A value with no suffix (such as 0x100000000) is taken as a number of bytes, as
+//              the kernel does.
+//
 // If the delimieter is not found or the string is malformed in some way, returns -1
 //=================================================================================================
 static uint64_t parseKMG(const char delimeter, const char* ptr)
 {
+    char* end;
+
     // Look for the delimeter in the string the user gave us
     ptr = strchr(ptr, delimeter);
 
@@ -55,18 +69,20 @@ static uint64_t parseKMG(const char delimeter, const char* ptr)
     // Point to the character after the delimeter
     ++ptr;
 
-    // Convert the ASCII digits that follow the delimeter to an integer
-    int64_t value = strtol(ptr, 0, 0);
-
-    // Skip over all of the ASCII digits
-    while (*ptr >= '0' && *ptr <= '9') ++ptr;
+    // Convert the ASCII digits that follow the delimeter to an integer, and skip over them
+    uint64_t value = strtoull(ptr, &end, 0);
+    if (end == ptr) return MALFORMED;
+    ptr = end;
 
     // Return the appropriate scaled integer value
     if (*ptr == 'K') return value * 1024;
     if (*ptr == 'M') return value * 1024 * 1024;
     if (*ptr == 'G') return value * 1024 * 1024 * 1024;
 
-    // If we get here, there wasn't a K, M, or G after the numeric value
+    // A plain number of bytes ends where the value does
+    if (*ptr == 0 || *ptr == '$' || *ptr == ',' || *ptr == ' ') return value;
+
+    // If we get here, there was something other than a K, M, or G after the numeric value
     return MALFORMED;
 }
 //=================================================================================================
@@ -80,6 +96,19 @@ static uint64_t parseKMG(const char delimeter, const char* ptr)
 //         size     = The size of the region to map, in bytes
 //=================================================================================================
 void PhysMem::map(uint64_t physAddr, size_t size)
+{
+    map(vector<segment_t>{{physAddr, size, 0, -1}});
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// map() - Maps several regions of physical address space back to back in user-space
+//
+// A range of address space big enough for all of them is reserved first, and then each region
+// is mapped over its own part of that range, so the caller sees one contiguous buffer.
+//=================================================================================================
+void PhysMem::map(const vector<segment_t>& regions)
 {
     const char* filename = "/dev/mem";
 
@@ -89,35 +118,71 @@ void PhysMem::map(uint64_t physAddr, size_t size)
     // Unmap any memory we may already have mapped
     unmap();
 
+    // Work out where each region goes.  Every region but the last has to be a whole number of
+    // pages, or the next one wouldn't start where this one ends
+    size_t pageSize = sysconf(_SC_PAGESIZE), totalSize = 0;
+    vector<segment_t> segments(regions);
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (i + 1 < segments.size() && segments[i].size % pageSize)
+        {
+            throwRuntime("RAM region at 0x%lx isn't a whole number of pages", segments[i].physAddr);
+        }
+        segments[i].offset = totalSize;
+        segments[i].node   = nodeOf(segments[i].physAddr);
+        totalSize += segments[i].size;
+    }
+    if (totalSize == 0) throwRuntime("No RAM to map");
+
     // Open the /dev/mem device
     int fd = ::open(filename, O_RDWR| O_SYNC);
 
     // If that open failed, we're done here
     if (fd < 0) throwRuntime("Can't open %s", filename);
 
-    // Map the memory
-    void* ptr = mmap(0, size, protection, MAP_SHARED, fd, physAddr);
-    
+    // Reserve the address space for all of the regions
+    void* base = mmap(0, totalSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        ::close(fd);
+        throwRuntime("mmap failed");
+    }
+
+    // And map each region over its part of it
+    for (auto& s : segments)
+    {
+        void* ptr = mmap((uint8_t*)base + s.offset, s.size, protection, MAP_SHARED | MAP_FIXED, fd, s.physAddr);
+        if (ptr == MAP_FAILED)
+        {
+            ::close(fd);
+            munmap(base, totalSize);
+            throwRuntime("mmap failed");
+        }
+    }
+
     // We're done with /dev/mem
     ::close(fd);
 
-    // If mapping into user-space failed tell the caller
-    if (ptr == MAP_FAILED) throwRuntime("mmap failed");        
-
-    // Otherwise, that mapping succeeded.  Record the userspace address and region size
-    userspaceAddr_ = ptr;        
-    mappedSize_    = size;
-    physicalAddr_  = physAddr;
+    // Record the userspace address, the regions, and their total size
+    userspaceAddr_ = base;
+    mappedSize_    = totalSize;
+    physicalAddr_  = segments[0].physAddr;
+    segments_      = segments;
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// map() - Automatically maps the region defined with "memmap=" in /proc/cmdline
+// map() - Automatically maps every region defined with "memmap=" in /proc/cmdline
+//
+// Each "memmap=" parameter holds one or more comma separated "size$address" reservations.  On
+// a multi-socket machine there's usually one per NUMA node.  They're mapped in the order they
+// appear on the command line
 //=================================================================================================
 void PhysMem::map()
 {
-    string line;
+    string line, token;
+    vector<segment_t> regions;
     
     const char* filename = "/proc/cmdline";
 
@@ -133,23 +198,245 @@ void PhysMem::map()
     // Fetch the first line of the file
     getline(file, line);
 
-    // Look for "memmap=" in the command line
-    const char* p = ::strstr(line.c_str(), "memmap=");
+    // Look at every "memmap=" on the command line
+    istringstream words(line);
+    while (words >> token)
+    {
+        if (token.compare(0, 7, "memmap=") != 0) continue;
+
+        // Each of its comma separated entries is a region.  Only "$" reserves RAM
+        istringstream entries(token.substr(7));
+        string entry;
+        while (getline(entries, entry, ','))
+        {
+            if (entry.find('$') == string::npos) continue;
+
+            // Fetch the size and the physical address
+            entry = "=" + entry;
+            auto size     = parseKMG('=', entry.c_str());
+            auto physAddr = parseKMG('$', entry.c_str());
+
+            // If we couldn't parse one of those values, /proc/cmdline is malformed
+            if (physAddr == MALFORMED || size == MALFORMED) throwRuntime("malformed %s", filename);
+
+            regions.push_back({physAddr, size, 0, -1});
+        }
+    }
 
     // If we can't find "memmap=", something is awry
-    if (p == nullptr) throwRuntime("malformed %s", filename);
+    if (regions.empty()) throwRuntime("malformed %s", filename);
+
+    // Now go map these physical addresses into user-space
+    map(regions);
+}
+//=================================================================================================
 
-    // Fetch the value after the '='
-    auto size = parseKMG('=', p);
 
-    // Fetch the value after the '$'
-    auto physAddr = parseKMG('$', p);
+//=================================================================================================
+// mapHugePages() - Maps a file on a hugetlbfs mount, locks it into RAM, and finds out which
+//                  physical pages it occupies
+//
+// This needs no "memmap=" reservation: the pages come from the kernel's hugepage pool, and the
+// mount determines whether they're 2M or 1G.  The pages belong to the file rather than to this
+// process, so they (and their physical addresses) outlive it.  Deleting the file frees them.
+// The file is never shrunk, so a DMA engine that's been told where the pages are is never left
+// pointing at pages that have been freed.
+//
+// Passed: filename = The name of a file on a hugetlbfs mount.  It's created if need be
+//         size     = The minimum size of the buffer in bytes, or 0 to map the file as it is
+//=================================================================================================
+void PhysMem::mapHugePages(const char* filename, size_t size)
+{
+    struct statfs fs;
+    struct stat   st;
+    uint64_t      entry;
 
-    // If we couldn't parse one of those values, /proc/cmdline is malformed
-    if (physAddr == MALFORMED || size == MALFORMED) throwRuntime("malformed %s", filename);
+    // Unmap any memory we may already have mapped
+    unmap();
 
-    // Now go map this physical address into user-space
-    map(physAddr, size);
+    // Open the file, creating it if need be
+    bool created = true;
+    int fd = ::open(filename, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST)
+    {
+        created = false;
+        fd = ::open(filename, O_RDWR);
+    }
+    if (fd < 0) throwRuntime("Can't open %s", filename);
+
+    // It has to be on hugetlbfs, and the mount tells us how big the pages are
+    if (fstatfs(fd, &fs) != 0 || fs.f_type != HUGETLBFS_MAGIC || fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        if (created) unlink(filename);
+        throwRuntime("%s isn't on a hugetlbfs mount", filename);
+    }
+    size_t hugePageSize = fs.f_bsize;
+
+    // Round the size up to whole pages, and grow the file if it's too small
+    size = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+    if (size < (size_t)st.st_size) size = st.st_size;
+    if (size == 0)
+    {
+        ::close(fd);
+        if (created) unlink(filename);
+        throwRuntime("%s is empty", filename);
+    }
+    if (size > (size_t)st.st_size && ftruncate(fd, size) != 0)
+    {
+        ::close(fd);
+        throwRuntime("Can't grow %s to %lu bytes: %s", filename, size, strerror(errno));
+    }
+
+    // Map the file and fault every page in.  This fails if the pool is short of pages
+    void* base = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) throwRuntime("Not enough free %lu-byte hugepages for %s", hugePageSize, filename);
+    userspaceAddr_ = base;
+    mappedSize_    = size;
+
+    // Make sure none of it can ever be paged out
+    if (mlock(base, size) != 0)
+    {
+        unmap();
+        throwRuntime("Can't lock %s into RAM: %s", filename, strerror(errno));
+    }
+
+    // The pagemap has an entry for every ordinary page of our address space
+    int pagemap = ::open("/proc/self/pagemap", O_RDONLY);
+    if (pagemap < 0)
+    {
+        unmap();
+        throwRuntime("Can't open /proc/self/pagemap");
+    }
+
+    // Look up the physical address of every hugepage, merging those that are contiguous
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < size; offset += hugePageSize)
+    {
+        uint64_t index = ((uintptr_t)base + offset) / pageSize;
+        bool     ok    = pread(pagemap, &entry, sizeof(entry), index * sizeof(entry)) == sizeof(entry);
+
+        // Bit 63 means the page is present, and bits 0-54 are its page frame number.  Without
+        // CAP_SYS_ADMIN, the kernel reports every page frame number as 0
+        uint64_t pfn = entry & ((1ULL << 55) - 1);
+        if (!ok || (entry >> 63) == 0 || pfn == 0)
+        {
+            ::close(pagemap);
+            unmap();
+            throwRuntime("Can't find the physical address of %s", filename);
+        }
+
+        uint64_t physAddr = pfn * pageSize;
+        if (!segments_.empty() && segments_.back().physAddr + segments_.back().size == physAddr)
+            segments_.back().size += hugePageSize;
+        else
+            segments_.push_back({physAddr, hugePageSize, offset, nodeOf(physAddr)});
+    }
+    ::close(pagemap);
+
+    // Record the physical address of the start of the buffer
+    physicalAddr_ = segments_[0].physAddr;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// saveSegments() - Writes the segment table as text, for whatever programs the DMA engine
+//
+// Each line is "<offset> <physical_address> <size> <node>", where 'offset' is where the segment
+// starts within the buffer
+//=================================================================================================
+void PhysMem::saveSegments(const char* filename)
+{
+    FILE* ofile = fopen(filename, "w");
+    if (ofile == nullptr) throwRuntime("Can't create %s", filename);
+
+    fprintf(ofile, "# offset physical_address size node\n");
+    for (auto& s : segments_)
+    {
+        fprintf(ofile, "0x%lx 0x%lx 0x%lx %d\n", s.offset, s.physAddr, s.size, s.node);
+    }
+
+    if (fclose(ofile) != 0) throwRuntime("Write to %s failed", filename);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// nodeOf() - Returns the NUMA node that a physical address belongs to
+//
+// Each node lists the memory blocks it owns in sysfs.  RAM that's been reserved with "memmap="
+// usually isn't in any block, so the address belongs to whichever node owns the nearest block
+// at or below it.
+//
+// Returns: The node number, or -1 if the machine doesn't tell us
+//=================================================================================================
+int PhysMem::nodeOf(uint64_t physAddr)
+{
+    const char* nodeDir = "/sys/devices/system/node";
+    uint64_t blockSize = 0, bestBlock = 0;
+    int      bestNode  = -1;
+
+    // Find out how big a memory block is
+    ifstream file("/sys/devices/system/memory/block_size_bytes");
+    if (!(file >> hex >> blockSize) || blockSize == 0) return -1;
+    uint64_t block = physAddr / blockSize;
+
+    // Look at every memory block of every node
+    DIR* nodes = opendir(nodeDir);
+    if (nodes == nullptr) return -1;
+    while (auto n = readdir(nodes))
+    {
+        int node;
+        if (sscanf(n->d_name, "node%d", &node) != 1) continue;
+
+        DIR* blocks = opendir((string(nodeDir) + "/" + n->d_name).c_str());
+        if (blocks == nullptr) continue;
+        while (auto b = readdir(blocks))
+        {
+            uint64_t index;
+            if (sscanf(b->d_name, "memory%lu", &index) != 1 || index > block) continue;
+            if (bestNode < 0 || index >= bestBlock) {bestBlock = index; bestNode = node;}
+        }
+        closedir(blocks);
+    }
+    closedir(nodes);
+
+    return bestNode;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// bindToNode() - Restricts the calling thread to the CPUs that belong to a NUMA node
+//=================================================================================================
+void PhysMem::bindToNode(int node)
+{
+    string list, range;
+    cpu_set_t cpus;
+
+    // If we don't know where the memory is, any CPU will do
+    if (node < 0) return;
+
+    // Fetch the list of CPUs that belong to the node, which looks like "0-15,32-47"
+    ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+    if (!getline(file, list)) return;
+
+    // Turn it into a CPU set
+    CPU_ZERO(&cpus);
+    istringstream ranges(list);
+    while (getline(ranges, range, ','))
+    {
+        int first, last;
+        int count = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (count < 1) continue;
+        if (count == 1) last = first;
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &cpus);
+    }
+
+    // And run the thread on those CPUs
+    if (CPU_COUNT(&cpus)) pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
 }
 //=================================================================================================
 
@@ -166,5 +453,6 @@ void PhysMem::unmap()
     // Indicate that we no longer have any memory mapped
     userspaceAddr_ = nullptr;
     mappedSize_    = 0;
+    segments_.clear();
 }
 //=================================================================================================
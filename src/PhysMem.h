@@ -4,11 +4,21 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <vector>
 
 class PhysMem
 {
 public:
 
+    // A region of physical RAM, and where it appears in the mapped address space
+    struct segment_t
+    {
+        uint64_t physAddr;
+        size_t   size;
+        size_t   offset;
+        int      node;
+    };
+
     // Constructor
     PhysMem() {userspaceAddr_ = nullptr; mappedSize_ = 0;}
 
@@ -22,9 +32,20 @@ public:
     // Call this to map a region of physical address space into user-space
     void    map(uint64_t physAddr, size_t size);
 
-    // Automatically maps the region define with "memmap=" in /proc/cmdline
+    // Maps several regions of physical address space back to back, so that they appear as a
+    // single contiguous region in user-space.  Only 'physAddr' and 'size' of each are used
+    void    map(const std::vector<segment_t>& regions);
+
+    // Automatically maps every region defined with "memmap=" in /proc/cmdline
     void    map();
 
+    // Maps a file on a hugetlbfs mount, grown to at least 'size' bytes, locks it into RAM, and
+    // finds out which physical pages it occupies.  A size of 0 maps the file as it is
+    void    mapHugePages(const char* filename, size_t size);
+
+    // Writes the segment table as text, one "offset physical_address size node" per line
+    void    saveSegments(const char* filename);
+
     // Call these to return either a void* or a byte* in user-space
     uint8_t* bptr() {return (uint8_t*)userspaceAddr_;}
     void*    vptr() {return userspaceAddr_;}
@@ -35,9 +56,18 @@ public:
     // Call this to fetch the size of the mapped region in bytes
     size_t  getSize() {return mappedSize_;}
 
-    // Call this to fetch the physical address of the mapped region
+    // Call this to fetch the physical address of the (first) mapped region
     uint64_t getPhysAddr() {return physicalAddr_;}
 
+    // Returns the physical regions that make up the mapped space, in order
+    const std::vector<segment_t>& segments() {return segments_;}
+
+    // Returns the NUMA node that a physical address belongs to, or -1 if that can't be told
+    static int nodeOf(uint64_t physAddr);
+
+    // Restricts the calling thread to the CPUs of a NUMA node.  Does nothing if 'node' is -1
+    static void bindToNode(int node);
+
 protected:
 
     // If this is not null, it contains a pointer to the mapped addresses
@@ -48,4 +78,7 @@ protected:
 
     // This is the size of the address spaces that has been mapped into user-space
     size_t  mappedSize_;
-};
\ No newline at end of file
+
+    // The physical regions that make up the mapped space
+    std::vector<segment_t> segments_;
+};
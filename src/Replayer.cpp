@@ -0,0 +1,341 @@
+//=================================================================================================
+// Replayer.cpp - Implements a class that sends data frames to a consumer at a fixed frame rate
+//
+// Frame 'n' is due at exactly start + n / frameRate.  Deadlines are absolute, so a frame that
+// goes out late doesn't push back the frames that follow it, and the average rate never drifts.
+// The frames themselves are produced by a separate thread into a queue, so the time it takes to
+// build or decompress a frame doesn't show up as jitter unless the producer falls behind.
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Replayer.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// now() - Returns the current time in nanoseconds
+//=================================================================================================
+static uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// sleepUntil() - Sleeps until the specified time (in nanoseconds)
+//=================================================================================================
+static void sleepUntil(uint64_t deadline)
+{
+    struct timespec ts;
+    ts.tv_sec  = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// open() - Opens the destination
+//
+// Passed: destination = "-" for stdout, the name of a FIFO, or the name of a Unix domain socket
+//         frameSize   = The number of bytes in a single data frame
+//=================================================================================================
+void Replayer::open(const char* destination, size_t frameSize)
+{
+    struct stat sb;
+
+    // Make sure we don't already have a destination open
+    close();
+
+    // Save our parameters for future use
+    destination_ = destination;
+    frameSize_   = frameSize;
+    isSocket_    = false;
+
+    // If the consumer goes away, we want to hear about it from write(), not be killed
+    signal(SIGPIPE, SIG_IGN);
+
+    // If we're sending to stdout, the frames get stdout all to themselves and anything else
+    // we print goes to stderr
+    if (strcmp(destination, "-") == 0)
+    {
+        if (isatty(STDOUT_FILENO)) throwRuntime("Refusing to write frames to a terminal");
+        fd_ = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        return;
+    }
+
+    // Find out what sort of thing the destination is
+    if (stat(destination, &sb) != 0) throwRuntime("%s not found", destination);
+
+    // A FIFO is just opened.  This waits for a consumer to open the other end
+    if (S_ISFIFO(sb.st_mode))
+    {
+        fd_ = ::open(destination, O_WRONLY);
+        if (fd_ < 0) throwRuntime("Can't open %s", destination);
+        return;
+    }
+
+    // If it isn't a FIFO, it had better be a socket
+    if (!S_ISSOCK(sb.st_mode)) throwRuntime("%s is not a FIFO or a socket", destination);
+
+    // Build the address of the socket
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(destination) >= sizeof(addr.sun_path)) throwRuntime("%s: name too long", destination);
+    strcpy(addr.sun_path, destination);
+
+    // Connect to the consumer.  A stream socket is most common, but a sequenced-packet socket
+    // gets one message per frame.  close() can change errno, so we hang on to connect()'s
+    int error = 0;
+    for (int type : {SOCK_STREAM, SOCK_SEQPACKET})
+    {
+        fd_ = socket(AF_UNIX, type, 0);
+        if (fd_ < 0) throwRuntime("Can't create socket");
+        if (connect(fd_, (struct sockaddr*)&addr, sizeof(addr)) == 0) break;
+        error = errno;
+        ::close(fd_);
+        fd_ = -1;
+        if (error != EPROTOTYPE) break;
+    }
+
+    // Complain if we couldn't connect
+    if (fd_ < 0) throwRuntime("Can't connect to %s: %s", destination, strerror(error));
+    isSocket_ = true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// openChannel() - Opens a shared-memory frame channel as the destination
+//=================================================================================================
+void Replayer::openChannel(const char* socketName, uint32_t cellsPerFrame, uint32_t framesPerGroup,
+                           uint64_t frameCount, uint32_t slotCount)
+{
+    // Make sure we don't already have a destination open
+    close();
+
+    // Save our parameters for future use
+    destination_ = socketName;
+    frameSize_   = cellsPerFrame;
+
+    // Create the channel and wait for a consumer to attach, so the clock doesn't start early
+    channel_.create(socketName, cellsPerFrame, framesPerGroup, frameCount, slotCount);
+    isChannel_ = true;
+    channel_.waitForConsumer();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// send() - Sends a single frame to the destination
+//=================================================================================================
+void Replayer::send(const uint8_t* frame)
+{
+    size_t length = frameSize_;
+
+    // A channel takes the whole frame at once
+    if (isChannel_)
+    {
+        channel_.writeFrame(frame);
+        return;
+    }
+
+    while (length)
+    {
+        ssize_t rc = isSocket_ ? ::send(fd_, frame, length, MSG_NOSIGNAL) : write(fd_, frame, length);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc < 0 && errno == EPIPE) throwRuntime("Consumer disconnected after %lu frames", framesSent_);
+        if (rc <= 0) throwRuntime("Write to %s failed: %s", destination_, strerror(errno));
+        frame  += rc;
+        length -= rc;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// run() - Sends frames to the destination at the specified frame rate
+//
+// Passed: frameCount = The number of frames to send
+//         frameRate  = Frames per second
+//         lookahead  = The number of frames the producer is allowed to get ahead of the sender
+//         source     = Called (from the producer thread) to fetch each frame
+//
+// A frame has missed its deadline if it hasn't been completely handed to the consumer by the
+// time the next frame is due.  An underrun is when a frame isn't ready by its deadline.
+//=================================================================================================
+void Replayer::run(uint64_t frameCount, double frameRate, uint32_t lookahead, source_t source)
+{
+    mutex              lock;
+    condition_variable frameReady, spaceReady;
+    uint64_t           produced = 0, consumed = 0;
+    bool               stopping = false;
+    exception_ptr      error;
+
+    // Check our parameters
+    if (frameRate <= 0) throwRuntime("Frame rate must be greater than zero");
+    if (lookahead == 0) lookahead = 1;
+
+    // The queue of frames waiting to be sent.  Frame 'n' lives in slot n % lookahead
+    vector<vector<uint8_t>> queue(lookahead, vector<uint8_t>(frameSize_));
+
+    // Nothing has been sent yet
+    framesSent_   = missedDeadlines_ = underruns_ = 0;
+    meanLateness_ = maxLateness_ = jitter_ = 0;
+
+    // The producer fills the queue as fast as the sender empties it
+    thread producer([&]()
+    {
+        try
+        {
+            for (uint64_t n = 0; n < frameCount; ++n)
+            {
+                // Wait for the slot this frame goes into to be free
+                {
+                    unique_lock<mutex> guard(lock);
+                    spaceReady.wait(guard, [&]() {return stopping || n - consumed < lookahead;});
+                    if (stopping) return;
+                }
+
+                // Fetch the frame and tell the sender it's ready
+                source(n, queue[n % lookahead].data());
+                lock_guard<mutex> guard(lock);
+                produced = n + 1;
+                frameReady.notify_one();
+            }
+        }
+        catch (...)
+        {
+            lock_guard<mutex> guard(lock);
+            error    = current_exception();
+            stopping = true;
+            frameReady.notify_one();
+        }
+    });
+
+    // Stops the producer thread
+    auto stopProducer = [&]()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+            spaceReady.notify_one();
+        }
+        producer.join();
+    };
+
+    try
+    {
+        // Let the producer fill the queue before the clock starts
+        {
+            unique_lock<mutex> guard(lock);
+            uint64_t prefill = frameCount < lookahead ? frameCount : lookahead;
+            frameReady.wait(guard, [&]() {return stopping || produced >= prefill;});
+        }
+
+        double   period = 1e9 / frameRate;
+        double   sum = 0, sumOfSquares = 0;
+        uint64_t start  = now();
+
+        for (uint64_t n = 0; n < frameCount; ++n)
+        {
+            // Wait until this frame is due
+            uint64_t deadline = start + (uint64_t)(n * period);
+            sleepUntil(deadline);
+
+            // If the producer hasn't caught up, wait for it
+            {
+                unique_lock<mutex> guard(lock);
+                if (produced <= n && !stopping)
+                {
+                    ++underruns_;
+                    frameReady.wait(guard, [&]() {return stopping || produced > n;});
+                }
+                if (produced <= n) break;
+            }
+
+            // Note how late we are, and send the frame
+            double lateness = (double)(now() - deadline);
+            send(queue[n % lookahead].data());
+            if (now() > deadline + period) ++missedDeadlines_;
+
+            // Keep track of the statistics
+            ++framesSent_;
+            sum          += lateness;
+            sumOfSquares += lateness * lateness;
+            if (lateness > maxLateness_) maxLateness_ = lateness;
+
+            // The slot is free for the producer to re-use
+            lock_guard<mutex> guard(lock);
+            consumed = n + 1;
+            spaceReady.notify_one();
+        }
+
+        // Compute the average lateness and the jitter
+        if (framesSent_)
+        {
+            meanLateness_ = sum / framesSent_;
+            double variance = sumOfSquares / framesSent_ - meanLateness_ * meanLateness_;
+            jitter_ = variance > 0 ? sqrt(variance) : 0;
+        }
+    }
+    catch (...)
+    {
+        stopProducer();
+        throw;
+    }
+
+    // Wait for the producer to finish, and pass along any error it ran into
+    stopProducer();
+    if (error) rethrow_exception(error);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Closes the destination
+//=================================================================================================
+void Replayer::close()
+{
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+
+    if (isChannel_) channel_.close();
+    isChannel_ = false;
+}
+//=================================================================================================
@@ -0,0 +1,72 @@
+//=================================================================================================
+// Replayer.h - Defines a class that sends data frames to a consumer at a fixed frame rate
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <vector>
+#include "FrameChannel.h"
+
+class Replayer
+{
+public:
+
+    // This is called to fill in the contents of frame number 'frameNumber'
+    typedef std::function<void(uint64_t frameNumber, uint8_t* frame)> source_t;
+
+    // Constructor
+    Replayer() {fd_ = -1; isChannel_ = false;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    Replayer (const Replayer&) = delete;
+    Replayer& operator= (const Replayer&) = delete;
+
+    // Destructor, closes the destination
+    ~Replayer() {close();}
+
+    // Opens the destination, which is "-" (stdout), a FIFO, or a Unix domain socket
+    void    open(const char* destination, size_t frameSize);
+
+    // Opens a shared-memory frame channel as the destination.  Consumers attach to the channel
+    // through the Unix domain socket 'socketName'
+    void    openChannel(const char* socketName, uint32_t cellsPerFrame, uint32_t framesPerGroup,
+                        uint64_t frameCount, uint32_t slotCount);
+
+    // Sends 'frameCount' frames at 'frameRate' frames per second.  The frames are fetched from
+    // 'source' by a separate thread that stays up to 'lookahead' frames ahead of the sender
+    void    run(uint64_t frameCount, double frameRate, uint32_t lookahead, source_t source);
+
+    // Closes the destination
+    void    close();
+
+    // Statistics about the last run.  "Lateness" is how long after its deadline each frame
+    // was sent, and "jitter" is the standard deviation of the lateness
+    uint64_t framesSent()      {return framesSent_;}
+    uint64_t missedDeadlines() {return missedDeadlines_;}
+    uint64_t underruns()       {return underruns_;}
+    double   meanLateness()    {return meanLateness_;}
+    double   maxLateness()     {return maxLateness_;}
+    double   jitter()          {return jitter_;}
+
+protected:
+
+    // Sends a single frame to the destination
+    void    send(const uint8_t* frame);
+
+    // The file descriptor and name of the destination, and whether it's a socket
+    int     fd_;
+    const char* destination_;
+    bool    isSocket_;
+
+    // If the destination is a shared-memory frame channel, this is it
+    bool         isChannel_;
+    FrameChannel channel_;
+
+    // The number of bytes in a frame
+    size_t  frameSize_;
+
+    // Statistics about the last run.  Times are in nanoseconds
+    uint64_t framesSent_, missedDeadlines_, underruns_;
+    double   meanLateness_, maxLateness_, jitter_;
+};
@@ -0,0 +1,145 @@
+//=================================================================================================
+// RingLayout.cpp - Implements a class that works out where each frame lives in an aligned ring
+//                  buffer image, and reads and writes the layout table that describes it
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdexcept>
+#include <vector>
+#include "RingLayout.h"
+#include "crc32c.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// roundUp() - Rounds 'value' up to a multiple of 'alignment', which is a power of two (or 0)
+//=================================================================================================
+static uint64_t roundUp(uint64_t value, uint64_t alignment)
+{
+    if (alignment == 0) return value;
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Works out the layout of the frames
+//=================================================================================================
+void RingLayout::create(uint32_t cellsPerFrame, uint32_t framesPerGroup, uint64_t frameCount,
+                        uint64_t alignment, bool alignFrames)
+{
+    // Check our parameters
+    if (alignment & (alignment - 1)) throwRuntime("Ring alignment must be a power of two");
+    if (framesPerGroup == 0) throwRuntime("A frame group can't be empty");
+
+    // Describe the layout
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, LAYOUT_MAGIC, sizeof(header_.magic));
+    header_.headerSize     = sizeof(header_);
+    header_.cellsPerFrame  = cellsPerFrame;
+    header_.framesPerGroup = framesPerGroup;
+    header_.alignFrames    = alignFrames;
+    header_.alignment      = alignment;
+    header_.frameCount     = frameCount;
+
+    // Work out how far apart the frames and the frame groups are
+    header_.frameStride = alignFrames ? roundUp(cellsPerFrame, alignment) : cellsPerFrame;
+    header_.groupStride = roundUp(header_.frameStride * framesPerGroup, alignment);
+
+    // The image is padded out to a whole number of frame groups, unless there's no padding
+    uint64_t groupCount = (frameCount + framesPerGroup - 1) / framesPerGroup;
+    header_.imageSize = isPacked() ? frameCount * cellsPerFrame : groupCount * header_.groupStride;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// save() - Writes the layout table
+//=================================================================================================
+void RingLayout::save(const char* filename)
+{
+    vector<layout_descriptor_t> table;
+
+    // If frames abut one another within a frame group, the whole group is a single transfer
+    bool     perFrame  = header_.frameStride != header_.cellsPerFrame;
+    uint64_t frameSize = header_.cellsPerFrame;
+    for (uint64_t n = 0; n < header_.frameCount; n += perFrame ? 1 : header_.framesPerGroup)
+    {
+        uint64_t frames = perFrame ? 1 : header_.framesPerGroup;
+        if (n + frames > header_.frameCount) frames = header_.frameCount - n;
+        table.push_back({frameOffset(n), frames * frameSize});
+    }
+
+    // Fill in the rest of the header
+    header_.descriptorCount = table.size();
+    header_.descriptorsCrc  = crc32c(0, table.data(), table.size() * sizeof(layout_descriptor_t));
+    header_.headerCrc       = crc32c(0, &header_, offsetof(layout_header_t, headerCrc));
+
+    // And write the file
+    int fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) throwRuntime("Can't create %s", filename);
+    size_t length = table.size() * sizeof(layout_descriptor_t);
+    bool ok = write(fd, &header_, sizeof(header_)) == sizeof(header_)
+           && write(fd, table.data(), length) == (ssize_t)length;
+    ::close(fd);
+    if (!ok) throwRuntime("Write to %s failed: %s", filename, strerror(errno));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// load() - Reads a layout table, and makes sure it's intact
+//
+// Returns: false if the file doesn't exist
+//=================================================================================================
+bool RingLayout::load(const char* filename)
+{
+    layout_header_t h;
+
+    // If there's no layout table, the caller will assume the frames are packed
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    // Fetch and sanity check the header
+    bool ok = read(fd, &h, sizeof(h)) == sizeof(h)
+           && memcmp(h.magic, LAYOUT_MAGIC, sizeof(h.magic)) == 0
+           && h.headerCrc == crc32c(0, &h, offsetof(layout_header_t, headerCrc))
+           && h.framesPerGroup > 0 && h.frameStride >= h.cellsPerFrame
+           && h.groupStride >= h.frameStride * h.framesPerGroup;
+
+    // Make sure the descriptor table is intact too
+    if (ok)
+    {
+        vector<layout_descriptor_t> table(h.descriptorCount);
+        size_t length = table.size() * sizeof(layout_descriptor_t);
+        ok = pread(fd, table.data(), length, h.headerSize) == (ssize_t)length
+          && crc32c(0, table.data(), length) == h.descriptorsCrc;
+    }
+    ::close(fd);
+    if (!ok) throwRuntime("%s is corrupt", filename);
+
+    header_ = h;
+    return true;
+}
+//=================================================================================================
@@ -0,0 +1,54 @@
+//=================================================================================================
+// RingLayout.h - Defines a class that works out where each frame lives in an aligned ring
+//                buffer image, and reads and writes the layout table that describes it
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "layout.h"
+
+class RingLayout
+{
+public:
+
+    // Constructor
+    RingLayout() {create(1, 1, 0, 0, false);}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    RingLayout (const RingLayout&) = delete;
+    RingLayout& operator= (const RingLayout&) = delete;
+
+    // Works out the layout of 'frameCount' frames.  Each frame group (or each frame, if
+    // 'alignFrames' is true) starts on a multiple of 'alignment' bytes, which must be a power of
+    // two.  An alignment of 0 packs the frames back to back
+    void    create(uint32_t cellsPerFrame, uint32_t framesPerGroup, uint64_t frameCount,
+                   uint64_t alignment, bool alignFrames);
+
+    // Writes the layout table
+    void    save(const char* filename);
+
+    // Reads a layout table.  Returns false if there isn't one
+    bool    load(const char* filename);
+
+    // Returns the offset of frame 'frameNumber' within the image
+    uint64_t frameOffset(uint64_t frameNumber)
+    {
+        return (frameNumber / header_.framesPerGroup) * header_.groupStride
+             + (frameNumber % header_.framesPerGroup) * header_.frameStride;
+    }
+
+    // Returns true if the frames are back to back, with no padding at all
+    bool     isPacked() {return header_.groupStride == (uint64_t)header_.framesPerGroup * header_.cellsPerFrame;}
+
+    // Accessors
+    const layout_header_t& header() {return header_;}
+    uint64_t frameStride()    {return header_.frameStride;}
+    uint64_t groupStride()    {return header_.groupStride;}
+    uint32_t framesPerGroup() {return header_.framesPerGroup;}
+    uint64_t imageSize()      {return header_.imageSize;}
+
+protected:
+
+    // Describes the layout
+    layout_header_t header_;
+};
@@ -0,0 +1,257 @@
+//=================================================================================================
+// StreamFile.cpp - Implements a class that streams data frames to stdout or to a FIFO
+//
+// When the stream is a pipe, frames are handed to the kernel with vmsplice(), which places
+// references to our buffer pages in the pipe instead of copying the data.  That means a buffer
+// can't be re-used until the consumer has read it out of the pipe.  A pipe holds at most one
+// page per slot, so once we've spliced more pages than the pipe has slots, every page before
+// them must have been consumed.  The buffer pool is sized with that in mind: by the time we
+// come back around to a buffer, it is guaranteed to be free.
+//
+// When the pipe is full, vmsplice() (or write()) blocks, which stalls the frame builder until
+// the consumer catches up.  Memory use never grows beyond the buffer pool.
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <stdexcept>
+#include "StreamFile.h"
+using namespace std;
+
+// The size of a page, and the size we'd like each buffer in the pool to be
+static const size_t PAGE_SIZE   = 4096;
+static const size_t BUFFER_SIZE = 0x40000;
+
+// The pipe size we ask for.  The kernel may not let us have it, and that's fine
+static const int    PIPE_SIZE   = 0x100000;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// isStream() - Returns true if the filename refers to stdout or to a FIFO
+//=================================================================================================
+bool StreamFile::isStream(const char* filename)
+{
+    struct stat sb;
+
+    // "-" is the conventional name for stdout
+    if (strcmp(filename, "-") == 0) return true;
+
+    // Otherwise, it's a stream if it's a FIFO that already exists
+    return stat(filename, &sb) == 0 && S_ISFIFO(sb.st_mode);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Opens the stream and allocates the buffer pool
+//
+// Passed: filename  = "-" for stdout, or the name of a FIFO
+//         frameSize = The number of bytes in a single data frame
+//=================================================================================================
+void StreamFile::create(const char* filename, size_t frameSize)
+{
+    struct stat sb;
+
+    // Make sure we don't already have a stream open
+    close();
+
+    // If we're streaming to stdout, the frames get stdout all to themselves and anything else
+    // we print goes to stderr.  When stdout isn't a terminal it's fully buffered, so nothing
+    // we've printed so far has reached it yet
+    if (strcmp(filename, "-") == 0)
+    {
+        if (isatty(STDOUT_FILENO)) throwRuntime("Refusing to write frames to a terminal");
+        fd_ = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    // Otherwise, open the FIFO.  This waits for a consumer to open the other end
+    else
+    {
+        fd_ = ::open(filename, O_WRONLY);
+    }
+
+    // Complain if we couldn't open the stream
+    if (fd_ < 0) throwRuntime("Can't open %s", filename);
+
+    // Save our parameters for future use
+    filename_  = filename;
+    frameSize_ = frameSize;
+
+    // Each buffer in the pool holds as many whole frames as will fit in BUFFER_SIZE
+    framesPerBuffer_ = BUFFER_SIZE / frameSize;
+    if (framesPerBuffer_ == 0) framesPerBuffer_ = 1;
+    size_t bufferSize = framesPerBuffer_ * frameSize;
+
+    // If we're writing to a pipe, we can hand it our pages rather than copies of them
+    zeroCopy_ = fstat(fd_, &sb) == 0 && S_ISFIFO(sb.st_mode);
+
+    // Work out how many buffers we need.  With vmsplice(), enough pages to fill every slot in
+    // the pipe have to be in flight before we can re-use a buffer
+    uint32_t poolSize = 2;
+    if (zeroCopy_)
+    {
+        fcntl(fd_, F_SETPIPE_SZ, PIPE_SIZE);
+        int pipeSize = fcntl(fd_, F_GETPIPE_SZ);
+        if (pipeSize <= 0) pipeSize = PIPE_SIZE;
+        size_t slots          = pipeSize / PAGE_SIZE;
+        size_t pagesPerBuffer = bufferSize / PAGE_SIZE;
+        if (pagesPerBuffer == 0) pagesPerBuffer = 1;
+        poolSize = (slots + pagesPerBuffer - 1) / pagesPerBuffer + 1;
+    }
+
+    // Allocate the page-aligned buffers
+    for (uint32_t i = 0; i < poolSize; ++i)
+    {
+        void* ptr;
+        if (posix_memalign(&ptr, PAGE_SIZE, bufferSize) != 0) throwRuntime("Out of memory");
+        pool_.push_back((uint8_t*)ptr);
+    }
+
+    // Nothing has been written yet
+    current_        = 0;
+    framesInBuffer_ = 0;
+    bytesWritten_   = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFrame() - Adds a frame to the current buffer, and sends the buffer when it's full
+//=================================================================================================
+void StreamFile::writeFrame(const uint8_t* frame)
+{
+    memcpy(pool_[current_] + framesInBuffer_ * frameSize_, frame, frameSize_);
+    if (++framesInBuffer_ == framesPerBuffer_) flush();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeAll() - Writes a block of data to the stream, retrying until all of it has been written
+//=================================================================================================
+void StreamFile::writeAll(const uint8_t* data, size_t length)
+{
+    while (length)
+    {
+        ssize_t rc = write(fd_, data, length);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) throwRuntime("Write to %s failed: %s", filename_, strerror(errno));
+        data   += rc;
+        length -= rc;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// flush() - Sends the frames in the current buffer and moves on to the next buffer in the pool
+//=================================================================================================
+void StreamFile::flush()
+{
+    if (framesInBuffer_ == 0) return;
+
+    struct iovec iov;
+    iov.iov_base = pool_[current_];
+    iov.iov_len  = framesInBuffer_ * frameSize_;
+    bytesWritten_ += iov.iov_len;
+
+    // Hand the pages to the pipe.  vmsplice() may accept less than we offered
+    while (zeroCopy_ && iov.iov_len)
+    {
+        ssize_t rc = vmsplice(fd_, &iov, 1, 0);
+        if (rc < 0 && errno == EINTR) continue;
+
+        // If the kernel won't splice from this pipe, fall back to copying
+        if (rc < 0 && (errno == EINVAL || errno == ENOSYS) && iov.iov_len == framesInBuffer_ * frameSize_)
+        {
+            zeroCopy_ = false;
+            break;
+        }
+
+        if (rc <= 0) throwRuntime("Write to %s failed: %s", filename_, strerror(errno));
+        iov.iov_base = (uint8_t*)iov.iov_base + rc;
+        iov.iov_len -= rc;
+    }
+
+    // If we're not splicing, just write the data
+    if (!zeroCopy_) writeAll((const uint8_t*)iov.iov_base, iov.iov_len);
+
+    // Move on to the next buffer in the pool
+    current_ = (current_ + 1) % pool_.size();
+    framesInBuffer_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// waitForDrain() - Waits for the consumer to read everything in the pipe.   Until it does, the 
+//                  pipe still refers to pages in our buffers, so they can't be freed.  If the 
+//                  consumer goes away, the pipe's contents are discarded and we stop waiting.
+//=================================================================================================
+void StreamFile::waitForDrain()
+{
+    int unread;
+    struct pollfd pfd = {fd_, POLLOUT, 0};
+
+    while (ioctl(fd_, FIONREAD, &unread) == 0 && unread > 0)
+    {
+        if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLERR)) break;
+        usleep(1000);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Sends any partial buffer and closes the stream
+//=================================================================================================
+void StreamFile::close()
+{
+    if (fd_ >= 0)
+    {
+        flush();
+        if (zeroCopy_) waitForDrain();
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    for (auto ptr : pool_) free(ptr);
+    pool_.clear();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// Destructor() - Closes the stream without sending anything more, and frees the buffers
+//=================================================================================================
+StreamFile::~StreamFile()
+{
+    if (fd_ >= 0) ::close(fd_);
+    for (auto ptr : pool_) free(ptr);
+}
+//=================================================================================================
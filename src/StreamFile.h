@@ -0,0 +1,69 @@
+//=================================================================================================
+// StreamFile.h - Defines a class that streams data frames to stdout or to a FIFO
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "FrameSink.h"
+
+class StreamFile : public FrameSink
+{
+public:
+
+    // Constructor
+    StreamFile() {fd_ = -1;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    StreamFile (const StreamFile&) = delete;
+    StreamFile& operator= (const StreamFile&) = delete;
+
+    // Destructor, frees the buffers and closes the stream
+    ~StreamFile();
+
+    // Returns true if 'filename' is "-" (meaning stdout) or is the name of a FIFO
+    static bool isStream(const char* filename);
+
+    // Opens the stream.  Opening a FIFO blocks until a reader opens the other end.  Streaming
+    // to stdout redirects anything else the program prints to stderr
+    void    create(const char* filename, size_t frameSize);
+
+    // Call this to append a single data frame to the stream.  This blocks while the consumer
+    // is behind
+    void    writeFrame(const uint8_t* frame);
+
+    // Sends any partially filled buffer and closes the stream
+    void    close();
+
+    // Returns the number of bytes sent, and whether they were sent without being copied
+    uint64_t bytesWritten() {return bytesWritten_;}
+    bool     isZeroCopy()   {return zeroCopy_;}
+
+protected:
+
+    // Sends the current buffer and moves on to the next buffer in the pool
+    void    flush();
+
+    // Waits for the consumer to read everything we've spliced into the pipe
+    void    waitForDrain();
+
+    // Sends a block of data with write()
+    void    writeAll(const uint8_t* data, size_t length);
+
+    // The file descriptor and name of the stream
+    int     fd_;
+    const char* filename_;
+
+    // The number of bytes in a frame, and the number of frames in each buffer
+    size_t  frameSize_, framesPerBuffer_;
+
+    // A pool of page-aligned buffers, the one being filled, and how many frames are in it
+    std::vector<uint8_t*> pool_;
+    uint32_t current_, framesInBuffer_;
+
+    // True if frames are being handed to the pipe with vmsplice() rather than copied
+    bool    zeroCopy_;
+
+    // Statistics for the report at the end of a run
+    uint64_t bytesWritten_;
+};
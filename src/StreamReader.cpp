@@ -0,0 +1,179 @@
+//=================================================================================================
+// StreamReader.cpp - Implements a class that reads a stream with a thread of its own
+//
+// The reader thread fills the two buffers in turn.  A full buffer belongs to the caller until
+// the caller moves on to the next one, at which point it's handed back to be refilled.  The
+// reader thread waits for the stream with poll(), so that stop() never has to wait for a
+// producer that has gone quiet.
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdexcept>
+#include "StreamReader.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// start() - Allocates the buffers and starts the reader thread
+//=================================================================================================
+void StreamReader::start(int fd, size_t blockSize)
+{
+    // Make sure we're not already reading something
+    stop();
+
+    fd_        = fd;
+    blockSize_ = blockSize;
+    for (int i = 0; i < 2; ++i)
+    {
+        buffer_[i].reset(new uint8_t[blockSize]);
+        length_[i] = 0;
+        full_[i]   = false;
+    }
+    current_   = -1;
+    index_     = 0;
+    position_  = 0;
+    stopping_  = false;
+    error_     = 0;
+    bytesRead_ = 0;
+
+    thread_ = thread(&StreamReader::readBlocks, this);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// readBlocks() - Fills the buffers in turn.  A buffer that's less than full (perhaps empty)
+//                marks the end of the stream
+//=================================================================================================
+void StreamReader::readBlocks()
+{
+    for (int i = 0;; i ^= 1)
+    {
+        // Wait for the caller to hand this buffer back
+        {
+            unique_lock<mutex> lock(mutex_);
+            cv_.wait(lock, [&]{return !full_[i] || stopping_;});
+            if (stopping_) return;
+        }
+
+        // Fill it
+        size_t length = 0;
+        int    error  = 0;
+        while (length < blockSize_)
+        {
+            pollfd pfd = {fd_, POLLIN, 0};
+            int rc = poll(&pfd, 1, 100);
+            if (stopping_) return;
+            if (rc == 0 || (rc < 0 && errno == EINTR)) continue;
+
+            ssize_t count = ::read(fd_, buffer_[i].get() + length, blockSize_ - length);
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0) error = errno;
+            if (count <= 0) break;
+            length += count;
+        }
+
+        // And hand it to the caller
+        {
+            lock_guard<mutex> lock(mutex_);
+            length_[i] = length;
+            full_[i]   = true;
+            error_     = error;
+        }
+        cv_.notify_all();
+
+        // A short block means the stream has ended
+        if (length < blockSize_) return;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// next() - Returns the next part of the stream
+//=================================================================================================
+size_t StreamReader::next(uint8_t** data, size_t maxLength)
+{
+    // If we've finished with the current buffer, hand it back and wait for the next one
+    if (current_ < 0 || position_ == length_[current_])
+    {
+        // A short buffer was the last one
+        if (current_ >= 0 && length_[current_] < blockSize_) return 0;
+
+        unique_lock<mutex> lock(mutex_);
+        if (current_ >= 0) full_[current_] = false;
+        cv_.notify_all();
+        cv_.wait(lock, [&]{return full_[index_];});
+        if (error_) throwRuntime("Read from stream failed: %s", strerror(error_));
+        current_  = index_;
+        index_   ^= 1;
+        position_ = 0;
+        if (length_[current_] == 0) return 0;
+    }
+
+    // Hand the caller as much of it as they asked for
+    size_t length = min(maxLength, length_[current_] - position_);
+    *data = buffer_[current_].get() + position_;
+    position_  += length;
+    bytesRead_ += length;
+    return length;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// read() - Reads exactly 'length' bytes into 'dst'
+//=================================================================================================
+bool StreamReader::read(void* dst, size_t length)
+{
+    uint8_t* data;
+
+    while (length)
+    {
+        size_t count = next(&data, length);
+        if (count == 0) return false;
+        memcpy(dst, data, count);
+        dst     = (uint8_t*)dst + count;
+        length -= count;
+    }
+
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stop() - Tells the reader thread to give up, and waits for it
+//=================================================================================================
+void StreamReader::stop()
+{
+    if (!thread_.joinable()) return;
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+//=================================================================================================
@@ -0,0 +1,73 @@
+//=================================================================================================
+// StreamReader.h - Defines a class that reads a stream (stdin or a FIFO) with a thread of its
+//                  own, so the next block of data arrives while the caller copies the last one
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+class StreamReader
+{
+public:
+
+    // Constructor
+    StreamReader() {fd_ = -1;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    StreamReader (const StreamReader&) = delete;
+    StreamReader& operator= (const StreamReader&) = delete;
+
+    // Destructor, stops the reader thread
+    ~StreamReader() {stop();}
+
+    // Starts reading 'fd' into a pair of buffers of 'blockSize' bytes each
+    void    start(int fd, size_t blockSize);
+
+    // Points 'data' at the next (up to) 'maxLength' bytes of the stream, and returns how many
+    // bytes there are.  They stay valid until the next call.  Returns 0 at the end of the stream
+    size_t  next(uint8_t** data, size_t maxLength);
+
+    // Reads exactly 'length' bytes into 'dst'.  Returns false if the stream ended first
+    bool    read(void* dst, size_t length);
+
+    // Stops the reader thread
+    void    stop();
+
+    // Returns the number of bytes the caller has been handed so far
+    uint64_t bytesRead() {return bytesRead_;}
+
+protected:
+
+    // The reader thread: fills the buffers in turn until the stream ends
+    void    readBlocks();
+
+    // The stream, and the size of each buffer
+    int     fd_;
+    size_t  blockSize_;
+
+    // The two buffers, how much data is in each, and whether each is waiting for the caller
+    std::unique_ptr<uint8_t[]> buffer_[2];
+    size_t  length_[2];
+    bool    full_[2];
+
+    // The buffer the caller is working through (or -1), and how far through it they are
+    int     current_, index_;
+    size_t  position_;
+
+    // Set by stop() to tell the reader thread to give up.  'error_' is the errno of a failed read
+    std::atomic<bool> stopping_;
+    int     error_;
+
+    // The number of bytes handed to the caller
+    uint64_t bytesRead_;
+
+    // Hands the buffers back and forth between the reader thread and the caller
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    std::thread             thread_;
+};
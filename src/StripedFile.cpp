@@ -0,0 +1,412 @@
+//=================================================================================================
+// StripedFile.cpp - Implements a class that spreads frame groups across several output files
+//
+// Each file is an ordinary OutputFile.  The files are written by a set of writer threads, and
+// file 'f' is always written by writer f % writerCount, so when the files live on different
+// drives, every drive has a writer of its own and they are all kept busy at once.
+//
+// The caller's frames are gathered into batches of consecutive frames from the same frame group.
+// Each writer has a small pool of batches, so the caller only waits when a drive falls behind,
+// and the memory we use doesn't depend on how big a frame group is.
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdexcept>
+#include <algorithm>
+#include "StripedFile.h"
+#include "crc32c.h"
+using namespace std;
+
+// The number of batches each writer has, and the size of a batch
+static const uint32_t BUFFERS_PER_WRITER = 3;
+static const size_t   BATCH_SIZE         = 8 * 1024 * 1024;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Gets ready to write the files and starts the writer threads
+//
+// Passed: filename      = The name of the manifest, which is written when the file is closed
+//         paths         = The names the files are based on
+//         groupsPerFile = 0 to stripe frame groups across 'paths', otherwise the number of
+//                         frame groups in each file
+//         manifest      = Describes the run
+//         dedup         = If true, each file de-duplicates its own frames
+//         header        = If not null, every file is a container, and this is its header
+//=================================================================================================
+void StripedFile::create(const char* filename, const vector<string>& paths,
+                         uint32_t groupsPerFile, const stripe_manifest_t& manifest, bool dedup,
+                         const container_header_t* header)
+{
+    uint32_t writerCount = paths.size();
+
+    // Make sure we don't already have a file open
+    close();
+
+    // Save our parameters for future use
+    filename_       = filename;
+    paths_          = paths;
+    manifest_       = manifest;
+    dedup_          = dedup;
+    isContainer_    = (header != nullptr);
+    if (isContainer_) header_ = *header;
+    frameSize_      = manifest.cellsPerFrame;
+    framesWritten_  = 0;
+    expectedFrames_ = 0;
+    writeBehind_    = 0;
+
+    // Nothing has been written yet
+    manifest_.groupsPerFile = groupsPerFile;
+    manifest_.frameCount    = 0;
+    manifest_.fileCount     = 0;
+
+    // A batch never spans frame groups, and always holds at least one frame
+    framesPerBatch_ = BATCH_SIZE / frameSize_;
+    if (framesPerBatch_ > manifest.framesPerGroup) framesPerBatch_ = manifest.framesPerGroup;
+    if (framesPerBatch_ == 0) framesPerBatch_ = 1;
+
+    // When a run is split into many files, each path gets as many writers as we have cores to
+    // share between them.  File 'f' is on path f % paths.size(), so every writer's files are
+    // on the same path
+    if (groupsPerFile)
+    {
+        uint32_t cores = thread::hardware_concurrency();
+        if (cores > writerCount) writerCount *= cores / writerCount;
+    }
+
+    // Start the writer threads
+    for (uint32_t i = 0; i < writerCount; ++i)
+    {
+        writers_.emplace_back(new writer_t);
+        writer_t* w = writers_.back().get();
+        w->buffers  = 0;
+        w->stopping = false;
+        w->isOpen   = false;
+        w->thread   = thread([this, w]() {writerThread(*w);});
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// fileOf() - Returns the number of the file that a frame group belongs in
+//=================================================================================================
+uint32_t StripedFile::fileOf(uint64_t group)
+{
+    if (manifest_.groupsPerFile) return group / manifest_.groupsPerFile;
+    return group % paths_.size();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// openFile() - Creates file number 'index' for a writer
+//=================================================================================================
+void StripedFile::openFile(writer_t& writer, uint32_t index)
+{
+    char     fullPath[PATH_MAX], suffix[16];
+    uint32_t fpg = manifest_.framesPerGroup;
+    uint64_t groupCount = (expectedFrames_ + fpg - 1) / fpg;
+    uint64_t firstGroup, groups;
+
+    // Figure out which frame groups go in this file
+    if (manifest_.groupsPerFile)
+    {
+        firstGroup = (uint64_t)index * manifest_.groupsPerFile;
+        groups     = manifest_.groupsPerFile;
+        if (firstGroup + groups > groupCount) groups = groupCount > firstGroup ? groupCount - firstGroup : 0;
+        sprintf(suffix, ".%04u", index);
+        writer.path = paths_[index % paths_.size()] + suffix;
+    }
+    else
+    {
+        firstGroup  = index;
+        groups      = groupCount / paths_.size() + (index < groupCount % paths_.size() ? 1 : 0);
+        writer.path = paths_[index];
+    }
+
+    // Create the file
+    writer.file.create(writer.path.c_str(), frameSize_, dedup_, isContainer_ ? &header_ : nullptr);
+    writer.file.preallocate(groups * fpg);
+    writer.file.setWriteBehind(writeBehind_);
+    writer.isOpen    = true;
+    writer.fileIndex = index;
+
+    // The manifest records the full path to each file, so it doesn't matter where the reader
+    // is run from
+    writer.fullPath = realpath(writer.path.c_str(), fullPath) ? fullPath : writer.path;
+
+    // Nothing is in the file yet
+    memset(&writer.entry, 0, sizeof(writer.entry));
+    writer.entry.firstFrame = firstGroup * fpg;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// finishFile() - Closes the file a writer is writing, and remembers what's in it
+//=================================================================================================
+void StripedFile::finishFile(writer_t& writer)
+{
+    if (!writer.isOpen) return;
+    writer.isOpen = false;
+    writer.file.close();
+    writer.written.push_back({writer.fileIndex, writer.fullPath, writer.entry});
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writerThread() - Writes batches to files until we're told to stop
+//=================================================================================================
+void StripedFile::writerThread(writer_t& writer)
+{
+    while (true)
+    {
+        unique_lock<mutex> guard(writer.lock);
+
+        // Wait for a batch to write
+        writer.workAvailable.wait(guard, [&]() {return writer.stopping || !writer.queue.empty();});
+
+        // If there's nothing to do, it's because we've been told to stop
+        if (writer.queue.empty()) return;
+
+        // Take the oldest batch
+        batch_t* batch = writer.queue.front();
+        writer.queue.pop_front();
+        guard.unlock();
+
+        // Write its frames, moving on to a new file if it belongs in one.  If that fails, we keep
+        // taking batches (so the caller never waits forever) but we don't write them
+        if (!writer.error) try
+        {
+            if (batch->file == UINT32_MAX)
+                finishFile(writer);
+            else if (!writer.isOpen || batch->file != writer.fileIndex)
+            {
+                finishFile(writer);
+                openFile(writer, batch->file);
+            }
+
+            for (uint32_t i = 0; i < batch->frames; ++i)
+            {
+                const uint8_t* frame = batch->data.data() + i * frameSize_;
+                writer.entry.crc = crc32c(writer.entry.crc, frame, frameSize_);
+                writer.file.writeFrame(frame);
+            }
+            writer.entry.frameCount += batch->frames;
+        }
+        catch (...)
+        {
+            writer.error = current_exception();
+        }
+
+        // And the batch is free for the caller to re-use
+        guard.lock();
+        writer.spare.push_back(batch);
+        writer.spaceAvailable.notify_one();
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// startBatch() - Fetches an empty batch from the writer that the next frame goes to
+//=================================================================================================
+void StripedFile::startBatch()
+{
+    uint32_t file   = fileOf(framesWritten_ / manifest_.framesPerGroup);
+    auto&    writer = *writers_[file % writers_.size()];
+    unique_lock<mutex> guard(writer.lock);
+
+    // If the writer can have another batch, create it.  Otherwise wait for one to be free
+    if (writer.spare.empty() && writer.buffers < BUFFERS_PER_WRITER)
+    {
+        batch_t* batch = new batch_t;
+        batch->data.resize(framesPerBatch_ * frameSize_);
+        writer.spare.push_back(batch);
+        ++writer.buffers;
+    }
+    writer.spaceAvailable.wait(guard, [&]() {return !writer.spare.empty();});
+
+    // If this writer has failed, there's no point going on
+    if (writer.error) rethrow_exception(writer.error);
+
+    current_ = writer.spare.front();
+    writer.spare.pop_front();
+    current_->frames = 0;
+    current_->file   = file;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// submitBatch() - Hands the current batch to the writer for its file
+//=================================================================================================
+void StripedFile::submitBatch()
+{
+    auto& writer = *writers_[current_->file % writers_.size()];
+    {
+        lock_guard<mutex> guard(writer.lock);
+        writer.queue.push_back(current_);
+        writer.workAvailable.notify_one();
+    }
+
+    current_ = nullptr;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeFrame() - Appends a frame to the current batch, and sends the batch on its way once it's
+//                full or the frame group is complete
+//=================================================================================================
+void StripedFile::writeFrame(const uint8_t* frame)
+{
+    if (current_ == nullptr) startBatch();
+
+    memcpy(current_->data.data() + current_->frames * frameSize_, frame, frameSize_);
+    ++current_->frames;
+    ++framesWritten_;
+
+    if (current_->frames == framesPerBatch_ || framesWritten_ % manifest_.framesPerGroup == 0)
+    {
+        submitBatch();
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stopThreads() - Tells the writer threads to finish what they have and quit, then frees the
+//                 batches
+//
+// Returns: The first error that any of the writers ran into
+//=================================================================================================
+exception_ptr StripedFile::stopThreads(bool finish)
+{
+    exception_ptr error;
+
+    // A batch for file UINT32_MAX tells a writer to close the file it's writing
+    for (auto& writer : writers_)
+    {
+        lock_guard<mutex> guard(writer->lock);
+        if (finish && writer->thread.joinable())
+        {
+            batch_t* batch = new batch_t;
+            batch->frames  = 0;
+            batch->file    = UINT32_MAX;
+            writer->queue.push_back(batch);
+        }
+        writer->stopping = true;
+        writer->workAvailable.notify_one();
+    }
+
+    for (auto& writer : writers_)
+    {
+        if (writer->thread.joinable()) writer->thread.join();
+        if (writer->error && !error) error = writer->error;
+        for (auto batch : writer->spare) delete batch;
+        for (auto batch : writer->queue) delete batch;
+        writer->spare.clear();
+        writer->queue.clear();
+    }
+
+    delete current_;
+    current_ = nullptr;
+    return error;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// close() - Writes any partial batch, closes every file, and writes the manifest
+//=================================================================================================
+void StripedFile::close()
+{
+    // If the file isn't open, there's nothing to do
+    if (writers_.empty()) return;
+
+    // The last batch may be a partial one
+    if (current_ && current_->frames) submitBatch();
+
+    // Wait for every batch to be written and every file to be closed, and complain if any of
+    // them couldn't be
+    exception_ptr error = stopThreads(true);
+    if (error)
+    {
+        writers_.clear();
+        rethrow_exception(error);
+    }
+
+    // Gather up what went into every file, in file order
+    vector<written_t> files;
+    for (auto& writer : writers_)
+    {
+        files.insert(files.end(), writer->written.begin(), writer->written.end());
+    }
+    writers_.clear();
+    sort(files.begin(), files.end(), [](const written_t& a, const written_t& b) {return a.index < b.index;});
+
+    // Build the file table and the list of names
+    vector<stripe_file_t> table;
+    string names;
+    for (auto& f : files)
+    {
+        table.push_back(f.entry);
+        names.append(f.path.c_str(), f.path.size() + 1);
+    }
+
+    // Fill in the fields that describe the layout
+    manifest_.headerSize = sizeof(manifest_);
+    manifest_.fileCount  = files.size();
+    manifest_.frameCount = framesWritten_;
+    manifest_.namesSize  = names.size();
+    manifest_.filesCrc   = crc32c(0, table.data(), table.size() * sizeof(stripe_file_t));
+    manifest_.filesCrc   = crc32c(manifest_.filesCrc, names.data(), names.size());
+    manifest_.headerCrc  = crc32c(0, &manifest_, offsetof(stripe_manifest_t, headerCrc));
+
+    // And write the manifest
+    size_t tableSize = table.size() * sizeof(stripe_file_t);
+    int fd = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) throwRuntime("Can't create %s", filename_.c_str());
+    bool ok = write(fd, &manifest_, sizeof(manifest_)) == sizeof(manifest_)
+           && write(fd, table.data(), tableSize) == (ssize_t)tableSize
+           && write(fd, names.data(), names.size()) == (ssize_t)names.size();
+    ::close(fd);
+    if (!ok) throwRuntime("Write to %s failed: %s", filename_.c_str(), strerror(errno));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// Destructor - If the caller never called close() we're being destroyed during an exception, so
+//              just stop the writers
+//=================================================================================================
+StripedFile::~StripedFile()
+{
+    stopThreads(false);
+}
+//=================================================================================================
@@ -0,0 +1,139 @@
+//=================================================================================================
+// StripedFile.h - Defines a class that spreads frame groups across several output files
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "container.h"
+#include "FrameSink.h"
+#include "OutputFile.h"
+
+class StripedFile : public FrameSink
+{
+public:
+
+    // Constructor
+    StripedFile() {current_ = nullptr;}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    StripedFile (const StripedFile&) = delete;
+    StripedFile& operator= (const StripedFile&) = delete;
+
+    // Destructor, stops the writer threads
+    ~StripedFile();
+
+    // Starts a run whose manifest is 'filename'.  If 'groupsPerFile' is 0, frame groups are
+    // striped round-robin across the files named in 'paths'.  Otherwise every 'groupsPerFile'
+    // frame groups go to a file of their own, named after one of 'paths' (round-robin) with
+    // the file number appended.  'manifest' describes the run; the layout fields are filled in
+    // when the file is closed.  If 'header' is not null, every file is a container
+    void    create(const char* filename, const std::vector<std::string>& paths,
+                   uint32_t groupsPerFile, const stripe_manifest_t& manifest, bool dedup,
+                   const container_header_t* header = nullptr);
+
+    // Reserves disk space in every file for its share of a run of 'frameCount' frames
+    void    preallocate(uint64_t frameCount) {expectedFrames_ = frameCount;}
+
+    // Sets the size of the write-behind window of every file (see OutputFile.h)
+    void    setWriteBehind(size_t windowSize) {writeBehind_ = windowSize;}
+
+    // Call this to append a single data frame
+    void    writeFrame(const uint8_t* frame);
+
+    // Writes any partial batch, waits for the writers to finish, and writes the manifest
+    void    close();
+
+    // Returns the number of files that were written
+    uint32_t fileCount() {return manifest_.fileCount;}
+
+protected:
+
+    // A batch of consecutive frames from a single frame group, on its way to a file
+    struct batch_t
+    {
+        std::vector<uint8_t> data;
+        uint32_t frames;
+        uint32_t file;
+    };
+
+    // A file that has been completely written
+    struct written_t
+    {
+        uint32_t      index;
+        std::string   path;
+        stripe_file_t entry;
+    };
+
+    // Each writer has a thread, a queue of batches, and the file it's currently writing
+    struct writer_t
+    {
+        std::thread              thread;
+        std::mutex               lock;
+        std::condition_variable  workAvailable, spaceAvailable;
+        std::deque<batch_t*>     queue, spare;
+        uint32_t                 buffers;
+        bool                     stopping;
+        std::exception_ptr       error;
+
+        OutputFile               file;
+        std::string              path, fullPath;
+        bool                     isOpen;
+        uint32_t                 fileIndex;
+        stripe_file_t            entry;
+        std::vector<written_t>   written;
+    };
+
+    // The body of the thread for a writer
+    void    writerThread(writer_t& writer);
+
+    // Opens file number 'index' on behalf of a writer
+    void    openFile(writer_t& writer, uint32_t index);
+
+    // Closes the file a writer is writing, and records what's in it
+    void    finishFile(writer_t& writer);
+
+    // Returns the number of the file that frame group 'group' belongs in
+    uint32_t fileOf(uint64_t group);
+
+    // Fetches an empty batch from the writer that the next frame goes to
+    void    startBatch();
+
+    // Hands the current batch to its writer
+    void    submitBatch();
+
+    // Stops the writer threads.  If 'finish' is true, they close the files they're writing.
+    // Returns the first error any of them ran into
+    std::exception_ptr stopThreads(bool finish);
+
+    // The name of the manifest, and the manifest we'll write when the file is closed
+    std::string       filename_;
+    stripe_manifest_t manifest_;
+
+    // The names the files are based on, and the parameters each file is created with
+    std::vector<std::string> paths_;
+    bool      dedup_, isContainer_;
+    container_header_t header_;
+
+    // The writers
+    std::vector<std::unique_ptr<writer_t>> writers_;
+
+    // The batch currently being filled, and the number of frames handed out so far
+    batch_t*  current_;
+    uint64_t  framesWritten_;
+
+    // The number of bytes in a frame, and the most frames in a batch
+    size_t    frameSize_;
+    uint32_t  framesPerBatch_;
+
+    // The number of frames in the complete run (0 = unknown), and the write-behind window size
+    uint64_t  expectedFrames_;
+    size_t    writeBehind_;
+};
@@ -0,0 +1,278 @@
+//=================================================================================================
+// SummaryPyramid.cpp - Implements a class that builds (and reads) a multi-resolution summary
+//
+// Level 0 is built a frame at a time while the run is generated.  The levels above it are built
+// at the end, each from the level below it, by merging 2 x 2 neighborhoods of tiles and blocks.
+// A viewer can start at the top of the pyramid and only descend into the regions that matter,
+// without ever touching the frame data.
+//=================================================================================================
+#include <unistd.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include "SummaryPyramid.h"
+#include "crc32c.h"
+using namespace std;
+
+
+//=================================================================================================
+// throwRuntime() - Throws a runtime exception
+//=================================================================================================
+static void throwRuntime(const char* fmt, ...)
+{
+    char buffer[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsprintf(buffer, fmt, ap);
+    va_end(ap);
+
+    throw runtime_error(buffer);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// emptySummary() - Returns a summary that covers no samples at all
+//=================================================================================================
+static summary_t emptySummary()
+{
+    summary_t s;
+    memset(&s, 0, sizeof(s));
+    s.min = 0xFF;
+    return s;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// create() - Starts a new summary
+//=================================================================================================
+void SummaryPyramid::create(uint32_t cellsPerFrame, uint32_t tileCells, uint32_t blockFrames,
+                            uint8_t fillerValue)
+{
+    // Check our parameters
+    if (tileCells == 0 || blockFrames == 0) throwRuntime("Summary tiles and blocks can't be empty");
+
+    // Describe the summary
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, SUMMARY_MAGIC, sizeof(header_.magic));
+    header_.headerSize    = sizeof(header_);
+    header_.cellsPerFrame = cellsPerFrame;
+    header_.tileCells     = tileCells;
+    header_.blockFrames   = blockFrames;
+    header_.fillerValue   = fillerValue;
+
+    // Level 0 has this many tiles across each frame
+    header_.level[0].tilesAcross = (cellsPerFrame + tileCells - 1) / tileCells;
+    header_.level[0].tileCells   = tileCells;
+    header_.level[0].blockFrames = blockFrames;
+
+    // Nothing has been summarized yet
+    levels_.assign(1, vector<summary_t>());
+    block_.assign(header_.level[0].tilesAcross, emptySummary());
+    framesInBlock_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// addFrame() - Folds a frame into the block of tiles we're accumulating
+//=================================================================================================
+void SummaryPyramid::addFrame(const uint8_t* frame)
+{
+    const uint8_t filler = header_.fillerValue;
+
+    for (uint32_t tile = 0; tile < block_.size(); ++tile)
+    {
+        const uint8_t* p   = frame + (size_t)tile * header_.tileCells;
+        uint32_t       n   = header_.tileCells;
+        uint8_t        lo  = 0xFF, hi = 0;
+        uint64_t       sum = 0;
+        uint32_t       idle = 0;
+
+        // The last tile in the frame may be a partial one
+        if ((size_t)tile * header_.tileCells + n > header_.cellsPerFrame)
+        {
+            n = header_.cellsPerFrame - tile * header_.tileCells;
+        }
+
+        // Gather the statistics for this tile of this frame
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            uint8_t value = p[i];
+            if (value < lo) lo = value;
+            if (value > hi) hi = value;
+            sum  += value;
+            idle += (value == filler);
+        }
+
+        // And fold them into the block
+        summary_t& s = block_[tile];
+        if (lo < s.min) s.min = lo;
+        if (hi > s.max) s.max = hi;
+        s.samples += n;
+        s.active  += n - idle;
+        s.sum     += sum;
+    }
+
+    ++header_.frameCount;
+    if (++framesInBlock_ == header_.blockFrames) finishBlock();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// finishBlock() - Appends the block we've been accumulating to level 0, and starts a new one
+//=================================================================================================
+void SummaryPyramid::finishBlock()
+{
+    levels_[0].insert(levels_[0].end(), block_.begin(), block_.end());
+    ++header_.level[0].blocks;
+
+    block_.assign(block_.size(), emptySummary());
+    framesInBlock_ = 0;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// merge() - Combines the statistics of one summary into another
+//=================================================================================================
+void SummaryPyramid::merge(summary_t& dst, const summary_t& src)
+{
+    if (src.min < dst.min) dst.min = src.min;
+    if (src.max > dst.max) dst.max = src.max;
+    dst.samples += src.samples;
+    dst.active  += src.active;
+    dst.sum     += src.sum;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// buildLevels() - Builds every level above level 0.  Each tile of a level covers a 2 x 2
+//                 neighborhood of the level below it (or 2 x 1, once there's only a single
+//                 tile across or a single block down).  The last level is a single tile
+//=================================================================================================
+void SummaryPyramid::buildLevels()
+{
+    uint32_t level = 0;
+
+    while (header_.level[level].tilesAcross > 1 || header_.level[level].blocks > 1)
+    {
+        if (level + 1 == SUMMARY_MAX_LEVELS) throwRuntime("Summary pyramid has too many levels");
+
+        auto& below  = header_.level[level];
+        auto& above  = header_.level[level + 1];
+        uint32_t tileScale  = below.tilesAcross > 1 ? 2 : 1;
+        uint32_t blockScale = below.blocks > 1 ? 2 : 1;
+        above.tilesAcross = (below.tilesAcross + tileScale - 1) / tileScale;
+        above.blocks      = (below.blocks + blockScale - 1) / blockScale;
+        above.tileCells   = below.tileCells * tileScale;
+        above.blockFrames = below.blockFrames * blockScale;
+
+        vector<summary_t> next((size_t)above.tilesAcross * above.blocks, emptySummary());
+        for (uint32_t block = 0; block < below.blocks; ++block)
+        {
+            for (uint32_t tile = 0; tile < below.tilesAcross; ++tile)
+            {
+                summary_t& dst = next[(size_t)(block / blockScale) * above.tilesAcross + tile / tileScale];
+                merge(dst, levels_[level][(size_t)block * below.tilesAcross + tile]);
+            }
+        }
+
+        levels_.push_back(move(next));
+        ++level;
+    }
+
+    header_.levelCount = level + 1;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// save() - Finishes the summary and writes it to a file
+//=================================================================================================
+void SummaryPyramid::save(const char* filename)
+{
+    // The last block of frames may be a partial one
+    if (framesInBlock_) finishBlock();
+
+    // A run with no frames still gets a (single, empty) block
+    if (header_.level[0].blocks == 0) finishBlock();
+
+    // Build the rest of the pyramid
+    buildLevels();
+
+    // Lay the levels out one after the other, and compute the CRC of them all
+    uint64_t offset = sizeof(header_);
+    header_.dataCrc = 0;
+    for (uint32_t level = 0; level < header_.levelCount; ++level)
+    {
+        header_.level[level].offset = offset;
+        offset += levels_[level].size() * sizeof(summary_t);
+        header_.dataCrc = crc32c(header_.dataCrc, levels_[level].data(), levels_[level].size() * sizeof(summary_t));
+    }
+    header_.headerCrc = crc32c(0, &header_, offsetof(summary_header_t, headerCrc));
+
+    // And write the file
+    int fd = ::open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) throwRuntime("Can't create %s", filename);
+    bool ok = write(fd, &header_, sizeof(header_)) == sizeof(header_);
+    for (auto& level : levels_)
+    {
+        size_t length = level.size() * sizeof(summary_t);
+        ok = ok && write(fd, level.data(), length) == (ssize_t)length;
+    }
+    ::close(fd);
+    if (!ok) throwRuntime("Write to %s failed: %s", filename, strerror(errno));
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// load() - Reads a summary file, and makes sure it's intact
+//=================================================================================================
+void SummaryPyramid::load(const char* filename)
+{
+    struct stat sb;
+
+    // Open the file
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open %s", filename);
+    fstat(fd, &sb);
+
+    // Fetch and sanity check the header
+    bool ok = read(fd, &header_, sizeof(header_)) == sizeof(header_)
+           && memcmp(header_.magic, SUMMARY_MAGIC, sizeof(header_.magic)) == 0
+           && header_.headerCrc == crc32c(0, &header_, offsetof(summary_header_t, headerCrc))
+           && header_.levelCount > 0 && header_.levelCount <= SUMMARY_MAX_LEVELS;
+    if (!ok)
+    {
+        ::close(fd);
+        throwRuntime("%s is not a summary file", filename);
+    }
+
+    // Read each level of the pyramid
+    uint32_t crc = 0;
+    levels_.resize(header_.levelCount);
+    for (uint32_t level = 0; ok && level < header_.levelCount; ++level)
+    {
+        auto&  info   = header_.level[level];
+        size_t length = (size_t)info.tilesAcross * info.blocks * sizeof(summary_t);
+        if (info.offset + length > (uint64_t)sb.st_size) {ok = false; break;}
+        levels_[level].resize((size_t)info.tilesAcross * info.blocks);
+        ok  = pread(fd, levels_[level].data(), length, info.offset) == (ssize_t)length;
+        crc = crc32c(crc, levels_[level].data(), length);
+    }
+    ::close(fd);
+
+    // Complain if the file is damaged
+    if (!ok || crc != header_.dataCrc) throwRuntime("%s is corrupt", filename);
+}
+//=================================================================================================
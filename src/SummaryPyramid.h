@@ -0,0 +1,62 @@
+//=================================================================================================
+// SummaryPyramid.h - Defines a class that builds (and reads) a multi-resolution summary of a run
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "summary.h"
+
+class SummaryPyramid
+{
+public:
+
+    // Constructor
+    SummaryPyramid() {}
+
+    // No copy or assignment constructor - objects of this class can't be copied
+    SummaryPyramid (const SummaryPyramid&) = delete;
+    SummaryPyramid& operator= (const SummaryPyramid&) = delete;
+
+    // Starts a new summary.  'tileCells' must be a multiple of the row size
+    void    create(uint32_t cellsPerFrame, uint32_t tileCells, uint32_t blockFrames, uint8_t fillerValue);
+
+    // Folds the next frame of the run into the summary
+    void    addFrame(const uint8_t* frame);
+
+    // Builds the upper levels of the pyramid and writes the summary to a file
+    void    save(const char* filename);
+
+    // Reads a summary that was written by save()
+    void    load(const char* filename);
+
+    // Returns the header that describes the summary
+    const summary_header_t& header() {return header_;}
+
+    // Returns the summary of a single tile in a single block of the specified level
+    const summary_t& at(uint32_t level, uint32_t block, uint32_t tile)
+    {
+        return levels_[level][(size_t)block * header_.level[level].tilesAcross + tile];
+    }
+
+protected:
+
+    // Appends the block that's been accumulating to level 0
+    void    finishBlock();
+
+    // Builds each level of the pyramid from the level below it
+    void    buildLevels();
+
+    // Combines the statistics in 'src' into 'dst'
+    static void merge(summary_t& dst, const summary_t& src);
+
+    // Describes the summary
+    summary_header_t header_;
+
+    // The block of tiles we're accumulating frames into, and how many frames it has so far
+    std::vector<summary_t> block_;
+    uint32_t framesInBlock_;
+
+    // The levels of the pyramid.  Each is 'blocks' rows of 'tilesAcross' tiles
+    std::vector<std::vector<summary_t>> levels_;
+};
@@ -5,5 +5,95 @@
 //
 // 1.01  31-Jul-23  DWW  Fixed the calculation of "frameGroupCount" to no longer be off by 1 when
 //                       the longest data sequence is exactly divisible by the frame group size.
+//
+// 1.02  18-Oct-26  DWW  Added optional "dedup_output".  Duplicate frames are cloned from their
+//                       earlier copy in the output file rather than being written again.
+//
+// 1.03  18-Oct-26  DWW  Added "output_format = container" and the "-verify" command line switch.
+//                       -trace and -load understand container files.
+//
+// 1.04  18-Oct-26  DWW  Added "output_format = compressed" and the "-compare" command line 
+//                       switch.  -trace, -load, and -verify understand compressed files.
+//
+// 1.05  18-Oct-26  DWW  Added "output_format = sparse", a container with frame data XORed with
+//                       the filler value so that idle pages become holes in the file.
+//
+// 1.06  18-Oct-26  DWW  Added "output_format = events", a compact model of the run from which
+//                       -load, -trace, -verify, and -compare rebuild the frames.
+//
+// 1.07  18-Oct-26  DWW  "output_file" can be "-" or a FIFO, to stream raw frames to another
+//                       process.   Pipes are fed with vmsplice() from a pool of page-aligned
+//                       buffers.
+//
+// 1.08  18-Oct-26  DWW  Added the "-replay" command line switch, which sends frames to a FIFO,
+//                       a Unix socket, or stdout at "frame_rate" frames per second.
+//
+// 1.09  18-Oct-26  DWW  Added "output_format = channel", which publishes frames into a
+//                       shared-memory ring for local consumers.  -replay can publish to a
+//                       channel too.
+//
+// 1.10  18-Oct-26  DWW  Output files are checkpointed every "checkpoint_interval" frame groups,
+//                       and the "-resume" command line switch carries on from the checkpoint.
+//                       Frames are now built from the compiled model of the distribution.
+//
+// 1.11  18-Oct-26  DWW  Output files are preallocated, and written behind in "writeback_mb"
+//                       windows that are dropped from the page cache once they're on disk.
+//
+// 1.12  18-Oct-26  DWW  "output_file" can name several files.  Frame groups are striped across
+//                       them by per-file writer threads, with a manifest that -load, -trace,
+//                       -verify, and -compare use to read the stripes in parallel.  Stripes are
+//                       written in bounded batches, and the manifest lists the frames in each
+//                       file and their CRC.
+//
+// 1.13  18-Oct-26  DWW  Added "split_groups", which writes every N frame groups to a numbered
+//                       file of their own, with "output_file" as the manifest.
+//
+// 1.14  18-Oct-26  DWW  Added "write_summary", which writes a multi-resolution summary pyramid
+//                       of the run next to the output file, and "-summary" to view it.
+//
+// 1.15  18-Oct-26  DWW  Added "marker_cell", which embeds a frame number and CRC in every frame,
+//                       and "-markers" to check a capture for dropped or damaged frames.
+//
+// 1.16  18-Oct-26  DWW  Added "-consume", which emulates the consumer of a frame channel and
+//                       reports throughput and headroom, and "consume_rate".
+//
+// 1.17  18-Oct-26  DWW  Added "ring_alignment" and "align_frames", which pad raw output so that
+//                       frame groups (or frames) are aligned for DMA, and write a layout table
+//                       of DMA descriptors next to the output file.
+//
+// 1.18  18-Oct-26  DWW  PhysMem maps every "memmap=" region as one buffer, and "-load" accepts
+//                       an address of "auto", filling each region from its own NUMA node.
+//
+// 1.19  18-Oct-26  DWW  "-load" and "-markers" accept "huge:<file>", a buffer made of locked
+//                       hugepages with no "memmap=" needed.  Their physical addresses come from
+//                       /proc/self/pagemap, and the segment table is written to
+//                       <filename>.segments.
+//
+// 1.20  18-Oct-26  DWW  "-load list:<file>" loads every file in a load list at its own offset
+//                       in the buffer, one thread per file, after checking the whole list.
+//
+// 1.21  18-Oct-26  DWW  "-load -" (or a FIFO) loads a stream through a double-buffered reader
+//                       thread, reporting throughput.  Containers are sized by their header and
+//                       have their CRCs checked as the data goes by.
+//
+// 1.22  18-Oct-26  DWW  "-trace" takes an optional range of frames, and works the values out from
+//                       the compiled model (without building frames) if "-model" is given or
+//                       the configuration names no output file.
+//
+// 1.23  18-Oct-26  DWW  Added CellIndex, an index over the distribution records, with "-cells" to
+//                       show which records cover a cell or range of cells, and "-overlaps" to
+//                       list the records that have cells in common.
+//
+// 1.24  18-Oct-26  DWW  Added "test_pattern" (prbs7, prbs31, ramp, walking_ones, frame_number) and
+//                       "test_pattern_frames", which write synthetic frames for bringing up the
+//                       DMA path instead of the modelled ones, built across all cores.
+//
+// 1.25  18-Oct-26  DWW  Added "defect_file" and "defect_rate", which simulate dead, stuck, and hot
+//                       cells.  Defects compile into masks over 16-byte blocks that are blended
+//                       into every built frame, and are carried in event files.
+//
+// 1.26  18-Oct-26  DWW  Added "crosstalk_kernel" and "crosstalk_shift", a 1x3 or 3x3 stencil over
+//                       the rows of the frame that models leakage between neighbouring cells.
+//                       It's applied with saturating SSE2 arithmetic in row stripes across cores.
 //=================================================================================================
-#define VERSION_REV "1.01"
\ No newline at end of file
+#define VERSION_REV "1.26"
\ No newline at end of file
@@ -0,0 +1,95 @@
+//=================================================================================================
+// channel.h - Defines the layout of the shared-memory frame channel
+//
+// The channel is a memfd that the producer shares with each consumer (via SCM_RIGHTS) when the
+// consumer connects to the producer's Unix domain socket.  The memfd looks like this:
+//
+//     +-------------------------+  offset 0
+//     | channel_header_t        |
+//     +-------------------------+  offset header.dataOffset (always a multiple of 4096)
+//     | slot[0]                 |  Each slot is 'slotSize' bytes and holds one frame
+//     | slot[1]                 |
+//     | ...                     |
+//     +-------------------------+
+//
+// Frame 'n' lives in slot n % slotCount.  'writeCursor' is the number of frames published so
+// far, and each consumer has its own 'readCursor', the number of frames it has finished with.
+// The producer never gets more than 'slotCount' frames ahead of the slowest consumer.
+//
+// The producer bumps 'writeSeq' and wakes it (as a futex) after every frame it publishes.
+// Consumers bump 'readSeq' and wake it after every frame they finish with.
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// The first 8 bytes of every channel
+#define CHANNEL_MAGIC "SFGCHAN1"
+
+// The most consumers that can be attached to a channel at once
+const uint32_t CHANNEL_MAX_CONSUMERS = 16;
+
+// Each consumer's cursor lives on its own cache line
+struct alignas(64) channel_consumer_t
+{
+    volatile uint64_t readCursor;
+    volatile uint32_t active;
+    volatile uint32_t pid;
+};
+
+struct channel_header_t
+{
+    char     magic[8];
+    uint32_t headerSize;
+    uint32_t cellsPerFrame;
+    uint32_t framesPerGroup;
+    uint32_t slotCount;
+    uint64_t slotSize;
+    uint64_t dataOffset;
+    uint64_t frameCount;
+
+    // Written only by the producer
+    alignas(64) volatile uint64_t writeCursor;
+    volatile uint32_t writeSeq;
+    volatile uint32_t finished;
+
+    // Bumped by consumers
+    alignas(64) volatile uint32_t readSeq;
+
+    // One entry per consumer
+    channel_consumer_t consumer[CHANNEL_MAX_CONSUMERS];
+};
+
+// When a consumer connects, it receives the memfd along with this message
+struct channel_welcome_t
+{
+    uint32_t consumerIndex;
+    uint32_t reserved;
+    uint64_t channelSize;
+};
+
+
+//=================================================================================================
+// futexWait() - Waits for up to 'msec' milliseconds for a wake-up on 'word', as long as it still
+//               contains 'value'
+//=================================================================================================
+inline void futexWait(volatile uint32_t* word, uint32_t value, uint32_t msec)
+{
+    struct timespec ts = {msec / 1000, (long)(msec % 1000) * 1000000};
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &ts, nullptr, 0);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// futexWake() - Wakes everyone waiting on 'word'
+//=================================================================================================
+inline void futexWake(volatile uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+//=================================================================================================
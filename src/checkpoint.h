@@ -0,0 +1,49 @@
+//=================================================================================================
+// checkpoint.h - Defines the layout of the checkpoint file that lets an interrupted run resume
+//
+// The checkpoint file sits next to the output file (with ".ckpt" appended to its name) and is
+// replaced atomically every time a checkpoint is taken.  It looks like this:
+//
+//     +-------------------------+
+//     | checkpoint_t            |
+//     +-------------------------+
+//     | uint32_t crc[crcCount]  |  The CRC of every frame group written so far (containers only)
+//     +-------------------------+
+//
+// Everything the checkpoint describes was on disk (fdatasync) before the checkpoint was written.
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+// The first 8 bytes of every checkpoint file
+#define CHECKPOINT_MAGIC "SFGCKPT4"
+
+struct checkpoint_t
+{
+    // These identify the run.  A checkpoint can only be resumed by an identical run
+    char     magic[8];
+    char     outputFormat[16];
+    uint32_t cellsPerFrame;
+    uint32_t framesPerGroup;
+    uint32_t frameGroupCount;
+    uint32_t fillerValue;
+    uint64_t randomSeed;
+    uint32_t nucleotideCrc;
+    uint32_t fragmentCrc;
+    uint32_t distributionCrc;
+    uint32_t markerCell;
+    uint32_t alignFrames;
+    uint64_t ringAlignment;
+    double   defectRate;
+    uint32_t defectCrc;
+    uint32_t crosstalkCrc;
+
+    // These describe how far the run got
+    uint32_t groupsDone;
+    uint64_t framesDone;
+    uint64_t randomPosition;
+    uint32_t crcCount;
+
+    // CRC-32C of all of the above fields and of the frame group CRCs that follow
+    uint32_t checkpointCrc;
+};
@@ -0,0 +1,290 @@
+//=================================================================================================
+// codec.cpp - A small, fast compressor for data frames
+//=================================================================================================
+#include <string.h>
+#include "codec.h"
+
+// Matches shorter than this aren't worth encoding
+static const size_t MIN_MATCH = 4;
+
+// The hash table that finds earlier occurences of 4-byte sequences has 2^HASH_BITS entries
+static const int HASH_BITS = 16;
+
+// A hash table entry that doesn't point to anything
+static const uint32_t EMPTY = 0xFFFFFFFF;
+
+
+//=================================================================================================
+// Helpers for reading unaligned words and hashing them
+//=================================================================================================
+static inline uint32_t read32(const uint8_t* p) {uint32_t v; memcpy(&v, p, 4); return v;}
+static inline uint64_t read64(const uint8_t* p) {uint64_t v; memcpy(&v, p, 8); return v;}
+static inline uint32_t hash32(uint32_t v)       {return (v * 2654435761u) >> (32 - HASH_BITS);}
+//=================================================================================================
+
+
+//=================================================================================================
+// putVarint() - Writes an unsigned integer 7 bits at a time, least significant bits first
+//=================================================================================================
+static inline uint8_t* putVarint(uint8_t* out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// varintLength() - Returns the number of bytes putVarint() will use to write a value
+//=================================================================================================
+static inline size_t varintLength(uint64_t value)
+{
+    size_t length = 1;
+    while (value >= 0x80) {value >>= 7; ++length;}
+    return length;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// getVarint() - Reads an integer written by putVarint().  Returns false if we run out of input
+//=================================================================================================
+static inline bool getVarint(const uint8_t*& in, const uint8_t* end, uint64_t* pValue)
+{
+    uint64_t value = 0;
+    int      shift = 0;
+
+    while (in < end && shift < 64)
+    {
+        uint8_t c = *in++;
+        value |= (uint64_t)(c & 0x7F) << shift;
+        if ((c & 0x80) == 0)
+        {
+            *pValue = value;
+            return true;
+        }
+        shift += 7;
+    }
+
+    return false;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// matchLength() - Returns the number of bytes (up to 'limit') that are identical at 'a' and 'b'
+//=================================================================================================
+static inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t limit)
+{
+    size_t length = 0;
+
+    // Compare 8 bytes at a time while we can
+    while (length + 8 <= limit)
+    {
+        uint64_t diff = read64(a + length) ^ read64(b + length);
+        if (diff) return length + (__builtin_ctzll(diff) >> 3);
+        length += 8;
+    }
+
+    // Then finish up a byte at a time
+    while (length < limit && a[length] == b[length]) ++length;
+    return length;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// emitLiterals() - Writes a literal run to the output stream
+//=================================================================================================
+static inline uint8_t* emitLiterals(uint8_t* out, const uint8_t* src, size_t count)
+{
+    if (count == 0) return out;
+
+    if (count < 127)
+        *out++ = (uint8_t)count;
+    else
+    {
+        *out++ = 127;
+        out = putVarint(out, count - 127);
+    }
+
+    memcpy(out, src, count);
+    return out + count;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// emitMatch() - Writes a match to the output stream
+//=================================================================================================
+static inline uint8_t* emitMatch(uint8_t* out, size_t length, size_t distance)
+{
+    length -= MIN_MATCH;
+
+    if (length < 127)
+        *out++ = (uint8_t)(0x80 | length);
+    else
+    {
+        *out++ = 0xFF;
+        out = putVarint(out, length - 127);
+    }
+
+    return putVarint(out, distance);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// compressBound() - Returns the worst case size of compressing 'length' bytes
+//=================================================================================================
+size_t compressBound(size_t length)
+{
+    // A match is never longer than the bytes it replaces, and each match can cost us at most one
+    // extra literal tag.  A match replaces at least 4 bytes.
+    return length + length / 4 + 32;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// compressBlock() - Compresses 'length' bytes at 'src' into 'dst'
+//
+// Returns: The number of bytes written to 'dst'
+//=================================================================================================
+size_t compressBlock(const uint8_t* src, size_t length, uint8_t* dst)
+{
+    // Each thread has its own hash table of where 4-byte sequences were last seen
+    static thread_local uint32_t table[1 << HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+
+    uint8_t* out    = dst;
+    size_t   anchor = 0, i = 0, misses = 0;
+
+    while (i + MIN_MATCH <= length)
+    {
+        size_t matchLen = 0, distance = 0;
+
+        // If this byte continues a run, find out how long the run is
+        if (i > 0 && src[i] == src[i-1])
+        {
+            matchLen = matchLength(src + i, src + i - 1, length - i);
+            distance = 1;
+        }
+
+        // If it's not a run, look for an earlier occurence of the next 4 bytes
+        if (matchLen < MIN_MATCH)
+        {
+            uint32_t word      = read32(src + i);
+            uint32_t& slot     = table[hash32(word)];
+            uint32_t candidate = slot;
+            slot = (uint32_t)i;
+            if (candidate != EMPTY && read32(src + candidate) == word)
+            {
+                matchLen = MIN_MATCH + matchLength(src + i + MIN_MATCH, src + candidate + MIN_MATCH,
+                                                   length - i - MIN_MATCH);
+                distance = i - candidate;
+            }
+        }
+
+        // A distant match can take more bytes to encode than it saves
+        if (matchLen >= MIN_MATCH)
+        {
+            size_t cost = 1 + varintLength(distance);
+            if (matchLen - MIN_MATCH >= 127) cost += varintLength(matchLen - MIN_MATCH - 127);
+            if (cost > matchLen) matchLen = 0;
+        }
+
+        // If we didn't find a match, move on.  The longer we go without finding one, the
+        // faster we skip through the data
+        if (matchLen < MIN_MATCH)
+        {
+            i += 1 + (misses++ >> 6);
+            continue;
+        }
+
+        // Write out the literals that precede this match, then the match itself
+        out = emitLiterals(out, src + anchor, i - anchor);
+        out = emitMatch(out, matchLen, distance);
+        i      += matchLen;
+        anchor  = i;
+        misses  = 0;
+    }
+
+    // Whatever is left over is literals
+    out = emitLiterals(out, src + anchor, length - anchor);
+
+    return out - dst;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// decompressBlock() - Decompresses a block produced by compressBlock()
+//
+// Returns: true if the block decompressed to exactly 'dstLength' bytes
+//=================================================================================================
+bool decompressBlock(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t dstLength)
+{
+    const uint8_t* in     = src;
+    const uint8_t* inEnd  = src + srcLength;
+    uint8_t*       out    = dst;
+    uint8_t*       outEnd = dst + dstLength;
+    uint64_t       extra, distance;
+
+    while (in < inEnd)
+    {
+        uint8_t  tag    = *in++;
+        uint64_t length = tag & 0x7F;
+
+        // Fetch the extended length if there is one
+        if (length == 127)
+        {
+            if (!getVarint(in, inEnd, &extra)) return false;
+            length += extra;
+        }
+
+        // Is this a literal run?
+        if ((tag & 0x80) == 0)
+        {
+            if (length > (uint64_t)(inEnd - in) || length > (uint64_t)(outEnd - out)) return false;
+            memcpy(out, in, length);
+            in  += length;
+            out += length;
+            continue;
+        }
+
+        // If we get here, it's a match
+        length += MIN_MATCH;
+        if (!getVarint(in, inEnd, &distance)) return false;
+        if (distance == 0 || distance > (uint64_t)(out - dst)) return false;
+        if (length > (uint64_t)(outEnd - out)) return false;
+
+        const uint8_t* from = out - distance;
+
+        // A run of a single byte is just a memset
+        if (distance == 1)
+            memset(out, *from, length);
+
+        // If the source and destination are far enough apart, copy 8 bytes at a time
+        else if (distance >= 8)
+        {
+            uint64_t i = 0;
+            for (; i + 8 <= length; i += 8) memcpy(out + i, from + i, 8);
+            for (; i < length; ++i) out[i] = from[i];
+        }
+
+        // Otherwise the regions overlap and have to be copied a byte at a time
+        else for (uint64_t i = 0; i < length; ++i) out[i] = from[i];
+
+        out += length;
+    }
+
+    // The block is valid if it filled the output buffer exactly
+    return out == outEnd;
+}
+//=================================================================================================
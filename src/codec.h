@@ -0,0 +1,25 @@
+//=================================================================================================
+// codec.h - A small, fast compressor for data frames
+//
+// Data frames are mostly long runs of the filler value with short stretches of ADC values, so
+// the codec is a byte-oriented LZ77 variant in which a run of identical bytes is simply a match
+// at distance 1.   The compressed stream is a sequence of:
+//
+//     Literals : tag 0LLLLLLL [varint] <bytes>      L = literal count (127 = more in varint)
+//     Match    : tag 1LLLLLLL [varint] <varint>     L = length - 4   (127 = more in varint),
+//                                                   followed by the distance back to the match
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Returns the largest number of bytes that compressing 'length' bytes can produce
+size_t   compressBound(size_t length);
+
+// Compresses a block of data.  'dst' must be at least compressBound(length) bytes.
+// Returns the number of compressed bytes
+size_t   compressBlock(const uint8_t* src, size_t length, uint8_t* dst);
+
+// Decompresses a block of data into exactly 'dstLength' bytes.  Returns false if the
+// compressed data is corrupt
+bool     decompressBlock(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t dstLength);
@@ -0,0 +1,198 @@
+//=================================================================================================
+// container.h - Defines the layout of the self-describing "container" output file format
+//
+// A container file looks like this:
+//
+//     +-------------------------+  offset 0
+//     | container_header_t      |
+//     +-------------------------+  offset header.dataOffset (always a multiple of 4096)
+//     | raw data frames         |
+//     +-------------------------+  offset header.trailerOffset
+//     | uint32_t crc[groups]    |  One CRC-32C per frame group
+//     +-------------------------+
+//
+// Unless 'encoding' says otherwise, the data frames are byte-for-byte identical to what would be
+// in a raw output file, so the data region can be loaded into the contiguous buffer as-is.
+//
+// With ENCODING_FILLER_XOR, every byte of frame data is stored exclusive-ORed with the filler
+// value.  Idle cells become zero, and 4K pages of zeros are never written, leaving holes in the 
+// (sparse) file.  The CRCs are of the encoded data.
+//
+// A compressed file looks like this:
+//
+//     +-------------------------+  offset 0
+//     | compressed_header_t     |
+//     +-------------------------+  offset COMPRESSED_DATA_OFFSET
+//     | compressed chunks       |  Each chunk is 'framesPerChunk' frames, compressed on its own
+//     +-------------------------+  offset header.indexOffset
+//     | chunk_index_t[chunks]   |  Where each chunk lives, and the CRC-32C of its raw data
+//     +-------------------------+
+//
+// An event file holds no frame data at all.  Instead it holds a compiled model of the run (see
+// FrameModel.cpp for the format of the events) from which every frame can be rebuilt:
+//
+//     +-------------------------+  offset 0
+//     | event_header_t          |
+//     +-------------------------+  offset header.eventsOffset
+//     | model events            |  'eventsSize' bytes
+//     +-------------------------+
+//
+// A run can also be spread across several files, usually on different drives.  Frame groups
+// are either striped across the files round-robin (frame group 'g' lives in file g % fileCount)
+// or split into runs of 'groupsPerFile' consecutive frame groups per file.  Each file is an
+// ordinary raw, container, or sparse file holding its own frame groups back to back.  The
+// manifest that ties them together looks like this:
+//
+//     +-------------------------+  offset 0
+//     | stripe_manifest_t       |
+//     +-------------------------+  offset header.headerSize
+//     | stripe_file_t[files]    |  The frames in each file, and the CRC-32C of those frames
+//     +-------------------------+
+//     | file names              |  'namesSize' bytes of NUL-terminated names, one per file
+//     +-------------------------+
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+// The first 8 bytes of every container file
+#define CONTAINER_MAGIC "SFGDATA1"
+
+// The frame data always starts at this offset in the file
+const uint32_t CONTAINER_DATA_OFFSET = 4096;
+
+// These are the possible values of the 'encoding' field in the header
+const uint32_t ENCODING_NONE       = 0;
+const uint32_t ENCODING_FILLER_XOR = 1;
+
+struct container_header_t
+{
+    char     magic[8];
+    uint32_t headerSize;
+    uint32_t cellsPerFrame;
+    uint32_t framesPerGroup;
+    uint32_t frameGroupCount;
+    uint64_t frameCount;
+    uint64_t randomSeed;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint64_t trailerOffset;
+
+    // CRC-32C of the nucleotide, fragment, and distribution input files
+    uint32_t nucleotideCrc;
+    uint32_t fragmentCrc;
+    uint32_t distributionCrc;
+
+    // How the frame data is encoded, and the filler value
+    uint32_t encoding;
+    uint32_t fillerValue;
+
+    // CRC-32C of all of the above fields
+    uint32_t headerCrc;
+};
+
+
+// The first 8 bytes of every compressed file
+#define COMPRESSED_MAGIC "SFGCMPR1"
+
+// The first compressed chunk always starts at this offset in the file
+const uint32_t COMPRESSED_DATA_OFFSET = 4096;
+
+struct compressed_header_t
+{
+    char     magic[8];
+    uint32_t headerSize;
+    uint32_t cellsPerFrame;
+    uint32_t framesPerGroup;
+    uint32_t framesPerChunk;
+    uint64_t frameCount;
+    uint64_t randomSeed;
+    uint64_t indexOffset;
+    uint32_t chunkCount;
+
+    // CRC-32C of the nucleotide, fragment, and distribution input files
+    uint32_t nucleotideCrc;
+    uint32_t fragmentCrc;
+    uint32_t distributionCrc;
+
+    // CRC-32C of all of the above fields
+    uint32_t headerCrc;
+};
+
+// If 'packedSize' == 'rawSize', the chunk didn't compress and is stored as-is
+struct chunk_index_t
+{
+    uint64_t offset;
+    uint32_t packedSize;
+    uint32_t rawSize;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+
+// The first 8 bytes of every event file
+#define EVENTS_MAGIC "SFGEVNT1"
+
+struct event_header_t
+{
+    char     magic[8];
+    uint32_t headerSize;
+    uint32_t cellsPerFrame;
+    uint32_t framesPerGroup;
+    uint32_t fillerValue;
+    uint64_t frameCount;
+    uint64_t randomSeed;
+    uint64_t eventsOffset;
+    uint64_t eventsSize;
+
+    // CRC-32C of the model events
+    uint32_t eventsCrc;
+
+    // CRC-32C of the nucleotide, fragment, and distribution input files
+    uint32_t nucleotideCrc;
+    uint32_t fragmentCrc;
+    uint32_t distributionCrc;
+
+    // CRC-32C of all of the above fields
+    uint32_t headerCrc;
+};
+
+
+// The first 8 bytes of every stripe manifest
+#define STRIPES_MAGIC "SFGSTRP1"
+
+struct stripe_manifest_t
+{
+    char     magic[8];
+    uint32_t headerSize;
+    uint32_t cellsPerFrame;
+    uint32_t framesPerGroup;
+    uint32_t fileCount;
+
+    // 0 if frame groups are striped round-robin, else the number of frame groups in each file
+    uint32_t groupsPerFile;
+    uint32_t fillerValue;
+    uint64_t frameCount;
+    uint64_t randomSeed;
+
+    // The size of the file names, and the CRC-32C of the file table and the file names
+    uint32_t namesSize;
+    uint32_t filesCrc;
+
+    // CRC-32C of the nucleotide, fragment, and distribution input files
+    uint32_t nucleotideCrc;
+    uint32_t fragmentCrc;
+    uint32_t distributionCrc;
+
+    // CRC-32C of all of the above fields
+    uint32_t headerCrc;
+};
+
+// One of these per file.  The CRC-32C is of the frames as they are in RAM, whatever the format
+// of the file.  'firstFrame' is the number of the first frame in the file
+struct stripe_file_t
+{
+    uint64_t firstFrame;
+    uint64_t frameCount;
+    uint32_t crc;
+    uint32_t reserved;
+};
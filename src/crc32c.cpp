@@ -0,0 +1,91 @@
+//=================================================================================================
+// crc32c.cpp - Computes CRC-32C (Castagnoli) checksums
+//
+// On x86-64 machines with SSE 4.2, the checksum is computed 8 bytes at a time with the "crc32"
+// instruction.   Everywhere else we fall back to a table-driven implementation.
+//=================================================================================================
+#include <string.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// The reflected CRC-32C polynomial
+static const uint32_t POLYNOMIAL = 0x82F63B78;
+
+
+//=================================================================================================
+// crc32cSoftware() - Table-driven CRC-32C for machines without CRC instructions
+//=================================================================================================
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t* p, size_t length)
+{
+    // The lookup table gets built (thread-safely) the first time we're called
+    static const struct crc_table_t
+    {
+        uint32_t entry[256];
+        crc_table_t()
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit) value = (value >> 1) ^ ((value & 1) ? POLYNOMIAL : 0);
+                entry[i] = value;
+            }
+        }
+    } table;
+
+    // Run each byte through the table
+    while (length--) crc = table.entry[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+//=================================================================================================
+
+
+#if defined(__x86_64__)
+//=================================================================================================
+// crc32cHardware() - CRC-32C using the SSE 4.2 "crc32" instruction
+//=================================================================================================
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t length)
+{
+    uint64_t crc64 = crc, word;
+
+    // Consume the bulk of the data 8 bytes at a time
+    while (length >= 8)
+    {
+        memcpy(&word, p, 8);
+        crc64   = _mm_crc32_u64(crc64, word);
+        p      += 8;
+        length -= 8;
+    }
+
+    // And consume whatever is left a byte at a time
+    crc = (uint32_t)crc64;
+    while (length--) crc = _mm_crc32_u8(crc, *p++);
+
+    return crc;
+}
+//=================================================================================================
+#endif
+
+
+//=================================================================================================
+// crc32c() - Extends a running CRC-32C with 'length' bytes of data
+//=================================================================================================
+uint32_t crc32c(uint32_t crc, const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)data;
+
+    // The CRC is kept inverted between calls
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    static const bool hasSSE42 = __builtin_cpu_supports("sse4.2");
+    if (hasSSE42) return ~crc32cHardware(crc, p, length);
+#endif
+
+    return ~crc32cSoftware(crc, p, length);
+}
+//=================================================================================================
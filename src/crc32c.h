@@ -0,0 +1,9 @@
+//=================================================================================================
+// crc32c.h - Computes CRC-32C (Castagnoli) checksums, using the CPU's CRC instructions if present
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Extends a running CRC-32C with 'length' bytes of data.  Start a new checksum with crc = 0
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
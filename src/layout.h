@@ -0,0 +1,55 @@
+//=================================================================================================
+// layout.h - Defines the layout descriptor table written next to a raw output file whose frames
+//            are aligned for DMA
+//
+// Normally a raw output file holds its frames back to back, exactly as they sit in the
+// contiguous buffer.  When "ring_alignment" is configured, every frame group (and, if
+// "align_frames" is set, every frame) starts on a multiple of the alignment, and the gaps are
+// padding.  Frame 'n' lives at:
+//
+//     (n / framesPerGroup) * groupStride + (n % framesPerGroup) * frameStride
+//
+// The file is the image of the buffer, padding and all, and the layout table (the output file
+// name with ".layout" appended) describes it:
+//
+//     +-------------------------+  offset 0
+//     | layout_header_t         |
+//     +-------------------------+  offset header.headerSize
+//     | layout_descriptor_t[]   |  One per contiguous run of frame data, in order
+//     +-------------------------+
+//
+// Each descriptor is a single aligned DMA transfer: one per frame group, or one per frame if
+// frames are aligned individually and don't already abut one another.
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+// The first 8 bytes of every layout table
+#define LAYOUT_MAGIC "SFGLYOT1"
+
+struct layout_header_t
+{
+    char     magic[8];
+    uint32_t headerSize;
+    uint32_t cellsPerFrame;
+    uint32_t framesPerGroup;
+    uint32_t alignFrames;
+    uint64_t alignment;
+    uint64_t frameStride;
+    uint64_t groupStride;
+    uint64_t frameCount;
+    uint64_t imageSize;
+    uint64_t descriptorCount;
+
+    // CRC-32C of the descriptor table
+    uint32_t descriptorsCrc;
+
+    // CRC-32C of all of the above fields
+    uint32_t headerCrc;
+};
+
+struct layout_descriptor_t
+{
+    uint64_t offset;
+    uint64_t length;
+};
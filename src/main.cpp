@@ -7,14 +7,51 @@
 //
 //   -config <filename>      : specifies the name of a configuration file
 //
-//   -trace <cell_number>    : instead of creating an output file, traces a cell in an existing 
-//                             file.
+//   -trace <cell_number> [<first_frame> [<last_frame>]] [-model]
+//                           : instead of creating an output file, traces a cell in an existing 
+//                             file.  If -model is given (or the config names no output file),
+//                             the values are worked out from the compiled model instead, without
+//                             building any frames
 //
 //   -dict                   : instead of creating an output file, display data dictionary
 //
+//   -cells <cell> [<last>]  : shows which distribution records cover a cell (or a range of 
+//                             cells), and which of them wins
+//
+//   -overlaps               : lists the pairs of distribution records that have cells in common
+//
 //   -load <filename> <addr> <size_limit>
 //                           : instead of creating output file, loads a file into the specified
-//                             RAM physical address
+//                             RAM physical address.  An address of "auto" loads it into every 
+//                             region reserved with "memmap=" on the kernel command line, and
+//                             "huge:<file>" loads it into hugepages that back a file on a 
+//                             hugetlbfs mount.  A filename of "list:<file>" loads every file
+//                             named in a load list at once, each at its own offset, and a 
+//                             filename of "-" (or a FIFO) loads a stream
+//
+//   -verify <filename>      : checks the CRCs of a container, compressed, or event file
+//
+//   -compare <file1> <file2>: compares the frames in two output files of any format
+//
+//   -resume                 : carries on with an interrupted run from its last checkpoint
+//
+//   -summary <file> [<level>]: displays the summary pyramid of a run, and every tile of one 
+//                             of its levels
+//
+//   -markers <source>       : checks the frame markers in a capture of frames for dropped, 
+//                             duplicated, reordered, or damaged frames.  <source> is a file, or
+//                             "ram:<address>" (or "ram:auto", or "ram:huge:<file>") to check 
+//                             the contiguous buffer in place
+//
+//   -consume <socket>       : attaches to a frame channel as a consumer, reads frames at 
+//                             "consume_rate" frames per second (or as fast as possible), checks
+//                             their frame markers, and reports the throughput
+//
+//   -replay <dest> [<file>] : sends frames to a FIFO, Unix socket, or stdout ("-") at 
+//                             "frame_rate" frames per second.  Frames come from <file> if 
+//                             specified, otherwise they are generated on the fly.  A 
+//                             destination of "channel:<socket>" publishes the frames into a
+//                             shared-memory frame channel
 //
 //=================================================================================================
 
@@ -25,13 +62,37 @@
 #include <fcntl.h>
 #include <cstdarg>
 #include <cstring>
+#include <cstddef>
 #include <iostream>
 #include <memory>
 #include <map>
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #include "config_file.h"
 #include "PhysMem.h"
+#include "OutputFile.h"
+#include "FrameFile.h"
+#include "CompressedFile.h"
+#include "StreamFile.h"
+#include "StreamReader.h"
+#include "StripedFile.h"
+#include "SummaryPyramid.h"
+#include "MarkerChecker.h"
+#include "Consumer.h"
+#include "RingLayout.h"
+#include "CellIndex.h"
+#include "Replayer.h"
+#include "FrameChannel.h"
+#include "checkpoint.h"
+#include "FrameModel.h"
+#include "PatternGenerator.h"
+#include "crc32c.h"
+#include "simd.h"
 #include "changelog.h"
 
 using namespace std;
@@ -42,12 +103,34 @@ void     loadFragments();
 void     loadDistribution();
 uint32_t findLongestSequence();
 uint32_t verifyDistributionIsValid();
+uint32_t framesInBuffer();
+uint32_t testPatternLength();
 void     writeOutputFile(uint32_t frameGroupCount);
+void     writeEventFile(uint32_t frameGroupCount);
+void     compileModel(FrameModel& model, uint64_t frameCount);
 void     parseCommandLine(const char** argv);
 void     trace(uint32_t cellNumber);
+void     traceModel(uint32_t cellNumber);
 void     readConfigurationFile(string filename);
 void     loadFile(string filename, string address);
+void     loadList(string listname, string address);
+void     loadStream(string filename, string address);
+void     mapRAM(const string& address, size_t size);
+void     publishSegments(const string& filename, const string& address);
+void     fillSegments(int fd, const string& filename, uint64_t fileOffset, size_t length);
+void     copyFromFile(int fd, const string& filename, uint64_t fileOffset, uint8_t* dest, size_t length);
+void     verifyFile(string filename);
+void     showSummary(string filename, int level);
+void     checkMarkers(string source);
+void     consume(string socketName);
+void     reportMarkers(MarkerChecker& checker);
+void     compareFiles(string filename1, string filename2);
+void     replay(string destination, string filename);
 void     printDictionary();
+void     buildCellIndex(CellIndex& index);
+void     describeRecord(uint32_t index, const char* note);
+void     showCells(uint32_t firstCell, uint32_t lastCell);
+void     showOverlaps();
 uint64_t stringTo64(const string& str);
 
 // Define a convenient type to encapsulate a vector of strings
@@ -64,6 +147,7 @@ struct distribution_t
 {
     int      first, last, step;
     strvec_t cellValue;
+    int      line;
 };
 vector<distribution_t> distributionList;
 
@@ -86,8 +170,34 @@ struct cmdline_t
     
     bool     trace;
     uint32_t cellNumber;
+    uint64_t firstFrame;
+    uint64_t lastFrame;
+    bool     model;
     
     bool     dict;
+
+    bool     cells;
+    uint32_t firstCell;
+    uint32_t lastCell;
+
+    bool     overlaps;
+
+    bool     verify;
+
+    bool     compare;
+    string   filename2;
+
+    bool     replay;
+    string   destination;
+
+    bool     resume;
+
+    bool     summary;
+    int      level;
+
+    bool     markers;
+
+    bool     consume;
     
     string   config;
 } cmdLine;
@@ -103,12 +213,35 @@ struct config_t
     uint64_t         random_seed;
     uint32_t         cells_per_frame;
     uint64_t         ring_buffer_size;
+    uint64_t         ring_alignment;
+    bool             align_frames;
     uint32_t         data_frames;
     uint8_t          filler_value;
     string           nucleotide_file;
     string           fragment_file;
     string           distribution_file;
     string           output_file;
+    vector<string>   output_stripes;
+    uint32_t         split_groups;
+    bool             write_summary;
+    uint32_t         summary_tile_cells;
+    uint32_t         summary_block_frames;
+    uint32_t         marker_cell;
+    bool             dedup_output;
+    string           output_format;
+    uint32_t         compress_chunk_frames;
+    uint32_t         channel_slots;
+    uint32_t         checkpoint_interval;
+    uint32_t         writeback_mb;
+    double           frame_rate;
+    double           consume_rate;
+    uint32_t         replay_lookahead;
+    string           test_pattern;
+    uint32_t         test_pattern_frames;
+    string           defect_file;
+    double           defect_rate;
+    vector<int32_t>  crosstalk_kernel;
+    uint32_t         crosstalk_shift;
 
 } config;
 //=================================================================================================
@@ -197,10 +330,31 @@ void showHelp()
     printf
     (
         "Usage:\n"
-        "  sfg [-config <filename>]\n"
-        "  sfg -trace <cell_number>\n"
+        "  sfg [-config <filename>] [-resume]\n"
+        "  sfg -trace <cell_number> [<first_frame> [<last_frame>]] [-model]\n"
         "  sfg -dict\n"
+        "  sfg -cells <cell_number> [<last_cell_number>]\n"
+        "  sfg -overlaps\n"
         "  sfg -load <filename> <address> <size_limit>\n"
+        "  sfg -verify <filename>\n"
+        "  sfg -compare <filename1> <filename2>\n"
+        "  sfg -replay <destination> [<filename>]\n"
+        "  sfg -summary <filename> [<level>]\n"
+        "  sfg -markers <filename> | ram:<address>\n"
+        "  sfg -consume <socket>\n"
+        "\n"
+        "  An <address> of \"auto\" uses every region reserved with memmap= on the kernel\n"
+        "  command line, one after the other.\n"
+        "  An <address> of \"huge:<file>\" uses hugepages that back <file> on a hugetlbfs\n"
+        "  mount, and needs no memmap=.  The pages stay allocated until <file> is deleted.\n"
+        "  Either way, the physical segments are written to <filename>.segments\n"
+        "\n"
+        "  A <filename> of \"list:<file>\" loads every file in a load list at once.  Each\n"
+        "  line of the list is \"<filename> <offset>\", the offset in the buffer to load\n"
+        "  that file's frame data at.\n"
+        "\n"
+        "  A <filename> of \"-\" (or the name of a FIFO) loads a stream of raw frames, up\n"
+        "  to <size_limit> bytes of them, or a container, which says how big it is.\n"
         "\n"
         "  <address> and <size_limit> may be expressed in either decimal or hex, and may\n"
         "  include optional K, M, or G suffixes.   Verilog-style underscores are allowed\n"
@@ -261,6 +415,103 @@ void parseCommandLine(const char** argv)
                 cmdLine.cellNumber = atoi(argv[++i]);                
             else
                 throwRuntime("Missing parameter on -trace");                
+
+            // The range of frames is optional
+            cmdLine.firstFrame = 0;
+            cmdLine.lastFrame  = UINT64_MAX;
+            if (argv[i+1] && argv[i+1][0] != '-')
+            {
+                cmdLine.firstFrame = stringTo64(argv[++i]);
+                cmdLine.lastFrame  = cmdLine.firstFrame;
+            }
+            if (argv[i+1] && argv[i+1][0] != '-') cmdLine.lastFrame = stringTo64(argv[++i]);
+            if (cmdLine.lastFrame < cmdLine.firstFrame) throwRuntime("Invalid range of frames on -trace");
+            continue;
+        }
+
+        // Handle the "-model" command line switch
+        if (token == "-model")
+        {
+            cmdLine.model = true;
+            continue;
+        }
+
+        // Handle the "-verify" command line switch
+        if (token == "-verify")
+        {
+            cmdLine.verify = true;
+            if (argv[i+1])
+                cmdLine.filename = argv[++i];
+            else
+                throwRuntime("Missing filename on -verify");
+            continue;
+        }
+
+        // Handle the "-compare" command line switch
+        if (token == "-compare")
+        {
+            cmdLine.compare = true;
+            if (argv[i+1] && argv[i+2])
+            {
+                cmdLine.filename  = argv[++i];
+                cmdLine.filename2 = argv[++i];
+            }
+            else
+                throwRuntime("Missing filename on -compare");
+            continue;
+        }
+
+        // Handle the "-replay" command line switch.  The filename is optional
+        if (token == "-replay")
+        {
+            cmdLine.replay = true;
+            if (argv[i+1])
+                cmdLine.destination = argv[++i];
+            else
+                throwRuntime("Missing destination on -replay");
+            if (argv[i+1] && argv[i+1][0] != '-') cmdLine.filename = argv[++i];
+            continue;
+        }
+
+        // Handle the "-summary" command line switch.  The level is optional
+        if (token == "-summary")
+        {
+            cmdLine.summary = true;
+            cmdLine.level   = -1;
+            if (argv[i+1])
+                cmdLine.filename = argv[++i];
+            else
+                throwRuntime("Missing filename on -summary");
+            if (argv[i+1] && argv[i+1][0] != '-') cmdLine.level = atoi(argv[++i]);
+            continue;
+        }
+
+        // Handle the "-markers" command line switch
+        if (token == "-markers")
+        {
+            cmdLine.markers = true;
+            if (argv[i+1])
+                cmdLine.filename = argv[++i];
+            else
+                throwRuntime("Missing source on -markers");
+            continue;
+        }
+
+        // Handle the "-consume" command line switch
+        if (token == "-consume")
+        {
+            cmdLine.consume = true;
+            if (argv[i+1])
+                cmdLine.destination = argv[++i];
+            else
+                throwRuntime("Missing socket name on -consume");
+            continue;
+        }
+
+        // Handle the "-resume" command line switch
+        if (token == "-resume")
+        {
+            cmdLine.resume = true;
             continue;
         }
 
@@ -271,6 +522,29 @@ void parseCommandLine(const char** argv)
             continue;            
         }
 
+        // Handle the "-cells" command line switch
+        if (token == "-cells")
+        {
+            cmdLine.cells = true;
+            if (argv[i+1])
+                cmdLine.firstCell = stringTo64(argv[++i]);
+            else
+                throwRuntime("Missing cell number on -cells");
+
+            // The last cell is optional
+            cmdLine.lastCell = cmdLine.firstCell;
+            if (argv[i+1] && argv[i+1][0] != '-') cmdLine.lastCell = stringTo64(argv[++i]);
+            if (cmdLine.lastCell < cmdLine.firstCell) throwRuntime("Invalid range of cells on -cells");
+            continue;
+        }
+
+        // Handle the "-overlaps" command line switch
+        if (token == "-overlaps")
+        {
+            cmdLine.overlaps = true;
+            continue;
+        }
+
         // Handle the "-config" command line switch
         if (token == "-config")
         {
@@ -304,16 +578,32 @@ void execute(const char** argv)
     // If we're just loading a data-file into a contig-buffer, make it so
     if (cmdLine.load)
     {
-        loadFile(cmdLine.filename, cmdLine.address);
+        if (cmdLine.filename.compare(0, 5, "list:") == 0)
+            loadList(cmdLine.filename.substr(5), cmdLine.address);
+        else if (StreamFile::isStream(cmdLine.filename.c_str()))
+            loadStream(cmdLine.filename, cmdLine.address);
+        else
+            loadFile(cmdLine.filename, cmdLine.address);
+        exit(0);
+    }
+
+    // If we're verifying a container file, we don't need a configuration file
+    if (cmdLine.verify)
+    {
+        verifyFile(cmdLine.filename);
+        exit(0);
+    }
+
+    // If we're displaying a summary pyramid, we don't need a configuration file either
+    if (cmdLine.summary)
+    {
+        showSummary(cmdLine.filename, cmdLine.level);
         exit(0);
     }
 
     // Fetch the configuration values from the file and populate the global "config" structure
     readConfigurationFile(cmdLine.config);
 
-    // Seed the random number generator
-    srand(config.random_seed);
-
     // If we're supposed to trace a single cell, make it so
     if (cmdLine.trace)
     {
@@ -321,6 +611,34 @@ void execute(const char** argv)
         exit(0);
     }
 
+    // If we're supposed to compare two output files, do so
+    if (cmdLine.compare)
+    {
+        compareFiles(cmdLine.filename, cmdLine.filename2);
+        exit(0);
+    }
+
+    // If we're supposed to check the frame markers in a capture, do so
+    if (cmdLine.markers)
+    {
+        checkMarkers(cmdLine.filename);
+        exit(0);
+    }
+
+    // If we're supposed to act as the consumer of a frame channel, do so
+    if (cmdLine.consume)
+    {
+        consume(cmdLine.destination);
+        exit(0);
+    }
+
+    // If we're supposed to replay frames to a consumer, do so
+    if (cmdLine.replay)
+    {
+        replay(cmdLine.destination, cmdLine.filename);
+        exit(0);
+    }
+
     // Load the nucleotide definitions
     loadNucleotides();
 
@@ -330,6 +648,18 @@ void execute(const char** argv)
     // Load the fragment sequence distribution definitions
     loadDistribution();
 
+    // If we're supposed to report on which distribution records cover which cells, do so
+    if (cmdLine.cells)
+    {
+        showCells(cmdLine.firstCell, cmdLine.lastCell);
+        exit(0);
+    }
+    if (cmdLine.overlaps)
+    {
+        showOverlaps();
+        exit(0);
+    }
+
     // Find out how many frame groups we need to write to the output file
     uint32_t frameGroupCount = verifyDistributionIsValid();
 
@@ -716,6 +1046,7 @@ void loadDistribution()
     char fragmentName[1000];
     distribution_t distRecord;
     string line;
+    int    lineNumber = 0;
 
     // Get a handy reference to the vector of cell values in a distribution record
     auto& drcv = distRecord.cellValue;
@@ -732,6 +1063,9 @@ void loadDistribution()
      // Loop through each line of the input file
     while (getline(file, line))
     {
+        // Keep track of where in the file each distribution record came from
+        distRecord.line = ++lineNumber;
+
         // Get a pointer to the line of text we just read
         const char* p = line.c_str();
 
@@ -807,36 +1141,6 @@ void loadDistribution()
 
 
 
-//=================================================================================================
-// nucleotideToADC() - Return an ADC value that is valid for the specified nucleotide
-//=================================================================================================
-int nucleotideToADC(string name)
-{
-    // Get the name of the nucleotide as a c-string
-    const char* cname = name.c_str();
-
-    // If the name is an integer literal, return its value
-    if (name[0] >= '0' && name[0] <= '9') return to_int(cname);
-    
-    // Does this nucleotide name exist?
-    auto it = nucleotide.find(name);
-
-    // If it doesn't return an empty result
-    if (it == nucleotide.end()) throwRuntime("Unknown nucleotide '%s'", cname);
-
-    // Get a handy reference to the integers that define this nucleotide
-    auto& adc_values = it->second;
-
-    // Select a random index into the vector 'adc_values'
-    int idx = rand() % adc_values.size();
-
-    // And return the ADC value at that random index
-    return adc_values[idx];
-}
-//=================================================================================================
-
-
-
 //=================================================================================================
 // findLongestSequence() - Finds and returns the number of frames requires by the longest sequence
 //                         in the distributionList
@@ -875,11 +1179,38 @@ uint32_t verifyDistributionIsValid()
         exit(1);        
     }
 
+    // Summary tiles are made of whole rows
+    if (config.write_summary && (config.summary_tile_cells == 0 || config.summary_tile_cells % ROW_SIZE != 0))
+    {
+        printf("\nConfig value 'summary_tile_cells' must a multiple of %i\n", ROW_SIZE);
+        exit(1);
+    }
+
+    // The frame marker has to fit inside the frame
+    if (config.marker_cell && config.marker_cell - 1 + sizeof(frame_marker_t) > config.cells_per_frame)
+    {
+        printf("\nConfig value 'marker_cell' must leave room for a %zu cell marker\n", sizeof(frame_marker_t));
+        exit(1);
+    }
+
+    // The ring alignment has to be a power of two
+    if (config.ring_alignment & (config.ring_alignment - 1))
+    {
+        printf("\nConfig value 'ring_alignment' must be a power of two\n");
+        exit(1);
+    }
+
+    // Work out how far apart the frame groups are in the contiguous buffer
+    RingLayout layout;
+    layout.create(config.cells_per_frame, config.data_frames, 0, config.ring_alignment, config.align_frames);
+
     // What's the maximum number of frames that will fit into the contig buffer?
-    uint32_t maxFrames = config.ring_buffer_size / config.cells_per_frame;
+    uint32_t maxFrames = framesInBuffer();
 
-    // What is the maximum number of frames required by any fragment sequence?
+    // What is the maximum number of frames required by any fragment sequence?  A test pattern
+    // doesn't use the fragments, and runs for as long as it's told to
     uint32_t longestSequence = findLongestSequence();
+    if (config.test_pattern != "none") longestSequence = testPatternLength();
 
     // A "frame group" is a set of data frames.
     uint32_t frameGroupLength = config.data_frames;
@@ -892,15 +1223,23 @@ uint32_t verifyDistributionIsValid()
     uint32_t totalReqdFrames = frameGroupCount * frameGroupLength;
 
     // How many bytes will that number of frames occupy in the contiguous buffer?
-    uint64_t totalContigReqd = (uint64_t)totalReqdFrames * (uint64_t)config.cells_per_frame;
+    uint64_t totalContigReqd = (uint64_t)frameGroupCount * layout.groupStride();
 
     // Tell the user basic statistics about this run
-    printf("%'16u Frames in the longest fragment sequence\n", longestSequence);
+    if (config.test_pattern != "none")
+        printf("%'16u Frames in the test pattern\n", longestSequence);
+    else
+        printf("%'16u Frames in the longest fragment sequence\n", longestSequence);
     printf("%'16u Frames in a frame group\n", frameGroupLength);
     printf("%'16u Frame group(s) required\n", frameGroupCount);
     printf("%'16u Frames will fit into the contiguous buffer\n", maxFrames);
     printf("%'16u Frames required in total\n", totalReqdFrames);
     printf("%'16lu Bytes required in total\n", totalContigReqd);
+    if (!layout.isPacked())
+    {
+        printf("%'16lu Bytes between frame groups\n", layout.groupStride());
+        printf("%'16lu Bytes of padding\n", totalContigReqd - (uint64_t)totalReqdFrames * config.cells_per_frame);
+    }
 
     // If the longest fragment sequence is too long to fit into the contiguous buffer,
     // complain and drop dead
@@ -917,362 +1256,1821 @@ uint32_t verifyDistributionIsValid()
 
 
 //=================================================================================================
-// buildDataFrame() - Uses the fragment-sequence distribution list to create a data frame
+// framesInBuffer() - Returns the number of frames that will fit into the contiguous buffer
 //=================================================================================================
-void buildDataFrame(uint8_t* frame, uint32_t frameNumber)
+uint32_t framesInBuffer()
 {
-    // Every cell in the frame starts out quiescient
-    memset(frame, config.filler_value, config.cells_per_frame);
+    RingLayout layout;
+    layout.create(config.cells_per_frame, config.data_frames, 0, config.ring_alignment, config.align_frames);
 
-    // Loop through every distribution record in the distribution list
-    for (auto& dr : distributionList)
-    {
-        // If this fragment sequence contains a value for this frame number...
-        if (frameNumber < dr.cellValue.size())
-        {
-            // Populate the appropriate cells with the data value for this frame
-            for (uint32_t cellNumber = dr.first-1; cellNumber < dr.last; cellNumber += dr.step)
-            {
-                string nucleotideName = dr.cellValue[frameNumber];
-                frame[cellNumber] = nucleotideToADC(nucleotideName);
-            }
-        }
-    }
+    if (!layout.isPacked()) return config.ring_buffer_size / layout.groupStride() * config.data_frames;
+    return config.ring_buffer_size / config.cells_per_frame;
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// writeOutputFile() - Creates the output file
+// testPatternLength() - Returns the number of frames in a test pattern run.  Unless the config
+//                       file says otherwise, the pattern fills the contiguous buffer with as many
+//                       whole frame groups as will fit
 //=================================================================================================
-void writeOutputFile(uint32_t frameGroupCount)
+uint32_t testPatternLength()
 {
-    uint32_t i, frameNumber = 0;
-
-    // Fetch the name of the file we're going to create
-    const char* filename = config.output_file.c_str();
-   
-    // Open the file we're going to write, and complain if we can't
-    FILE* ofile = fopen(filename, "w");
-    if (ofile == nullptr) throwRuntime("Can't create %s", filename);
-
-    // Allocate sufficient RAM to contain an entire raw data frame
-    unique_ptr<uint8_t> framePtr(new uint8_t[config.cells_per_frame]);
-
-    // Get a pointer to the frame data
-    uint8_t* frame  = framePtr.get();
-
-    // Loop through each frame group
-    for (int32_t frameGroup = 0; frameGroup < frameGroupCount; ++frameGroup)
-    {
-        // For each data frame in this frame group...
-        for (i=0; i<config.data_frames; ++i)
-        {
-            // Build the raw data frame for this frame number
-            buildDataFrame(frame, frameNumber++);
-            
-            // And write the resulting frame to the output file
-            fwrite(frame, 1, config.cells_per_frame, ofile);
-        }
-    }
-
-    // We're done with the output file
-    fclose(ofile);
+    if (config.test_pattern_frames) return config.test_pattern_frames;
+    return framesInBuffer() / config.data_frames * config.data_frames;
 }
 //=================================================================================================
 
 
-
-
 //=================================================================================================
-// trace() - Displays the value of a single cell for every frame in the output file
+// fileCrc() - Returns the CRC-32C of the contents of a file
 //=================================================================================================
-void trace(uint32_t cellNumber)
+uint32_t fileCrc(const string& filename)
 {
-    bool first = true;
-
-    // Fetch the name of the file we're going to open
-    const char* filename = config.output_file.c_str();
+    char buffer[0x10000];
+    uint32_t crc = 0;
+    ssize_t  length;
 
-    // Open the file we're going to read, and complain if we can't
-    FILE* ifile = fopen(filename, "r");
-    if (ifile == nullptr) throwRuntime("Can't create %s", filename);
-
-    // Allocate sufficient RAM to contain an entire data frame
-    unique_ptr<uint8_t> framePtr(new uint8_t[config.cells_per_frame]);
+    // Open the file, and complain if we can't
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open %s", filename.c_str());
 
-    // Get a pointer to the frame data
-    uint8_t* frame = framePtr.get();
+    // Fold every byte of the file into the CRC
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) crc = crc32c(crc, buffer, length);
 
-    // Loop through each frame of the file...
-    while (fread(frame, 1, config.cells_per_frame, ifile) == config.cells_per_frame)
-    {
-        
-        // If this isn't the first value we've output, print a comma separator
-        #if 0
-        if (!first) printf(", ");
-        first = false;
-        #endif
-        
-        // And display the value of the cell number that was specified on the command line
-        printf("%d\n", frame[cellNumber]);
-    }
-    
-    // Terminate the line of text in the output
-    printf("\n");
+    // Close the file and hand the caller the CRC
+    close(fd);
+    return crc;
 }
 //=================================================================================================
 
 
-
 //=================================================================================================
-// readConfigurationFile() - Reads in the configuration file and populates the global "config"
-//                           structure.
+// describeRun() - Fills in the fields of a checkpoint that identify this run
 //=================================================================================================
-void readConfigurationFile(string filename)
+void describeRun(checkpoint_t& cp, uint32_t frameGroupCount)
 {
-    CConfigFile cf;
-    string cells_per_frame, ring_buffer_size;
-
-    // Declare a default filename
-    const char* cfilename = "sensor_frame_gen.conf";
-
-    // If the filename passed by the caller isn't blank, that's our filename
-    if (!filename.empty()) cfilename = filename.c_str();
+    memset(&cp, 0, sizeof(cp));
+    memcpy(cp.magic, CHECKPOINT_MAGIC, sizeof(cp.magic));
+    strncpy(cp.outputFormat, config.output_format.c_str(), sizeof(cp.outputFormat) - 1);
+    cp.cellsPerFrame   = config.cells_per_frame;
+    cp.framesPerGroup  = config.data_frames;
+    cp.frameGroupCount = frameGroupCount;
+    cp.fillerValue     = config.filler_value;
+    cp.randomSeed      = config.random_seed;
+    cp.nucleotideCrc   = fileCrc(config.nucleotide_file);
+    cp.fragmentCrc     = fileCrc(config.fragment_file);
+    cp.distributionCrc = fileCrc(config.distribution_file);
+    cp.markerCell      = config.marker_cell;
+    cp.alignFrames     = config.align_frames;
+    cp.ringAlignment   = config.ring_alignment;
+    cp.defectRate      = config.defect_rate;
+    cp.defectCrc       = config.defect_file.empty() ? 0 : fileCrc(config.defect_file);
+    cp.crosstalkCrc    = crc32c(config.crosstalk_shift, config.crosstalk_kernel.data(),
+                                config.crosstalk_kernel.size() * sizeof(int32_t));
+}
+//=================================================================================================
 
-    // Read and parse the configuration file and complain if we can't
-    if (!cf.read(cfilename, false)) throwRuntime("Can't read %s", cfilename);
 
-    // Fetch each configuration
-    cf.get("cells_per_frame",     &cells_per_frame          );
-    cf.get("ring_buffer_size",    &ring_buffer_size         );
-    cf.get("adc_per_nucleotide",  &config.adc_per_nucleotide);
-    cf.get("random_seed",         &config.random_seed       );
-    cf.get("data_frames",         &config.data_frames       );
-    cf.get("filler_value",        &config.filler_value      );
-    cf.get("nucleotide_file",     &config.nucleotide_file   );
-    cf.get("fragment_file",       &config.fragment_file     );
-    cf.get("distribution_file",   &config.distribution_file );
-    cf.get("output_file",         &config.output_file       );
+//=================================================================================================
+// saveCheckpoint() - Records how far the run has gotten.  The checkpoint is written to a 
+//                    temporary file which then replaces the old checkpoint, so there is always
+//                    a complete checkpoint on disk
+//
+// Passed: ofile           = The output file, whose contents are already durable
+//         frameGroupCount = The number of frame groups in the complete run
+//         groupsDone      = The number of frame groups that have been written
+//         randomPosition  = The number of random values consumed so far
+//=================================================================================================
+void saveCheckpoint(OutputFile& ofile, uint32_t frameGroupCount, uint32_t groupsDone,
+                    uint64_t randomPosition)
+{
+    checkpoint_t cp;
+    auto& crcs = ofile.groupCrcs();
+
+    // Describe the run and how far it got
+    describeRun(cp, frameGroupCount);
+    cp.groupsDone     = groupsDone;
+    cp.framesDone     = (uint64_t)groupsDone * config.data_frames;
+    cp.randomPosition = randomPosition;
+    cp.crcCount       = crcs.size();
+    cp.checkpointCrc  = crc32c(0, &cp, offsetof(checkpoint_t, checkpointCrc));
+    cp.checkpointCrc  = crc32c(cp.checkpointCrc, crcs.data(), crcs.size() * sizeof(uint32_t));
+
+    // Write the checkpoint to a temporary file
+    string filename = config.output_file + ".ckpt";
+    string tempname = filename + ".tmp";
+    int fd = open(tempname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) throwRuntime("Can't create %s", tempname.c_str());
+    size_t crcSize = crcs.size() * sizeof(uint32_t);
+    bool ok = write(fd, &cp, sizeof(cp)) == sizeof(cp)
+           && write(fd, crcs.data(), crcSize) == (ssize_t)crcSize
+           && fdatasync(fd) == 0;
+    close(fd);
+    if (!ok) throwRuntime("Can't write %s", tempname.c_str());
 
-    // Convert the scaled integer strings into binary values
-    config.cells_per_frame = stringTo64(cells_per_frame);
-    config.ring_buffer_size     = stringTo64(ring_buffer_size);
+    // And make it the checkpoint
+    if (rename(tempname.c_str(), filename.c_str()) < 0) throwRuntime("Can't create %s", filename.c_str());
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// getFileSize() - Returns the size (in bytes) of the input file
-//
-// Passed:  descriptor = The file descriptor of the file we want the size of
+// resumeOutputFile() - Re-opens the output file of an interrupted run at its last checkpoint
 //
-// Returns: The size of the file in bytes
+// Returns: The number of the first frame group that still needs to be written
 //=================================================================================================
-size_t getFileSize(int descriptor)
+uint32_t resumeOutputFile(OutputFile& ofile, const container_header_t* header, uint32_t frameGroupCount)
 {
-    // Find out how big the file is
-    off64_t result = lseek64(descriptor, 0, SEEK_END);
+    checkpoint_t cp, expected;
+    vector<uint32_t> crcs;
+
+    // Open the checkpoint file and read the checkpoint
+    string filename = config.output_file + ".ckpt";
+    ifstream file(filename, ios::binary);
+    if (!file.read((char*)&cp, sizeof(cp))) throwRuntime("No checkpoint found in %s", filename.c_str());
+
+    // Read the frame group CRCs that follow it
+    if (cp.crcCount > frameGroupCount) throwRuntime("%s is corrupt", filename.c_str());
+    crcs.resize(cp.crcCount);
+    file.read((char*)crcs.data(), crcs.size() * sizeof(uint32_t));
+
+    // Make sure the checkpoint is intact
+    uint32_t crc = crc32c(0, &cp, offsetof(checkpoint_t, checkpointCrc));
+    crc = crc32c(crc, crcs.data(), crcs.size() * sizeof(uint32_t));
+    if (!file || crc != cp.checkpointCrc) throwRuntime("%s is corrupt", filename.c_str());
+
+    // Make sure it's a checkpoint of this very run
+    describeRun(expected, frameGroupCount);
+    if (memcmp(&cp, &expected, offsetof(checkpoint_t, groupsDone)) != 0)
+    {
+        throwRuntime("%s is from a different run", filename.c_str());
+    }
 
-    // Rewind back to the start of the file
-    lseek(descriptor, 0, SEEK_SET);
+    // Pick up the output file where the checkpoint left it
+    ofile.resume(config.output_file.c_str(), config.cells_per_frame, config.dedup_output,
+                 header, cp.framesDone, crcs);
 
-    // And hand the size of the input-file to the caller
-    return result;
+    // Tell the user where we're starting
+    printf("Resuming at frame group %u\n", cp.groupsDone);
+    return cp.groupsDone;
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// fillBuffer() - This stuffs some data into a DMA buffer
-//
-//                          <<< THIS ROUTINE IS A KLUDGE >>>
-//
-// Because of yet unresolved issues with very slow-writes to the DMA buffer, we are reading the
-// file into a local user-space buffer then copying it into the DMA buffer.    For reasons we don't
-// yet understand, the MMU allows us to copy a user-space buffer into the DMA space buffer faster
-// than it allows us to write to it directly.
-//
-//                               <<< THIS IS A HACK >>>
-//
-// The hack will be fixed when we figure out how to write a device driver that can allocate
-// very large contiguous blocks.
-//  
+// describeContainer() - Fills in a container header that describes this run
 //=================================================================================================
-void fillBuffer(int fd, size_t fileSize)
+void describeContainer(container_header_t& header)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CONTAINER_MAGIC, sizeof(header.magic));
+    header.cellsPerFrame   = config.cells_per_frame;
+    header.framesPerGroup  = config.data_frames;
+    header.randomSeed      = config.random_seed;
+    header.nucleotideCrc   = fileCrc(config.nucleotide_file);
+    header.fragmentCrc     = fileCrc(config.fragment_file);
+    header.distributionCrc = fileCrc(config.distribution_file);
+    header.fillerValue     = config.filler_value;
+    header.encoding        = (config.output_format == "sparse") ? ENCODING_FILLER_XOR : ENCODING_NONE;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeOutputFile() - Creates the output file
+//=================================================================================================
+void writeOutputFile(uint32_t frameGroupCount)
+{
+    uint32_t i, firstGroup = 0;
+    FrameModel     model;
+    PatternGenerator patterns;
+    OutputFile     ofile;
+    CompressedFile cfile;
+    StreamFile     sfile;
+    StripedFile    stripes;
+    FrameChannel   channel;
+    SummaryPyramid summary;
+    RingLayout     layout;
+    FrameSink*     sink = &ofile;
+
+    // Is the run spread across several files?
+    bool striped = config.output_stripes.size() > 1 || config.split_groups > 0;
+
+    // Are we writing a synthetic test pattern instead of the modelled frames?
+    bool testPattern = config.test_pattern != "none";
+    if (testPattern) patterns.create(config.test_pattern, config.cells_per_frame, config.marker_cell);
+
+    // A summary is written next to the output file, so there has to be one
+    if (config.write_summary && (config.output_format == "events" || StreamFile::isStream(config.output_file.c_str())))
+    {
+        throwRuntime("write_summary isn't supported for this output");
+    }
+
+    // Frame groups can only be striped across files that hold frames
+    if (striped && config.output_format != "raw" &&
+        config.output_format != "container" && config.output_format != "sparse")
+    {
+        throwRuntime("Only raw, container, and sparse output can be striped");
+    }
+
+    // Only a single raw, container, or sparse output file is checkpointed, so that's all that
+    // can be resumed.  This is checked before anything is created, so a -resume that's turned
+    // down never touches the output
+    if (cmdLine.resume)
+    {
+        bool resumable = config.output_format == "raw" || config.output_format == "container" ||
+                         config.output_format == "sparse";
+        if (!resumable || striped || StreamFile::isStream(config.output_file.c_str()))
+        {
+            throwRuntime("-resume isn't supported for this output");
+        }
+        if (testPattern) throwRuntime("-resume isn't supported for test patterns");
+    }
+
+    // Work out where each frame goes in the contiguous buffer.  Only a raw output file is an
+    // image of the buffer, so that's the only thing that can be padded out
+    layout.create(config.cells_per_frame, config.data_frames, (uint64_t)frameGroupCount * config.data_frames,
+                  config.ring_alignment, config.align_frames);
+    if (!layout.isPacked() && (config.output_format != "raw" || striped || StreamFile::isStream(config.output_file.c_str())))
+    {
+        throwRuntime("ring_alignment only applies to raw output files");
+    }
+
+    // An event file holds a model of the frames rather than the frames themselves
+    if (config.output_format == "events")
+    {
+        if (testPattern) throwRuntime("A test pattern can't be written as events");
+        writeEventFile(frameGroupCount);
+        return;
+    }
+
+    // Fetch the name of the file we're going to create
+    const char* filename = config.output_file.c_str();
+
+    // Create the file we're going to write in the appropriate format.  Streams (stdout or a
+    // FIFO) can't seek, so they can only carry raw frames
+    if (StreamFile::isStream(filename))
+    {
+        if (config.output_format != "raw") throwRuntime("Only raw output can be streamed to %s", filename);
+        sfile.create(filename, config.cells_per_frame);
+        sink = &sfile;
+    }
+    else if (striped)
+    {
+        stripe_manifest_t manifest;
+        memset(&manifest, 0, sizeof(manifest));
+        memcpy(manifest.magic, STRIPES_MAGIC, sizeof(manifest.magic));
+        manifest.cellsPerFrame   = config.cells_per_frame;
+        manifest.framesPerGroup  = config.data_frames;
+        manifest.randomSeed      = config.random_seed;
+        manifest.fillerValue     = config.filler_value;
+        manifest.nucleotideCrc   = fileCrc(config.nucleotide_file);
+        manifest.fragmentCrc     = fileCrc(config.fragment_file);
+        manifest.distributionCrc = fileCrc(config.distribution_file);
+        container_header_t header;
+        describeContainer(header);
+        stripes.create(filename, config.output_stripes, config.split_groups, manifest,
+                       config.dedup_output, config.output_format == "raw" ? nullptr : &header);
+        sink = &stripes;
+    }
+    else if (config.output_format == "raw")
+    {
+        if (!layout.isPacked()) ofile.setLayout(layout.frameStride(), config.data_frames, layout.groupStride());
+        if (cmdLine.resume)
+            firstGroup = resumeOutputFile(ofile, nullptr, frameGroupCount);
+        else
+            ofile.create(filename, config.cells_per_frame, config.dedup_output);
+    }
+    else if (config.output_format == "container" || config.output_format == "sparse")
+    {
+        container_header_t header;
+        describeContainer(header);
+        if (cmdLine.resume)
+            firstGroup = resumeOutputFile(ofile, &header, frameGroupCount);
+        else
+            ofile.create(filename, config.cells_per_frame, config.dedup_output, &header);
+    }
+    else if (config.output_format == "channel")
+    {
+        uint64_t frameCount = (uint64_t)frameGroupCount * config.data_frames;
+        channel.create(filename, config.cells_per_frame, config.data_frames, frameCount, config.channel_slots);
+        printf("Waiting for consumers on %s\n", filename);
+        fflush(stdout);
+        sink = &channel;
+    }
+    else if (config.output_format == "compressed")
+    {
+        compressed_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, COMPRESSED_MAGIC, sizeof(header.magic));
+        header.cellsPerFrame   = config.cells_per_frame;
+        header.framesPerGroup  = config.data_frames;
+        header.framesPerChunk  = config.compress_chunk_frames;
+        header.randomSeed      = config.random_seed;
+        header.nucleotideCrc   = fileCrc(config.nucleotide_file);
+        header.fragmentCrc     = fileCrc(config.fragment_file);
+        header.distributionCrc = fileCrc(config.distribution_file);
+        cfile.create(filename, header);
+        sink = &cfile;
+    }
+    else throwRuntime("Unknown output_format '%s'", config.output_format.c_str());
+
+    // Only a file we can resume gets checkpoints
+    bool checkpointing = (sink == &ofile) && config.checkpoint_interval && !testPattern;
+
+    // Reserve the space for the rest of the output file up front, and keep the page cache from
+    // filling up with dirty pages as we write it
+    if (sink == &ofile)
+    {
+        ofile.preallocate((uint64_t)(frameGroupCount - firstGroup) * config.data_frames);
+        ofile.setWriteBehind((size_t)config.writeback_mb << 20);
+    }
+    else if (sink == &stripes)
+    {
+        stripes.preallocate((uint64_t)frameGroupCount * config.data_frames);
+        stripes.setWriteBehind((size_t)config.writeback_mb << 20);
+    }
+
+    // Compile the distribution list into a model that builds the frames
+    if (!testPattern) compileModel(model, (uint64_t)frameGroupCount * config.data_frames);
+    if (!model.defects().defects().empty())
+    {
+        printf("%'16lu Defective cells\n", model.defects().defects().size());
+    }
+
+    // A test pattern is built in batches of about this many bytes
+    const size_t PATTERN_BATCH_SIZE = 0x800000;
+
+    // Allocate sufficient RAM to contain an entire raw data frame.  A test pattern is built a 
+    // batch of frames at a time, with at least one frame for every core to build
+    uint32_t framesPerBuild = 1;
+    if (testPattern)
+    {
+        size_t frames  = max<size_t>(PATTERN_BATCH_SIZE / config.cells_per_frame, thread::hardware_concurrency());
+        framesPerBuild = max<size_t>(min<size_t>(frames, config.data_frames), 1);
+    }
+    unique_ptr<uint8_t[]> framePtr(new uint8_t[(size_t)framesPerBuild * config.cells_per_frame]);
+
+    // Get a pointer to the frame data
+    uint8_t* frame  = framePtr.get();
+
+    // If we're resuming, this is where we pick up
+    uint64_t frameNumber = (uint64_t)firstGroup * config.data_frames;
+
+    // If we're building a summary of the run, the frames written before a resume have to be 
+    // summarized too.  The model rebuilds them
+    if (config.write_summary)
+    {
+        summary.create(config.cells_per_frame, config.summary_tile_cells,
+                       config.summary_block_frames, config.filler_value);
+        for (uint64_t n = 0; n < frameNumber; ++n)
+        {
+            model.buildFrame(n, frame);
+            summary.addFrame(frame);
+        }
+    }
+
+    // Loop through each frame group
+    for (uint32_t frameGroup = firstGroup; frameGroup < frameGroupCount; ++frameGroup)
+    {
+        // For each data frame in this frame group...
+        for (i=0; i<config.data_frames; ++i)
+        {
+            // Build the raw data frame for this frame number.  A test pattern builds the next
+            // batch of frames, spread across all the cores, each time the last one is used up
+            if (testPattern)
+            {
+                uint32_t slot = i % framesPerBuild;
+                if (slot == 0) patterns.buildFrames(frameNumber, min(framesPerBuild, config.data_frames - i), framePtr.get());
+                frame = framePtr.get() + (size_t)slot * config.cells_per_frame;
+            }
+            else
+                model.buildFrame(frameNumber, frame);
+            ++frameNumber;
+            
+            // And write the resulting frame to the output file
+            sink->writeFrame(frame);
+
+            // If we're summarizing the run, fold this frame into the summary
+            if (config.write_summary) summary.addFrame(frame);
+        }
+
+        // Every so often, make sure what we've written is on disk and record how far we got
+        uint32_t groupsDone = frameGroup + 1;
+        if (checkpointing && groupsDone % config.checkpoint_interval == 0 && groupsDone < frameGroupCount)
+        {
+            ofile.checkpoint();
+            saveCheckpoint(ofile, frameGroupCount, groupsDone, model.drawsBefore(frameNumber));
+        }
+    }
+
+    // We're done with the output file
+    sink->close();
+
+    // Write the summary of the run next to the output file
+    if (config.write_summary) summary.save((config.output_file + ".summary").c_str());
+
+    // The run is complete, so the checkpoint is no longer needed
+    if (sink == &ofile) unlink((config.output_file + ".ckpt").c_str());
+
+    // If the frames are spaced out, write the table that describes where they are.  Otherwise
+    // make sure there's no stale table from an earlier run
+    if (sink == &ofile && !layout.isPacked())
+    {
+        layout.save((config.output_file + ".layout").c_str());
+        printf("%'16lu Layout descriptors written\n", layout.header().descriptorCount);
+    }
+    else if (sink == &ofile || sink == &stripes) unlink((config.output_file + ".layout").c_str());
+
+    // If we compressed the output, tell the user how well that worked
+    if (sink == &cfile)
+    {
+        printf("%'16lu Bytes before compression\n", cfile.rawBytes());
+        printf("%'16lu Bytes after compression\n", cfile.packedBytes());
+    }
+
+    // If we published to a channel, tell the user how often the consumers held us up
+    else if (sink == &channel)
+    {
+        printf("%'16lu Times the ring was full\n", channel.stalls());
+    }
+
+    // If we spread the output across several files, tell the user how many
+    else if (sink == &stripes)
+    {
+        printf("%'16u Output files\n", stripes.fileCount());
+    }
+
+    // If we streamed the output, tell the user how it went
+    else if (sink == &sfile)
+    {
+        printf("%'16lu Bytes streamed%s\n", sfile.bytesWritten(), sfile.isZeroCopy() ? " (zero-copy)" : "");
+    }
+
+    // If we de-duplicated frames, tell the user how much writing that saved
+    else if (config.dedup_output)
+    {
+        printf("%'16lu Bytes written\n", ofile.bytesWritten());
+        printf("%'16lu Bytes deduplicated\n", ofile.bytesDeduplicated());
+    }
+}
+//=================================================================================================
+
+
+
+
+//=================================================================================================
+// compileModel() - Compiles the distribution list into a model that builds the data frames
+//=================================================================================================
+void compileModel(FrameModel& model, uint64_t frameCount)
+{
+    map<string, uint32_t>           nucleotideIndex;
+    map<vector<uint16_t>, uint32_t> sequenceIndex;
+
+    // Describe the frames and the random seed.  srand() only uses the low 32 bits of the seed
+    model.setGeometry(config.cells_per_frame, frameCount, config.filler_value);
+    model.setSeed((uint32_t)config.random_seed);
+    model.setMarkerCell(config.marker_cell);
+
+    // Every nucleotide becomes a list of ADC values
+    for (auto& n : nucleotide)
+    {
+        vector<uint8_t> adc(n.second.begin(), n.second.end());
+        if (adc.empty()) throwRuntime("Nucleotide '%s' has no ADC values", n.first.c_str());
+        nucleotideIndex[n.first] = model.addNucleotide(adc);
+    }
+
+    // Every distribution record becomes a cell set that plays a sequence of symbols
+    for (auto& dr : distributionList)
+    {
+        vector<uint16_t> symbols;
+
+        // Each cell value is either an integer literal or the name of a nucleotide
+        for (auto& name : dr.cellValue)
+        {
+            if (name[0] >= '0' && name[0] <= '9')
+            {
+                symbols.push_back((uint8_t)to_int(name.c_str()));
+                continue;
+            }
+
+            auto it = nucleotideIndex.find(name);
+            if (it == nucleotideIndex.end()) throwRuntime("Unknown nucleotide '%s'", name.c_str());
+            symbols.push_back(FrameModel::NUCLEOTIDE | it->second);
+        }
+
+        // Many distribution records play the same sequence, so each sequence is stored once
+        auto it = sequenceIndex.find(symbols);
+        if (it == sequenceIndex.end())
+        {
+            it = sequenceIndex.insert(make_pair(symbols, model.addSequence(symbols))).first;
+        }
+
+        model.addCellSet(dr.first, dr.last, dr.step, it->second);
+    }
+
+    // Neighbouring cells leak into each other across the rows of the sensor
+    if (!config.crosstalk_kernel.empty()) model.crosstalk().set(config.crosstalk_kernel, config.crosstalk_shift, ROW_SIZE);
+
+    // Scatter defective cells across the sensor, and then add the ones listed in the defect file
+    if (config.defect_rate != 0) model.defects().generate(config.defect_rate, (uint32_t)config.random_seed, config.cells_per_frame);
+    if (!config.defect_file.empty()) model.defects().load(config.defect_file);
+
+    // Work out where in the random sequence each frame starts
+    model.finalize();
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// writeEventFile() - Creates an output file that contains a compiled model of the run instead of
+//                    the data frames
+//=================================================================================================
+void writeEventFile(uint32_t frameGroupCount)
+{
+    FrameModel     model;
+    event_header_t header;
+
+    // Fetch the name of the file we're going to create
+    const char* filename = config.output_file.c_str();
+
+    // Compile the distribution list and turn it into a stream of events
+    compileModel(model, (uint64_t)frameGroupCount * config.data_frames);
+    vector<uint8_t> events = model.serialize();
+
+    // Build the header.  The events immediately follow it
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EVENTS_MAGIC, sizeof(header.magic));
+    header.headerSize      = sizeof(header);
+    header.cellsPerFrame   = config.cells_per_frame;
+    header.framesPerGroup  = config.data_frames;
+    header.fillerValue     = config.filler_value;
+    header.frameCount      = model.frameCount();
+    header.randomSeed      = config.random_seed;
+    header.eventsOffset    = sizeof(header);
+    header.eventsSize      = events.size();
+    header.eventsCrc       = crc32c(0, events.data(), events.size());
+    header.nucleotideCrc   = fileCrc(config.nucleotide_file);
+    header.fragmentCrc     = fileCrc(config.fragment_file);
+    header.distributionCrc = fileCrc(config.distribution_file);
+    header.headerCrc       = crc32c(0, &header, offsetof(event_header_t, headerCrc));
+
+    // Create the output file and complain if we can't
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) throwRuntime("Can't create %s", filename);
+
+    // Write the header and the events
+    bool ok = write(fd, &header, sizeof(header)) == sizeof(header)
+           && write(fd, events.data(), events.size()) == (ssize_t)events.size();
+    close(fd);
+    if (!ok) throwRuntime("Can't write %s", filename);
+
+    // Tell the user how much space that saved
+    printf("%'16lu Bytes of frame data\n", header.frameCount * config.cells_per_frame);
+    printf("%'16lu Bytes written\n", sizeof(header) + events.size());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// trace() - Displays the value of a single cell for every frame in the output file, or for the
+//           range of frames given on the command line
+//=================================================================================================
+void trace(uint32_t cellNumber)
+{
+    bool first = true;
+    FrameFile ifile;
+
+    // Fetch the name of the file we're going to open
+    const char* filename = config.output_file.c_str();
+
+    // If we've been told to (or there's no file to read), the values come from the model.  A
+    // missing output file is an error rather than a reason to quietly trace the model instead
+    if (cmdLine.model || config.output_file.empty())
+    {
+        traceModel(cellNumber);
+        return;
+    }
+
+    // Open the file we're going to read.  If it's a container, it knows its own frame size
+    ifile.open(filename, config.cells_per_frame);
+
+    // Make sure the cell number is actually in the frame
+    if (cellNumber >= ifile.cellsPerFrame()) throwRuntime("Invalid cell number %u", cellNumber);
+
+    // Work out where the range of frames ends
+    uint64_t endFrame = ifile.frameCount();
+    if (cmdLine.lastFrame < endFrame) endFrame = cmdLine.lastFrame + 1;
+
+    // Loop through each frame in the range...
+    for (uint64_t frameNumber = cmdLine.firstFrame; frameNumber < endFrame; ++frameNumber)
+    {
+        
+        // If this isn't the first value we've output, print a comma separator
+        #if 0
+        if (!first) printf(", ");
+        first = false;
+        #endif
+        
+        // And display the value of the cell number that was specified on the command line
+        printf("%d\n", ifile.cell(frameNumber, cellNumber));
+    }
+    
+    // Terminate the line of text in the output
+    printf("\n");
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// traceModel() - Displays the value of a single cell in a range of frames, worked out from the
+//                compiled model rather than read from a file.  Nothing has to be written (or
+//                even fit into the contiguous buffer), and no frames are built
+//=================================================================================================
+void traceModel(uint32_t cellNumber)
+{
+    FrameModel model;
+
+    // A test pattern is cheap enough to simply build the frames
+    if (config.test_pattern != "none")
+    {
+        PatternGenerator patterns;
+        patterns.create(config.test_pattern, config.cells_per_frame, config.marker_cell);
+        if (cellNumber >= config.cells_per_frame) throwRuntime("Invalid cell number %u", cellNumber);
+        uint64_t endFrame = (testPatternLength() + config.data_frames - 1) / config.data_frames * config.data_frames;
+        if (cmdLine.lastFrame < endFrame) endFrame = cmdLine.lastFrame + 1;
+        unique_ptr<uint8_t[]> frame(new uint8_t[config.cells_per_frame]);
+        for (uint64_t n = cmdLine.firstFrame; n < endFrame; ++n)
+        {
+            patterns.buildFrame(n, frame.get());
+            printf("%d\n", frame[cellNumber]);
+        }
+        printf("\n");
+        return;
+    }
+
+    // Compile the model of the run
+    loadNucleotides();
+    loadFragments();
+    loadDistribution();
+    uint64_t frameGroupCount = (findLongestSequence() + config.data_frames - 1) / config.data_frames;
+    compileModel(model, frameGroupCount * config.data_frames);
+
+    // Work out where the range of frames ends
+    uint64_t endFrame = model.frameCount();
+    if (cmdLine.lastFrame < endFrame) endFrame = cmdLine.lastFrame + 1;
+
+    // Fetch the value of the cell in every frame in the range
+    vector<uint8_t> values(endFrame > cmdLine.firstFrame ? endFrame - cmdLine.firstFrame : 0);
+    model.traceCell(cellNumber, cmdLine.firstFrame, values.size(), values.data());
+
+    // And display them the same way trace() does
+    for (auto value : values) printf("%d\n", value);
+    printf("\n");
+}
+//=================================================================================================
+
+
+
+//=================================================================================================
+// readConfigurationFile() - Reads in the configuration file and populates the global "config"
+//                           structure.
+//=================================================================================================
+void readConfigurationFile(string filename)
+{
+    CConfigFile cf;
+    string cells_per_frame, ring_buffer_size, ring_alignment = "0";
+
+    // Declare a default filename
+    const char* cfilename = "sensor_frame_gen.conf";
+
+    // If the filename passed by the caller isn't blank, that's our filename
+    if (!filename.empty()) cfilename = filename.c_str();
+
+    // Read and parse the configuration file and complain if we can't
+    if (!cf.read(cfilename, false)) throwRuntime("Can't read %s", cfilename);
+
+    // Fetch each configuration
+    cf.get("cells_per_frame",     &cells_per_frame          );
+    cf.get("ring_buffer_size",    &ring_buffer_size         );
+    cf.get("adc_per_nucleotide",  &config.adc_per_nucleotide);
+    cf.get("random_seed",         &config.random_seed       );
+    cf.get("data_frames",         &config.data_frames       );
+    cf.get("filler_value",        &config.filler_value      );
+    cf.get("nucleotide_file",     &config.nucleotide_file   );
+    cf.get("fragment_file",       &config.fragment_file     );
+    cf.get("distribution_file",   &config.distribution_file );
+    cf.get("output_file",         &config.output_stripes    );
+
+    // The remaining configuration values are optional
+    cf.throw_on_fail(false);
+    config.dedup_output = false;
+    cf.get("dedup_output",        &config.dedup_output      );
+    config.output_format = "raw";
+    cf.get("output_format",       &config.output_format     );
+    config.compress_chunk_frames = 16;
+    cf.get("compress_chunk_frames", &config.compress_chunk_frames);
+    config.checkpoint_interval = 16;
+    cf.get("checkpoint_interval", &config.checkpoint_interval);
+    config.split_groups = 0;
+    cf.get("split_groups",        &config.split_groups      );
+    config.write_summary = false;
+    cf.get("write_summary",       &config.write_summary     );
+    config.summary_tile_cells = ROW_SIZE;
+    cf.get("summary_tile_cells",  &config.summary_tile_cells);
+    config.summary_block_frames = 16;
+    cf.get("summary_block_frames", &config.summary_block_frames);
+    config.marker_cell = 0;
+    cf.get("marker_cell",         &config.marker_cell       );
+    cf.get("ring_alignment",      &ring_alignment           );
+    config.align_frames = false;
+    cf.get("align_frames",        &config.align_frames      );
+    config.writeback_mb = 64;
+    cf.get("writeback_mb",        &config.writeback_mb      );
+    config.channel_slots = 64;
+    cf.get("channel_slots",       &config.channel_slots     );
+    config.frame_rate = 100;
+    cf.get("frame_rate",          &config.frame_rate        );
+    config.consume_rate = 0;
+    cf.get("consume_rate",        &config.consume_rate      );
+    config.replay_lookahead = 64;
+    cf.get("replay_lookahead",    &config.replay_lookahead  );
+    config.test_pattern = "none";
+    cf.get("test_pattern",        &config.test_pattern      );
+    config.test_pattern_frames = 0;
+    cf.get("test_pattern_frames", &config.test_pattern_frames);
+    config.defect_file = "";
+    cf.get("defect_file",         &config.defect_file       );
+    config.defect_rate = 0;
+    cf.get("defect_rate",         &config.defect_rate       );
+    config.crosstalk_kernel.clear();
+    cf.get("crosstalk_kernel",    &config.crosstalk_kernel  );
+    config.crosstalk_shift = 4;
+    cf.get("crosstalk_shift",     &config.crosstalk_shift   );
+
+    // If there are several output files, frame groups are striped across them, and the manifest
+    // that describes them is what everything else treats as the output file.  If the output is
+    // split, the frame groups go in numbered files and the manifest takes the name itself
+    config.output_file = config.output_stripes[0];
+    if (config.output_stripes.size() > 1) config.output_file += ".stripes";
+
+    // Convert the scaled integer strings into binary values
+    config.cells_per_frame = stringTo64(cells_per_frame);
+    config.ring_buffer_size     = stringTo64(ring_buffer_size);
+    config.ring_alignment       = stringTo64(ring_alignment);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// getFileSize() - Returns the size (in bytes) of the input file
+//
+// Passed:  descriptor = The file descriptor of the file we want the size of
+//
+// Returns: The size of the file in bytes
+//=================================================================================================
+size_t getFileSize(int descriptor)
+{
+    // Find out how big the file is
+    off64_t result = lseek64(descriptor, 0, SEEK_END);
+
+    // Rewind back to the start of the file
+    lseek(descriptor, 0, SEEK_SET);
+
+    // And hand the size of the input-file to the caller
+    return result;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// fillBuffer() - This stuffs some data into a DMA buffer
+//
+//                          <<< THIS ROUTINE IS A KLUDGE >>>
+//
+// Because of yet unresolved issues with very slow-writes to the DMA buffer, we are reading the
+// file into a local user-space buffer then copying it into the DMA buffer.    For reasons we don't
+// yet understand, the MMU allows us to copy a user-space buffer into the DMA space buffer faster
+// than it allows us to write to it directly.
+//
+//                               <<< THIS IS A HACK >>>
+//
+// The hack will be fixed when we figure out how to write a device driver that can allocate
+// very large contiguous blocks.
+//  
+//=================================================================================================
+void fillBuffer(int fd, size_t fileSize)
 {
     // We will load the file into the buffer in blocks of data this size (i.e, 1 GB)
     const uint32_t FRAME_SIZE = 0x40000000;
 
-    // This is the number of bytes that have been loaded into the buffer
-    uint64_t bytesLoaded = 0;
+    // This is the number of bytes that have been loaded into the buffer
+    uint64_t bytesLoaded = 0;
+
+    // Get a pointer to the start of the contiguous buffer
+    uint8_t* ptr = RAM.bptr();
+
+    // Allocate a RAM buffer in userspace
+    uint8_t* localBuffer = new uint8_t[FRAME_SIZE];
+
+    // Compute how many bytes of data to load...
+    uint64_t bytesRemaining = fileSize;
+
+    // Display the completion percentage
+    printf("Percent loaded =   0");
+    fflush(stdout);
+
+    // While there is still data to load from the file...
+    while (bytesRemaining)
+    {
+        // We'd like to load the entire remainder of the file
+        size_t blockSize = bytesRemaining;
+
+        // We're going to load this file in chunks of no more than 1 GB
+        if (blockSize > FRAME_SIZE) blockSize = FRAME_SIZE;
+
+        // Load this chunk of the file into our local user-space buffer
+        size_t rc = read(fd, localBuffer, blockSize);
+        if (rc != blockSize)
+        {
+            perror("\nread");
+            exit(1);
+        }
+
+        // Copy the userspace buffer into the contiguous block of physical RAM
+        memcpy(ptr, localBuffer, blockSize);
+
+        // Bump the pointer to where the next chunk will be stored
+        ptr += blockSize;
+
+        // And keep track of how many bytes are left to load
+        bytesRemaining -= blockSize;
+
+        // Compute and display the completion percentage
+        bytesLoaded += blockSize;
+        int pct = 100 * bytesLoaded / fileSize;
+        printf("\b\b\b%3i", pct);
+        fflush(stdout);
+    }
+
+    // Finish the "percent complete" display
+    printf("\b\b\b100\n");
+
+    // Free up the localBuffer so we don't leak memory
+    delete[] localBuffer;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// copyFromFile() - Copies part of a file into the contiguous buffer.  Like fillBuffer(), it 
+//                  reads into a local buffer and copies from there
+//
+// Passed:  fd         = The file descriptor of the input file
+//          filename   = The name of the input file, for error messages
+//          fileOffset = The offset in the file to copy from
+//          dest       = Where in the contiguous buffer to copy to
+//          length     = The number of bytes to copy
+//=================================================================================================
+void copyFromFile(int fd, const string& filename, uint64_t fileOffset, uint8_t* dest, size_t length)
+{
+    // We copy in blocks of data no bigger than this
+    const size_t BLOCK_SIZE = 0x4000000;
+
+    unique_ptr<uint8_t[]> localBuffer(new uint8_t[min(BLOCK_SIZE, length)]);
+
+    for (size_t done = 0; done < length;)
+    {
+        size_t  blockSize = min(BLOCK_SIZE, length - done);
+        ssize_t got = pread(fd, localBuffer.get(), blockSize, fileOffset + done);
+        if (got != (ssize_t)blockSize)
+        {
+            throwRuntime("%s: %s", filename.c_str(), got < 0 ? strerror(errno) : "unexpected end of file");
+        }
+        memcpy(dest + done, localBuffer.get(), blockSize);
+        done += blockSize;
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// fillSegments() - Loads frame data into a buffer that spans several regions of RAM, with one
+//                  thread per NUMA node, running on that node and filling that node's regions
+//
+// Passed:  fd         = The file descriptor of the input file
+//          filename   = The name of the input file, for error messages
+//          fileOffset = The offset in the file where the frame data starts
+//          length     = The number of bytes of frame data
+//=================================================================================================
+void fillSegments(int fd, const string& filename, uint64_t fileOffset, size_t length)
+{
+    // Sort the regions by node.  A buffer made of hugepages can have thousands of them
+    map<int, vector<PhysMem::segment_t>> nodes;
+    for (auto& s : RAM.segments()) if (s.offset < length) nodes[s.node].push_back(s);
+
+    // An exception can't leave a thread, so each thread hands its error back to us
+    vector<thread> threads;
+    vector<exception_ptr> errors(nodes.size());
+    for (auto& node : nodes)
+    {
+        exception_ptr& error = errors[threads.size()];
+        threads.emplace_back([&node, &error, &filename, fd, fileOffset, length]()
+        {
+            try
+            {
+                // Run on the node the regions belong to, so our local buffer is allocated there
+                PhysMem::bindToNode(node.first);
+
+                for (auto& s : node.second)
+                {
+                    size_t count = min(s.size, length - s.offset);
+                    copyFromFile(fd, filename, fileOffset + s.offset, RAM.bptr() + s.offset, count);
+                }
+            }
+            catch (...)
+            {
+                error = current_exception();
+            }
+        });
+    }
+
+    // Wait for every region to be loaded, and complain if any of them couldn't be
+    for (auto& t : threads) t.join();
+    for (auto& error : errors) if (error) rethrow_exception(error);
+    printf("Loaded %'lu bytes into %zu regions on %zu nodes\n", length, RAM.segments().size(), nodes.size());
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// stringTo64() - Converts a character string to a 64-bit integer after stripping out any
+//                underscore characters from the input string.  Also scales the return value
+//                according to any K, M, or G suffix on the string
+//=================================================================================================
+uint64_t stringTo64(const string& str)
+{
+    char buffer[100], *out = buffer;
+    uint64_t multiplier = 0;
+
+    // Point to the beginning of the input string
+    const char* in = str.c_str();
+
+    // This loop is going to strip underscores from the input string
+    while (*in)
+    {
+        // If we've reached the end of the input string, we're done
+        if (*in == 0) break;
+
+        // If we're at the last character of the output buffer, we're done
+        if ((out - buffer) == sizeof(buffer)-1) break;
+
+        // If the input character is an underscore, skip it
+        if (*in == '_')
+        {
+            ++in;
+            continue;
+        }
+
+        // Move the input character to the output buffer
+        *out++ = *in++;
+    }
+
+    // Nul-terminate the output string
+    *out = 0;
+
+    // If the buffer is empty, the result is 0
+    if (buffer[0] == 0) return 0;
+
+    // Fetch the final character
+    char letter = *(out-1);
+
+    // Use the suffix (if any) to determine the multiplier
+         if (letter >= '0' && letter <= '9') multiplier = 1;
+    else if (letter >= 'a' && letter <= 'f') multiplier = 1;
+    else if (letter >= 'A' && letter <= 'F') multiplier = 1;
+    else if (letter == 'K') multiplier = 1024;
+    else if (letter == 'M') multiplier = 1024 * 1024;
+    else if (letter == 'G') multiplier = 1024 * 1024 * 1024;
+
+    // If an invalid suffix was specified, whine about it
+    if (multiplier == 0) throwRuntime("Invalid suffix on %s", str.c_str());
+
+    // If there was a suffix on the string, remove it
+    if (multiplier > 1) *(out-1) = 0;
+
+    // Convert the ASCII string to a numeric value
+    int64_t value = stoull(buffer, 0, radix(buffer));
+
+    // Hand the resulting value to the caller
+    return value * multiplier;
+}
+//=================================================================================================
+
+
+
+//=================================================================================================
+// mapRAM() - Maps the contiguous buffer into user-space
+//
+// Passed:  address = A physical address, "auto" for every region reserved with "memmap=", or
+//                    "huge:<filename>" for the hugepages behind a file on a hugetlbfs mount
+//          size    = The number of bytes at a physical address to map, or the minimum size of
+//                    a hugepage buffer (0 maps it as it is).  Ignored for "auto"
+//=================================================================================================
+void mapRAM(const string& address, size_t size)
+{
+    // Every region reserved with "memmap=", back to back
+    if (address == "auto")
+    {
+        RAM.map();
+        return;
+    }
+
+    // Hugepages, which need no reservation at boot
+    if (address.compare(0, 5, "huge:") == 0)
+    {
+        RAM.mapHugePages(address.substr(5).c_str(), size);
+        return;
+    }
+
+    // Convert the string-form of the address to binary
+    uint64_t physAddr = stringTo64(address);
+
+    // Make at least minimal effort to ensure the user doesn't blow away their system
+    if (physAddr == 0) throwRuntime("Mapping RAM address 0 not permitted");
+
+    // Map the physical RAM space
+    RAM.map(physAddr, size);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// publishSegments() - Tells the user (and whatever programs the DMA engine) where the regions of
+//                     the contiguous buffer are
+//
+// Passed:  filename = The file being loaded.  The segment table is written next to it
+//          address   = The address the buffer was mapped with
+//=================================================================================================
+void publishSegments(const string& filename, const string& address)
+{
+    // Unless the user told us where the buffer is, the DMA engine needs to be told
+    if (address == "auto" || address.compare(0, 5, "huge:") == 0)
+    {
+        RAM.saveSegments((filename + ".segments").c_str());
+    }
+
+    // If the buffer is made of a few regions, show the user where they are
+    if (RAM.segments().size() > 1 && RAM.segments().size() <= 16) for (auto& s : RAM.segments())
+    {
+        printf("%'16lu Bytes at 0x%lx on node %d\n", s.size, s.physAddr, s.node);
+    }
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// loadFile() - Loads a data-file into RAM at a defined physical address
+//=================================================================================================
+void loadFile(string filename, string address)
+{
+    // Ensure that we're running as the root user
+    if (geteuid() != 0) throw runtime_error("Must be root to run.  Use sudo.");
+
+    // Open the data file
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open '%s'", filename.c_str());
+
+    // Find out how big the input file is
+    size_t fileSize = getFileSize(fd);
+
+    // If the file is a container, check its CRCs and load only the frame data.  If the file is
+    // compressed, we need to know how big it is once it's decompressed
+    FrameFile container;
+    container.open(filename.c_str(), 1);
+    if (container.isContainer())
+    {
+        if (!container.verify().empty()) throwRuntime("%s failed CRC check", filename.c_str());
+        lseek64(fd, container.dataOffset(), SEEK_SET);
+    }
+    fileSize = container.dataSize();
+
+    // Find out how large our contiguous buffer is
+    size_t sizeLimit = stringTo64(cmdLine.sizeLimit);
+
+    // Ensure that the file doesn't exceed the size of the buffer it's being loaded in to
+    if (fileSize > sizeLimit) throwRuntime("%s is too big to fit into buffer", filename.c_str());
+
+    // Tell the user what we're doing...
+    printf("Mapping RAM...\n");
+
+    // Map the RAM we're loading the file into
+    mapRAM(address, fileSize);
+    if (fileSize > RAM.getSize()) throwRuntime("%s is too big to fit into reserved RAM", filename.c_str());
+
+    // Tell the user and the DMA engine where the buffer is
+    publishSegments(filename, address);
+
+    // If the frames are laid out for DMA, the alignment only means something if every region
+    // of the buffer is aligned the same way
+    RingLayout layout;
+    if (layout.load((filename + ".layout").c_str()))
+    {
+        uint64_t alignment = layout.header().alignment;
+        for (auto& s : RAM.segments()) if (alignment && (s.physAddr - s.offset) % alignment)
+        {
+            throwRuntime("%s is laid out for a buffer aligned to %lu bytes", filename.c_str(), alignment);
+        }
+    }
+
+    // Tell the user what's taking so long...
+    printf("Loading %s into RAM at address %s\n", filename.c_str(), address.c_str());
+
+    // Load the data file into the RAM buffer.  Compressed, sparse, and event files are decoded 
+    // (or rebuilt) in parallel.  If the buffer spans several regions, each is filled by a 
+    // thread running on its own NUMA node
+    if (!container.isRawData())
+        container.copyTo(RAM.bptr());
+    else if (RAM.segments().size() > 1)
+        fillSegments(fd, filename, container.dataOffset(), fileSize);
+    else
+        fillBuffer(fd, fileSize);
+
+    // Close the input file, we're done
+    close(fd);
+}
+//=================================================================================================
+
+
+
+//=================================================================================================
+// loadList() - Loads every data-file named in a load list into RAM at once
+//
+// The load list is a text file with one "<filename> <offset>" per line, where <offset> is where
+// in the contiguous buffer the file's frame data goes, and may have a K, M, or G suffix.  Blank
+// lines and lines that start with '#' are ignored.  Every file is opened and checked before
+// anything is mapped, so a bad list never leaves the buffer half loaded.  Then the buffer is 
+// mapped once and the files are loaded in parallel
+//=================================================================================================
+void loadList(string listname, string address)
+{
+    // One of these for every file on the list
+    struct entry_t
+    {
+        string                filename;
+        uint64_t              offset;
+        uint64_t              size;
+        unique_ptr<FrameFile> file;
+    };
+    vector<entry_t> entries;
+    uint64_t        alignment = 0;
+    string          line;
+
+    // Ensure that we're running as the root user
+    if (geteuid() != 0) throw runtime_error("Must be root to run.  Use sudo.");
+
+    // Open the load list
+    ifstream list(listname);
+    if (!list.is_open()) throwRuntime("Can't open '%s'", listname.c_str());
+
+    // Open every file on it.  Containers have their CRCs checked, and compressed files tell us
+    // how big they are once they're decompressed
+    while (getline(list, line))
+    {
+        string filename, offset;
+        istringstream words(line);
+        if (!(words >> filename) || filename[0] == '#') continue;
+        if (!(words >> offset)) throwRuntime("No offset for %s in %s", filename.c_str(), listname.c_str());
+
+        entries.push_back({filename, stringTo64(offset), 0, unique_ptr<FrameFile>(new FrameFile)});
+        auto& file = *entries.back().file;
+        file.open(filename.c_str(), 1);
+        if (file.isContainer() && !file.verify().empty()) throwRuntime("%s failed CRC check", filename.c_str());
+        entries.back().size = file.dataSize();
+    }
+    if (entries.empty()) throwRuntime("%s doesn't name any files", listname.c_str());
+
+    // Find out how large our contiguous buffer is
+    size_t sizeLimit = stringTo64(cmdLine.sizeLimit);
+
+    // Every file has to fit in the buffer without overlapping any other, and a file that's laid
+    // out for DMA has to start on a multiple of its alignment
+    sort(entries.begin(), entries.end(), [](const entry_t& a, const entry_t& b) {return a.offset < b.offset;});
+    uint64_t end = 0, totalSize = 0;
+    for (auto& e : entries)
+    {
+        totalSize += e.size;
+        if (e.offset < end) throwRuntime("%s overlaps the file before it", e.filename.c_str());
+        end = e.offset + e.size;
+        if (end > sizeLimit) throwRuntime("%s is too big to fit into buffer", e.filename.c_str());
+
+        RingLayout layout;
+        if (layout.load((e.filename + ".layout").c_str()))
+        {
+            uint64_t fileAlignment = layout.header().alignment;
+            if (fileAlignment && e.offset % fileAlignment)
+            {
+                throwRuntime("%s has to be at a multiple of %lu bytes", e.filename.c_str(), fileAlignment);
+            }
+            alignment = max(alignment, fileAlignment);
+        }
+    }
+
+    // Map the RAM once, for all of the files
+    printf("Mapping RAM...\n");
+    mapRAM(address, end);
+    if (end > RAM.getSize()) throwRuntime("%s is too big to fit into reserved RAM", listname.c_str());
+
+    // The alignments only mean something if every region of the buffer is aligned the same way
+    for (auto& s : RAM.segments()) if (alignment && (s.physAddr - s.offset) % alignment)
+    {
+        throwRuntime("%s is laid out for a buffer aligned to %lu bytes", listname.c_str(), alignment);
+    }
+
+    // Tell the user and the DMA engine where the buffer is
+    publishSegments(listname, address);
+
+    // Tell the user what's taking so long...
+    printf("Loading %zu files into RAM at address %s\n", entries.size(), address.c_str());
+
+    // Loads a single file.  It runs in a thread of its own, on the node that the file's part of
+    // the buffer belongs to.  An exception can't leave a thread, so it hands its error back to us
+    vector<exception_ptr> errors(entries.size());
+    auto loadEntry = [&](size_t i)
+    {
+        auto& e = entries[i];
+        try
+        {
+            for (auto& s : RAM.segments())
+            {
+                if (e.offset >= s.offset && e.offset < s.offset + s.size) PhysMem::bindToNode(s.node);
+            }
+
+            // Compressed, sparse, and event files are decoded (or rebuilt)
+            uint8_t* dest = RAM.bptr() + e.offset;
+            if (!e.file->isRawData())
+            {
+                e.file->copyTo(dest);
+                return;
+            }
+
+            // Raw frame data is copied straight in
+            int fd = open(e.filename.c_str(), O_RDONLY);
+            if (fd < 0) throwRuntime("%s: %s", e.filename.c_str(), strerror(errno));
+            try
+            {
+                copyFromFile(fd, e.filename, e.file->dataOffset(), dest, e.size);
+            }
+            catch (...)
+            {
+                close(fd);
+                throw;
+            }
+            close(fd);
+        }
+        catch (...)
+        {
+            errors[i] = current_exception();
+        }
+    };
+
+    // Raw files are copied by a pool of one worker per core, each taking the next file on the
+    // list until there are none left.  Every other file is decoded across all of the cores by
+    // copyTo(), so those are loaded one at a time after the raw files
+    vector<size_t> raw, decoded;
+    for (size_t i = 0; i < entries.size(); ++i) (entries[i].file->isRawData() ? raw : decoded).push_back(i);
+
+    atomic<size_t> next(0);
+    uint32_t workerCount = max(thread::hardware_concurrency(), 1u);
+    if (workerCount > raw.size()) workerCount = raw.size();
+    vector<thread> workers;
+    for (uint32_t w = 0; w < workerCount; ++w) workers.emplace_back([&]()
+    {
+        for (size_t n = next++; n < raw.size(); n = next++) loadEntry(raw[n]);
+    });
+    for (auto& t : workers) t.join();
+
+    for (size_t i : decoded) thread(loadEntry, i).join();
+
+    // Complain if any of the files couldn't be loaded
+    for (auto& error : errors) if (error) rethrow_exception(error);
+    printf("Loaded %'lu bytes from %zu files\n", totalSize, entries.size());
+}
+//=================================================================================================
+
+
+
+//=================================================================================================
+// loadStream() - Loads frame data from stdin or a FIFO into RAM
+//
+// A stream can't be asked how big it is.  If it's a container, the header says how much frame
+// data is coming, and the CRCs in the trailer are checked once it has all arrived.  Otherwise
+// it's raw frame data that runs until the end of the stream, and must fit in <size_limit>.
+// The stream is read by a thread of its own, so the next block arrives while we copy the last
+// one into the buffer
+//=================================================================================================
+void loadStream(string filename, string address)
+{
+    // The stream is read in blocks of this size
+    const size_t BLOCK_SIZE = 0x4000000;
+
+    container_header_t header;
+    StreamReader       reader;
+    uint8_t*           data;
+
+    // Ensure that we're running as the root user
+    if (geteuid() != 0) throw runtime_error("Must be root to run.  Use sudo.");
 
-    // Get a pointer to the start of the contiguous buffer
-    uint8_t* ptr = RAM.bptr();
+    // Open the stream.  "-" is stdin
+    int fd = (filename == "-") ? STDIN_FILENO : open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throwRuntime("Can't open '%s'", filename.c_str());
+    reader.start(fd, BLOCK_SIZE);
 
-    // Allocate a RAM buffer in userspace
-    uint8_t* localBuffer = new uint8_t[FRAME_SIZE];
+    // Find out how large our contiguous buffer is
+    size_t sizeLimit = stringTo64(cmdLine.sizeLimit);
 
-    // Compute how many bytes of data to load...
-    uint64_t bytesRemaining = fileSize;
+    // Find out whether the stream is a container.  If it isn't, what we've read is frame data
+    bool isContainer = reader.read(&header, sizeof(header)) && memcmp(header.magic, CONTAINER_MAGIC, 8) == 0;
+    size_t prefixSize = isContainer ? 0 : reader.bytesRead();
 
-    // Display the completion percentage
-    printf("Percent loaded =   0");
-    fflush(stdout);
+    // Compressed files, event files, and stripe manifests can only be decoded with random access
+    for (const char* magic : {COMPRESSED_MAGIC, EVENTS_MAGIC, STRIPES_MAGIC})
+    {
+        if (prefixSize >= 8 && memcmp(header.magic, magic, 8) == 0) throwRuntime("%s can't be loaded from a stream", filename.c_str());
+    }
 
-    // While there is still data to load from the file...
-    while (bytesRemaining)
+    // A container tells us how much data is coming.  Skip to the start of it
+    uint64_t loadSize = sizeLimit;
+    if (isContainer)
     {
-        // We'd like to load the entire remainder of the file
-        size_t blockSize = bytesRemaining;
+        if (header.headerCrc != crc32c(0, &header, offsetof(container_header_t, headerCrc)))
+        {
+            throwRuntime("%s has a corrupt header", filename.c_str());
+        }
+        if (header.encoding != ENCODING_NONE && header.encoding != ENCODING_FILLER_XOR)
+        {
+            throwRuntime("%s has unknown encoding %u", filename.c_str(), header.encoding);
+        }
+        if (header.dataSize > sizeLimit) throwRuntime("%s is too big to fit into buffer", filename.c_str());
+        for (uint64_t skip = header.dataOffset - sizeof(header); skip;)
+        {
+            size_t count = reader.next(&data, skip);
+            if (count == 0) throwRuntime("%s ended early", filename.c_str());
+            skip -= count;
+        }
+        loadSize = header.dataSize;
+    }
 
-        // We're going to load this file in chunks of no more than 1 GB
-        if (blockSize > FRAME_SIZE) blockSize = FRAME_SIZE;
+    // Tell the user what we're doing...
+    printf("Mapping RAM...\n");
 
-        // Load this chunk of the file into our local user-space buffer
-        size_t rc = read(fd, localBuffer, blockSize);
-        if (rc != blockSize)
+    // Map the RAM we're loading the stream into.  A raw stream can have as much of it as there is
+    mapRAM(address, loadSize);
+    if (isContainer && loadSize > RAM.getSize()) throwRuntime("%s is too big to fit into reserved RAM", filename.c_str());
+    loadSize = min(loadSize, (uint64_t)RAM.getSize());
+
+    // Tell the user and the DMA engine where the buffer is
+    publishSegments(filename == "-" ? "stdin" : filename, address);
+
+    // Tell the user what's taking so long...
+    printf("Loading %s into RAM at address %s\n", filename.c_str(), address.c_str());
+
+    // The CRC of every frame group in a container is computed as the data goes by
+    uint64_t groupSize = isContainer ? (uint64_t)header.framesPerGroup * header.cellsPerFrame : 1;
+    vector<uint32_t> crc(isContainer ? header.frameGroupCount : 0);
+
+    // The first few bytes of a raw stream have already arrived
+    uint8_t* dest = RAM.bptr();
+    memcpy(dest, &header, prefixSize);
+    uint64_t loaded = prefixSize;
+
+    // Copy the stream into the buffer, and keep the user informed of the throughput
+    auto start = chrono::steady_clock::now(), lastReport = start;
+    while (loaded < loadSize)
+    {
+        size_t count = reader.next(&data, loadSize - loaded);
+        if (count == 0) break;
+
+        // A container's CRCs are of the data as stored, which might be encoded
+        if (isContainer)
         {
-            perror("\nread");
-            exit(1);
+            for (size_t done = 0; done < count;)
+            {
+                uint64_t offset = loaded + done;
+                size_t   length = min((uint64_t)count - done, groupSize - offset % groupSize);
+                crc[offset / groupSize] = crc32c(crc[offset / groupSize], data + done, length);
+                done += length;
+            }
+            if (header.encoding == ENCODING_FILLER_XOR) xorBytes(data, data, count, header.fillerValue);
         }
 
-        // Copy the userspace buffer into the contiguous block of physical RAM
-        memcpy(ptr, localBuffer, blockSize);
+        memcpy(dest + loaded, data, count);
+        loaded += count;
 
-        // Bump the pointer to where the next chunk will be stored
-        ptr += blockSize;
+        auto now = chrono::steady_clock::now();
+        if (now - lastReport >= chrono::seconds(1))
+        {
+            double seconds = chrono::duration<double>(now - start).count();
+            printf("\r%'16lu bytes loaded, %'.1f MB/s", loaded, loaded / seconds / 1e6);
+            fflush(stdout);
+            lastReport = now;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("\r%'16lu bytes loaded, %'.1f MB/s\n", loaded, seconds > 0 ? loaded / seconds / 1e6 : 0.0);
 
-        // And keep track of how many bytes are left to load
-        bytesRemaining -= blockSize;
+    // A raw stream has to have ended, and a container has to have delivered all of its data
+    if (!isContainer && reader.next(&data, 1)) throwRuntime("%s is too big to fit into buffer", filename.c_str());
+    if (isContainer && loaded < loadSize) throwRuntime("%s ended early", filename.c_str());
 
-        // Compute and display the completion percentage
-        bytesLoaded += blockSize;
-        int pct = 100 * bytesLoaded / fileSize;
-        printf("\b\b\b%3i", pct);
-        fflush(stdout);
+    // The trailer of a container holds the CRC of every frame group
+    if (isContainer)
+    {
+        vector<uint32_t> expected(header.frameGroupCount);
+        for (uint64_t skip = header.trailerOffset - header.dataOffset - header.dataSize; skip;)
+        {
+            size_t count = reader.next(&data, skip);
+            if (count == 0) throwRuntime("%s ended early", filename.c_str());
+            skip -= count;
+        }
+        if (!reader.read(expected.data(), expected.size() * sizeof(uint32_t)))
+        {
+            throwRuntime("%s ended early", filename.c_str());
+        }
+
+        size_t badGroups = 0;
+        for (size_t group = 0; group < crc.size(); ++group) if (crc[group] != expected[group]) ++badGroups;
+        if (badGroups) throwRuntime("%s failed CRC check in %zu frame groups", filename.c_str(), badGroups);
     }
 
-    // Finish the "percent complete" display
-    printf("\b\b\b100\n");
+    // We're done with the stream
+    reader.stop();
+    if (fd != STDIN_FILENO) close(fd);
+}
+//=================================================================================================
 
-    // Free up the localBuffer so we don't leak memory
-    delete[] localBuffer;
+
+
+//=================================================================================================
+// verifyFile() - Displays the header of a container file and checks the CRC of every frame group
+//=================================================================================================
+void verifyFile(string filename)
+{
+    FrameFile ifile;
+
+    // Open the file.  There is no config file, so it has to be a container
+    ifile.open(filename.c_str(), 0);
+
+    // Display the header
+    auto& h = ifile.header();
+    printf("%'16u Cells per frame\n",      h.cellsPerFrame);
+    printf("%'16u Frames per frame group\n", h.framesPerGroup);
+    printf("%'16u Frame group(s)\n",       h.frameGroupCount);
+    printf("%'16lu Frames in total\n",     h.frameCount);
+    printf("%16lu Random seed\n",          h.randomSeed);
+    printf("        %08X Nucleotide file CRC\n",   h.nucleotideCrc);
+    printf("        %08X Fragment file CRC\n",     h.fragmentCrc);
+    printf("        %08X Distribution file CRC\n", h.distributionCrc);
+
+    // A compressed file is checked chunk by chunk rather than frame group by frame group, and an
+    // event file has a single CRC
+    const char* unit = ifile.isCompressed() ? "chunk" : ifile.isModel() ? "event stream" : "frame group";
+
+    // Check the CRC of every frame group
+    auto badGroups = ifile.verify();
+
+    // Report any frame groups that are corrupt
+    for (auto group : badGroups) printf("Bad %s: %u\n", unit, group);
+
+    // And tell the user the verdict
+    if (badGroups.empty())
+        printf("All %ss are valid\n", unit);
+    else
+        throwRuntime("%lu %s(s) failed CRC check", badGroups.size(), unit);
 }
 //=================================================================================================
 
 
 //=================================================================================================
-// stringTo64() - Converts a character string to a 64-bit integer after stripping out any
-//                underscore characters from the input string.  Also scales the return value
-//                according to any K, M, or G suffix on the string
+// showSummary() - Displays the shape of a summary pyramid and the statistics of the whole run.
+//                 If a level is specified, every tile of that level is displayed too, one line
+//                 per tile in CSV form
 //=================================================================================================
-uint64_t stringTo64(const string& str)
+void showSummary(string filename, int level)
 {
-    char buffer[100], *out = buffer;
-    uint64_t multiplier = 0;
+    SummaryPyramid summary;
 
-    // Point to the beginning of the input string
-    const char* in = str.c_str();
+    // Read the summary
+    summary.load(filename.c_str());
+    auto& h = summary.header();
 
-    // This loop is going to strip underscores from the input string
-    while (*in)
+    // Display the header
+    printf("%'16u Cells per frame\n",     h.cellsPerFrame);
+    printf("%'16lu Frames in total\n",    h.frameCount);
+    printf("%'16u Cells per tile\n",      h.tileCells);
+    printf("%'16u Frames per block\n",    h.blockFrames);
+
+    // Display the shape of each level
+    for (uint32_t i = 0; i < h.levelCount; ++i)
     {
-        // If we've reached the end of the input string, we're done
-        if (*in == 0) break;
+        printf("Level %2u: %'8u tiles x %'8u blocks (%'lu cells x %'lu frames each)\n", i,
+                h.level[i].tilesAcross, h.level[i].blocks, h.level[i].tileCells, h.level[i].blockFrames);
+    }
 
-        // If we're at the last character of the output buffer, we're done
-        if ((out - buffer) == sizeof(buffer)-1) break;
+    // The top of the pyramid describes the entire run
+    auto& top = summary.at(h.levelCount - 1, 0, 0);
+    double samples = top.samples ? top.samples : 1;
+    printf("Whole run: min %u, max %u, mean %.3f, %.3f%% active\n", 
+            top.min, top.max, top.sum / samples, 100.0 * top.active / samples);
 
-        // If the input character is an underscore, skip it
-        if (*in == '_')
+    // If the caller didn't ask for a level, we're done
+    if (level < 0) return;
+    if (level >= (int)h.levelCount) throwRuntime("%s has no level %d", filename.c_str(), level);
+
+    // Display every tile of the level
+    printf("block,tile,first_frame,first_cell,min,max,mean,active\n");
+    for (uint32_t block = 0; block < h.level[level].blocks; ++block)
+    {
+        for (uint32_t tile = 0; tile < h.level[level].tilesAcross; ++tile)
         {
-            ++in;
-            continue;
+            auto& s = summary.at(level, block, tile);
+            double n = s.samples ? s.samples : 1;
+            printf("%u,%u,%lu,%lu,%u,%u,%.3f,%lu\n", block, tile, block * h.level[level].blockFrames,
+                    tile * h.level[level].tileCells, s.min, s.max, s.sum / n, s.active);
         }
+    }
+}
+//=================================================================================================
 
-        // Move the input character to the output buffer
-        *out++ = *in++;
+
+//=================================================================================================
+// reportMarkers() - Reports the first few problems a marker checker found, and its statistics
+//=================================================================================================
+void reportMarkers(MarkerChecker& checker)
+{
+    static const char* kindName[] = {"gap", "duplicate", "out of order", "no marker", "bad CRC"};
+    uint32_t reported = 0;
+
+    // Report the first few problems in detail
+    for (auto& a : checker.anomalies())
+    {
+        if (++reported > 10) break;
+        if (a.kind == MarkerChecker::GAP)
+            printf("Position %lu: %s, expected frame %lu, found %lu\n", a.position, kindName[a.kind], a.expected, a.found);
+        else if (a.kind == MarkerChecker::BAD_MARKER)
+            printf("Position %lu: %s\n", a.position, kindName[a.kind]);
+        else
+            printf("Position %lu: %s, frame %lu\n", a.position, kindName[a.kind], a.found);
     }
 
-    // Nul-terminate the output string
-    *out = 0;
+    // And then the totals
+    printf("%'16lu Frames checked\n",   checker.framesChecked());
+    printf("%'16lu First frame\n",      checker.firstFrame());
+    printf("%'16lu Last frame\n",       checker.lastFrame());
+    printf("%'16lu Frames dropped\n",   checker.dropped());
+    printf("%'16lu Frames duplicated\n", checker.duplicated());
+    printf("%'16lu Frames out of order\n", checker.reordered());
+    printf("%'16lu Frames without a marker\n", checker.badMarkers());
+    printf("%'16lu Frames with a bad CRC\n", checker.badCrcs());
+}
+//=================================================================================================
 
-    // If the buffer is empty, the result is 0
-    if (buffer[0] == 0) return 0;
 
-    // Fetch the final character
-    char letter = *(out-1);
+//=================================================================================================
+// checkMarkers() - Checks the frame markers in a capture of frames, which is either a file (in
+//                  any format) or the contiguous buffer, and reports every frame that was 
+//                  dropped, duplicated, reordered, or damaged on its way there
+//=================================================================================================
+void checkMarkers(string source)
+{
+    FrameFile      ifile;
+    MarkerChecker  checker;
+    const uint8_t* frames = nullptr;
+    uint64_t       frameCount;
+    uint32_t       frameSize = config.cells_per_frame;
 
-    // Use the suffix (if any) to determine the multiplier
-         if (letter >= '0' && letter <= '9') multiplier = 1;
-    else if (letter >= 'a' && letter <= 'f') multiplier = 1;
-    else if (letter >= 'A' && letter <= 'F') multiplier = 1;
-    else if (letter == 'K') multiplier = 1024;
-    else if (letter == 'M') multiplier = 1024 * 1024;
-    else if (letter == 'G') multiplier = 1024 * 1024 * 1024;
+    // We need to know where the markers are
+    if (config.marker_cell == 0) throwRuntime("marker_cell isn't configured");
 
-    // If an invalid suffix was specified, whine about it
-    if (multiplier == 0) throwRuntime("Invalid suffix on %s", str.c_str());
+    // A capture in the contiguous buffer is checked in place
+    if (source.compare(0, 4, "ram:") == 0)
+    {
+        if (geteuid() != 0) throw runtime_error("Must be root to run.  Use sudo.");
+        string address = source.substr(4);
+        mapRAM(address, address.compare(0, 5, "huge:") == 0 ? 0 : config.ring_buffer_size);
+        frames     = RAM.bptr();
+        frameCount = RAM.getSize() / frameSize;
+    }
 
-    // If there was a suffix on the string, remove it
-    if (multiplier > 1) *(out-1) = 0;
+    // Otherwise it's a file.  Raw frame data is checked right where it's mapped
+    else
+    {
+        ifile.open(source.c_str(), config.cells_per_frame);
+        frameSize  = ifile.cellsPerFrame();
+        frameCount = ifile.frameCount();
+        if (ifile.isRawData() && !ifile.hasLayout()) frames = ifile.frame(0);
+    }
 
-    // Convert the ASCII string to a numeric value
-    int64_t value = stoull(buffer, 0, radix(buffer));
+    // Make sure the marker fits in the frames
+    if (config.marker_cell - 1 + sizeof(frame_marker_t) > frameSize)
+    {
+        throwRuntime("The frame marker at cell %u doesn't fit in the frame", config.marker_cell);
+    }
 
-    // Hand the resulting value to the caller
-    return value * multiplier;
+    // Check every frame in the capture
+    auto start = chrono::steady_clock::now();
+    checker.create(frameSize, config.marker_cell);
+    if (frames)
+        checker.check(frames, frameCount);
+    else
+    {
+        // Frames that have to be decoded are checked a batch at a time
+        const uint32_t batchFrames = 256;
+        vector<uint8_t> batch((size_t)batchFrames * frameSize);
+        for (uint64_t first = 0; first < frameCount; first += batchFrames)
+        {
+            uint64_t count = frameCount - first < batchFrames ? frameCount - first : batchFrames;
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                memcpy(batch.data() + i * frameSize, ifile.frame(first + i), frameSize);
+            }
+            checker.check(batch.data(), count);
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Report what we found
+    reportMarkers(checker);
+    if (seconds > 0) printf("%'16.1f MB/s checked\n", (double)frameCount * frameSize / seconds / 1e6);
 }
 //=================================================================================================
 
 
-
 //=================================================================================================
-// loadFile() - Loads a data-file into RAM at a defined physical address
+// consume() - Attaches to a frame channel and emulates a consumer, reading every frame the 
+//             producer publishes and checking its frame marker.  Reports how fast the frames
+//             arrived, and how long we spent waiting for them
 //=================================================================================================
-void loadFile(string filename, string address)
+void consume(string socketName)
 {
-    // Ensure that we're running as the root user
-    if (geteuid() != 0) throw runtime_error("Must be root to run.  Use sudo.");
+    Consumer consumer;
 
-    // Open the data file
-    int fd = open(filename.c_str(), O_RDONLY);
-    if (fd < 0) throwRuntime("Can't open '%s'", filename.c_str());
+    // Connect to the producer
+    consumer.attach(socketName.c_str());
+    auto& h = consumer.header();
+    printf("Attached to %s, %'u cells per frame, %'u slots\n", socketName.c_str(), h.cellsPerFrame, h.slotCount);
+    if (config.marker_cell && config.marker_cell - 1 + sizeof(frame_marker_t) > h.cellsPerFrame)
+    {
+        throwRuntime("The frame marker at cell %u doesn't fit in the frame", config.marker_cell);
+    }
+    fflush(stdout);
 
-    // Find out how big the input file is
-    size_t fileSize = getFileSize(fd);
+    // Read frames until the producer is done
+    consumer.run(config.consume_rate, config.marker_cell);
+    uint64_t frameSize = h.cellsPerFrame;
+    consumer.detach();
+
+    // Report the results
+    double seconds = consumer.elapsed() / 1e9;
+    uint64_t frames = consumer.framesConsumed();
+    if (config.marker_cell) reportMarkers(consumer.checker());
+    printf("%'16lu Frames consumed\n", frames);
+    if (seconds > 0)
+    {
+        printf("%'16.1f Frames per second\n", frames / seconds);
+        printf("%'16.1f MB/s consumed\n", frames * frameSize / seconds / 1e6);
+        printf("%'16.1f%% Time waiting for the producer\n", 100 * consumer.waiting() / consumer.elapsed());
+    }
+    if (config.consume_rate > 0) printf("%'16lu Deadlines missed\n", consumer.missedDeadlines());
+}
+//=================================================================================================
 
-    // Find out how large our contiguous buffer is
-    size_t sizeLimit = stringTo64(cmdLine.sizeLimit);
 
-    // Ensure that the file doesn't exceed the size of the buffer it's being loaded in to
-    if (fileSize > sizeLimit) throwRuntime("%s is too big to fit into buffer", filename.c_str());
+//=================================================================================================
+// compareFiles() - Compares the frames in two output files, which can be in any format, and
+//                  reports the frames that differ
+//=================================================================================================
+void compareFiles(string filename1, string filename2)
+{
+    FrameFile file1, file2;
+    uint64_t  differences = 0;
 
-    // Convert the string-form of the address to binary
-    uint64_t physAddr = stringTo64(address);
+    // Open both files.  Raw files use the frame size from the configuration file
+    file1.open(filename1.c_str(), config.cells_per_frame);
+    file2.open(filename2.c_str(), config.cells_per_frame);
 
-    // Make at least minimal effort to ensure the user doesn't blow away their system
-    if (physAddr == 0) throwRuntime("Loading to RAM address 0 not permitted");
+    // If the frames aren't the same size, there's nothing to compare
+    if (file1.cellsPerFrame() != file2.cellsPerFrame())
+    {
+        throwRuntime("%s and %s have different frame sizes", filename1.c_str(), filename2.c_str());
+    }
 
-    // Tell the user what we're doing...
-    printf("Mapping RAM...\n");
+    // Find out how many frames we can compare
+    uint32_t frameSize  = file1.cellsPerFrame();
+    uint64_t frameCount = file1.frameCount();
+    if (file2.frameCount() < frameCount) frameCount = file2.frameCount();
 
-    // Map the physical RAM space
-    RAM.map(physAddr, fileSize);
+    // Compare the frames one by one.  The first few differences get reported in detail
+    for (uint64_t frameNumber = 0; frameNumber < frameCount; ++frameNumber)
+    {
+        const uint8_t* frame1 = file1.frame(frameNumber);
+        const uint8_t* frame2 = file2.frame(frameNumber);
+        if (memcmp(frame1, frame2, frameSize) == 0) continue;
 
-    // Tell the user what's taking so long...
-    printf("Loading %s into RAM at address %s\n", filename.c_str(), address.c_str());
+        if (++differences <= 10)
+        {
+            uint32_t cell = 0;
+            while (frame1[cell] == frame2[cell]) ++cell;
+            printf("Frame %lu differs, first at cell %u (%u vs %u)\n", 
+                    frameNumber, cell, frame1[cell], frame2[cell]);
+        }
+    }
 
-    // Load the data file into the RAM buffer
-    fillBuffer(fd, fileSize);
+    // Report the results
+    if (file1.frameCount() != file2.frameCount())
+    {
+        printf("Frame counts differ: %lu vs %lu\n", file1.frameCount(), file2.frameCount());
+    }
 
-    // Close the input file, we're done
-    close(fd);
+    printf("%'16lu Frames compared\n", frameCount);
+    printf("%'16lu Frames differ\n", differences);
 }
 //=================================================================================================
 
 
+//=================================================================================================
+// replay() - Sends frames to a consumer at the configured frame rate.  The frames come from an
+//            existing output file (in any format) or, if no filename is given, are built on the
+//            fly from the configuration
+//=================================================================================================
+void replay(string destination, string filename)
+{
+    FrameFile  ifile;
+    FrameModel model;
+    PatternGenerator patterns;
+    Replayer   replayer;
+    uint64_t   frameCount;
+    uint32_t   frameSize;
+    Replayer::source_t source;
+
+    // If we've been given a file, the frames come from there
+    if (!filename.empty())
+    {
+        ifile.open(filename.c_str(), config.cells_per_frame);
+        frameSize  = ifile.cellsPerFrame();
+        frameCount = ifile.frameCount();
+        source = [&](uint64_t n, uint8_t* frame) {memcpy(frame, ifile.frame(n), frameSize);};
+    }
+
+    // If we're replaying a test pattern, build the frames of that
+    else if (config.test_pattern != "none")
+    {
+        patterns.create(config.test_pattern, config.cells_per_frame, config.marker_cell);
+        frameSize  = config.cells_per_frame;
+        frameCount = testPatternLength();
+        frameCount = (frameCount + config.data_frames - 1) / config.data_frames * config.data_frames;
+        source = [&](uint64_t n, uint8_t* frame) {patterns.buildFrame(n, frame);};
+    }
+
+    // Otherwise, compile the distribution into a model and build the frames from that
+    else
+    {
+        loadNucleotides();
+        loadFragments();
+        loadDistribution();
+        uint32_t frameGroupCount = verifyDistributionIsValid();
+        compileModel(model, (uint64_t)frameGroupCount * config.data_frames);
+        frameSize  = config.cells_per_frame;
+        frameCount = model.frameCount();
+        source = [&](uint64_t n, uint8_t* frame) {model.buildFrame(n, frame);};
+    }
+
+    // Open the destination.  This may wait for a consumer to show up
+    if (destination.compare(0, 8, "channel:") == 0)
+    {
+        const char* socketName = destination.c_str() + 8;
+        printf("Waiting for consumers on %s\n", socketName);
+        fflush(stdout);
+        replayer.openChannel(socketName, frameSize, config.data_frames, frameCount, config.channel_slots);
+    }
+    else replayer.open(destination.c_str(), frameSize);
+
+    // Send the frames
+    printf("Replaying %lu frames at %g frames per second\n", frameCount, config.frame_rate);
+    replayer.run(frameCount, config.frame_rate, config.replay_lookahead, source);
+    replayer.close();
+
+    // Tell the user how well we kept to the schedule
+    printf("%'16lu Frames sent\n",              replayer.framesSent());
+    printf("%'16lu Deadlines missed\n",         replayer.missedDeadlines());
+    printf("%'16lu Lookahead underruns\n",      replayer.underruns());
+    printf("%'16.1f Mean lateness (usec)\n",    replayer.meanLateness() / 1000);
+    printf("%'16.1f Maximum lateness (usec)\n", replayer.maxLateness()  / 1000);
+    printf("%'16.1f Jitter (usec)\n",           replayer.jitter()       / 1000);
+}
+//=================================================================================================
+
 
 //=================================================================================================
 // printDictionary() - Display the name of each fragment along with its length (in frames), then
@@ -1317,5 +3115,106 @@ void printDictionary()
 //=================================================================================================
 
 
+//=================================================================================================
+// buildCellIndex() - Indexes the cells that each distribution record covers
+//=================================================================================================
+void buildCellIndex(CellIndex& index)
+{
+    vector<CellIndex::cellrange_t> ranges;
+
+    for (auto& dr : distributionList) ranges.push_back({(uint32_t)dr.first, (uint32_t)dr.last, (uint32_t)dr.step});
+
+    index.build(ranges);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// describeRecord() - Displays a distribution record on a single line
+//=================================================================================================
+void describeRecord(uint32_t index, const char* note)
+{
+    auto& dr = distributionList[index];
+    printf("  line %5i: cells %i to %i step %i, %zu frames%s\n", dr.line, dr.first, dr.last, 
+           dr.step, dr.cellValue.size(), note);
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// showCells() - Displays the distribution records that cover a cell or a range of cells.  Cells
+//               are numbered from 1, as they are in the distribution file
+//
+// When several records cover a cell, the last of them wins, for as long as its sequence plays.
+// For a single cell, each record is shown with the frames in which it decides the cell's value
+//=================================================================================================
+void showCells(uint32_t firstCell, uint32_t lastCell)
+{
+    CellIndex index;
+    buildCellIndex(index);
+
+    // A single cell
+    if (firstCell == lastCell)
+    {
+        auto records = index.at(firstCell);
+        printf("Cell %u is covered by %zu distribution record(s)\n", firstCell, records.size());
+
+        // A record is in effect from the frame where every later record's sequence has ended,
+        // up to the end of its own sequence.  Work backwards to find where that is
+        vector<size_t> from(records.size());
+        size_t later = 0;
+        for (size_t i = records.size(); i-- > 0;)
+        {
+            from[i] = later;
+            later   = max(later, distributionList[records[i]].cellValue.size());
+        }
+
+        for (size_t i = 0; i < records.size(); ++i)
+        {
+            char   note[64];
+            size_t end = distributionList[records[i]].cellValue.size();
+            if (from[i] < end)
+                sprintf(note, "  <- frames %zu to %zu", from[i], end - 1);
+            else
+                sprintf(note, "  <- never in effect");
+            describeRecord(records[i], note);
+        }
+        return;
+    }
+
+    // A range of cells
+    auto records = index.within(firstCell, lastCell);
+    printf("Cells %u to %u are covered by %zu distribution record(s)\n", firstCell, lastCell, records.size());
+    for (auto r : records) describeRecord(r, "");
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// showOverlaps() - Lists the pairs of distribution records that have cells in common.  Where 
+//                  they do, the later record overwrites the earlier one
+//=================================================================================================
+void showOverlaps()
+{
+    // We list no more than this many pairs
+    const size_t MAX_PAIRS = 100;
+
+    CellIndex index;
+    uint64_t  total;
+    uint32_t  cell;
 
+    buildCellIndex(index);
+    auto pairs = index.overlaps(MAX_PAIRS, &total);
 
+    printf("%'16lu Pairs of distribution records have cells in common\n", total);
+    for (auto& p : pairs)
+    {
+        auto& a = distributionList[p.first];
+        auto& b = distributionList[p.second];
+        CellIndex::firstShared(index.range(p.first), index.range(p.second), &cell);
+        printf("  line %5i (cells %i to %i step %i) and line %5i (cells %i to %i step %i), from cell %u\n",
+               a.line, a.first, a.last, a.step, b.line, b.first, b.last, b.step, cell);
+    }
+    if (total > pairs.size()) printf("  ... and %'lu more\n", total - pairs.size());
+}
+//=================================================================================================
@@ -0,0 +1,21 @@
+//=================================================================================================
+// marker.h - Defines the frame marker that can be embedded in every data frame
+//
+// When "marker_cell" is configured, the 16 cells starting at that cell (numbered from 1) of
+// every frame are overwritten with a frame_marker_t.  The marker carries the number of the frame
+// and a CRC-32C of every other cell in the frame, computed over the cells before the marker
+// and then the cells after it.  A consumer at the far end of a DMA path can then tell, from the
+// frames alone, whether any were dropped, duplicated, reordered, or damaged along the way.
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+// The first 4 bytes of every frame marker
+#define MARKER_MAGIC "SFGM"
+
+struct frame_marker_t
+{
+    char     magic[4];
+    uint32_t crc;
+    uint64_t frameNumber;
+};
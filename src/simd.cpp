@@ -0,0 +1,93 @@
+//=================================================================================================
+// simd.cpp - Vectorized helper routines for operating on data frames
+//
+// These use SSE2, which every x86-64 CPU has, so no run-time CPU detection is required.   On
+// other architectures they fall back to plain C++.
+//=================================================================================================
+#include <string.h>
+#include "simd.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+
+//=================================================================================================
+// xorBytes() - Copies a buffer, exclusive-ORing every byte with 'value'
+//=================================================================================================
+void xorBytes(uint8_t* dst, const uint8_t* src, size_t length, uint8_t value)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    const __m128i mask = _mm_set1_epi8((char)value);
+
+    // Handle 64 bytes per iteration
+    for (; i + 64 <= length; i += 64)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i     ));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(src + i + 48));
+        _mm_storeu_si128((__m128i*)(dst + i     ), _mm_xor_si128(a, mask));
+        _mm_storeu_si128((__m128i*)(dst + i + 16), _mm_xor_si128(b, mask));
+        _mm_storeu_si128((__m128i*)(dst + i + 32), _mm_xor_si128(c, mask));
+        _mm_storeu_si128((__m128i*)(dst + i + 48), _mm_xor_si128(d, mask));
+    }
+#endif
+
+    // Handle whatever is left over a byte at a time
+    for (; i < length; ++i) dst[i] = src[i] ^ value;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// isAllZero() - Returns true if every byte in the buffer is zero
+//=================================================================================================
+bool isAllZero(const uint8_t* p, size_t length)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    // OR together 64 bytes at a time, and check the result for zero
+    for (; i + 64 <= length; i += 64)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i     ));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(p + i + 48));
+        __m128i x = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF) return false;
+    }
+#endif
+
+    // Check whatever is left over a byte at a time
+    for (; i < length; ++i) if (p[i]) return false;
+
+    return true;
+}
+//=================================================================================================
+
+
+//=================================================================================================
+// blendBlocks() - Masks 16-byte blocks of a frame and overlays new values on them
+//=================================================================================================
+void blendBlocks(uint8_t* frame, const uint32_t* offsets, const uint8_t* keep,
+                 const uint8_t* value, size_t count)
+{
+    for (size_t k = 0; k < count; ++k, keep += 16, value += 16)
+    {
+        uint8_t* p = frame + offsets[k];
+
+#if defined(__x86_64__)
+        __m128i x = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_loadu_si128((const __m128i*)keep);
+        __m128i v = _mm_loadu_si128((const __m128i*)value);
+        _mm_storeu_si128((__m128i*)p, _mm_or_si128(_mm_and_si128(x, m), v));
+#else
+        for (int i = 0; i < 16; ++i) p[i] = (p[i] & keep[i]) | value[i];
+#endif
+    }
+}
+//=================================================================================================
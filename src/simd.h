@@ -0,0 +1,18 @@
+//=================================================================================================
+// simd.h - Vectorized helper routines for operating on data frames
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Copies 'length' bytes from 'src' to 'dst', exclusive-ORing every byte with 'value'.
+// 'src' and 'dst' may be the same buffer
+void    xorBytes(uint8_t* dst, const uint8_t* src, size_t length, uint8_t value);
+
+// Returns true if every one of the 'length' bytes at 'p' is zero
+bool    isAllZero(const uint8_t* p, size_t length);
+
+// For each of 'count' 16-byte blocks of 'frame', starting at 'offsets[k]', replaces every byte
+// 'x' with (x & keep[16*k + i]) | value[16*k + i]
+void    blendBlocks(uint8_t* frame, const uint32_t* offsets, const uint8_t* keep,
+                    const uint8_t* value, size_t count);
@@ -0,0 +1,72 @@
+//=================================================================================================
+// summary.h - Defines the layout of the summary pyramid written next to the output file
+//
+// The summary file (the output file name with ".summary" appended) describes the run at several
+// resolutions.  At level 0, every frame is divided into tiles of 'tileCells' cells, and the run
+// is divided into blocks of 'blockFrames' frames.  Each (block, tile) pair is summarized by a
+// single summary_t.  Every level after that halves the resolution in each direction that has
+// more than one tile (or block) left, and the last level is a single summary_t that describes
+// the entire run:
+//
+//     +-------------------------+  offset 0
+//     | summary_header_t        |
+//     +-------------------------+  offset header.level[0].offset
+//     | summary_t[level 0]      |  blocks x tilesAcross, one row of tiles per block
+//     +-------------------------+  offset header.level[1].offset
+//     | summary_t[level 1]      |
+//     +-------------------------+
+//     |  ...                    |
+//     +-------------------------+
+//
+// Tiles at the right hand edge of a frame and blocks at the end of the run may be partial ones,
+// which is why every summary_t says how many samples it covers.
+//=================================================================================================
+#pragma once
+#include <stdint.h>
+
+// The first 8 bytes of every summary file
+#define SUMMARY_MAGIC "SFGSUMM1"
+
+// The most levels a summary pyramid can have
+const uint32_t SUMMARY_MAX_LEVELS = 48;
+
+// Statistics about every cell value in a tile, over every frame in a block.  A cell is "active"
+// if its value isn't the filler value
+struct summary_t
+{
+    uint8_t  min;
+    uint8_t  max;
+    uint8_t  reserved[6];
+    uint64_t samples;
+    uint64_t active;
+    uint64_t sum;
+};
+
+// Describes a single level of the pyramid
+struct summary_level_t
+{
+    uint32_t tilesAcross;
+    uint32_t blocks;
+    uint64_t tileCells;
+    uint64_t blockFrames;
+    uint64_t offset;
+};
+
+struct summary_header_t
+{
+    char     magic[8];
+    uint32_t headerSize;
+    uint32_t cellsPerFrame;
+    uint32_t tileCells;
+    uint32_t blockFrames;
+    uint64_t frameCount;
+    uint32_t fillerValue;
+    uint32_t levelCount;
+    summary_level_t level[SUMMARY_MAX_LEVELS];
+
+    // CRC-32C of every summary_t in the file
+    uint32_t dataCrc;
+
+    // CRC-32C of all of the above fields
+    uint32_t headerCrc;
+};